@@ -0,0 +1,93 @@
+#include "DistanceTransform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+void DistanceTransform1D(const double *f, size_t n, double *d,
+                         std::vector<size_t> &v, std::vector<double> &z)
+{
+  const double INF = std::numeric_limits<double>::infinity();
+
+  v.resize(n);
+  z.resize(n + 1);
+
+  // v[0..k] are sources of parabolas of the envelope, parabola v[k] is the
+  // lowest one between z[k] and z[k+1].
+  size_t k = 0;
+  bool found = false;
+  for (size_t q = 0; q < n; ++q) {
+    if (std::isinf(f[q]))
+      continue;
+
+    if (!found) {
+      found = true;
+      v[0] = q;
+      z[0] = -INF;
+      z[1] = INF;
+      continue;
+    }
+
+    const double fq = f[q] + double(q) * double(q);
+    double s = 0.0;
+    while (true) {
+      const double p = double(v[k]);
+      s = (fq - (f[v[k]] + p * p)) / (2.0 * (double(q) - p));
+      if (s <= z[k] && k > 0)
+        --k;
+      else
+        break;
+    }
+
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = INF;
+  }
+
+  if (!found) {
+    for (size_t q = 0; q < n; ++q)
+      d[q] = INF;
+    return;
+  }
+
+  k = 0;
+  for (size_t q = 0; q < n; ++q) {
+    while (z[k + 1] < double(q))
+      ++k;
+    const double dist = double(q) - double(v[k]);
+    d[q] = dist * dist + f[v[k]];
+  }
+}
+
+
+void SquaredDistanceTransform(const Image<uint8_t> &features,
+                              Image<double> &result)
+{
+  const double INF = std::numeric_limits<double>::infinity();
+  const size_t height = features.getHeight();
+  const size_t width = features.getWidth();
+
+  result = Image<double>(height, width);
+
+  std::vector<size_t> v;
+  std::vector<double> z;
+  std::vector<double> f(std::max(height, width));
+  std::vector<double> d(std::max(height, width));
+
+  // Columns first, then rows of column distances.
+  for (size_t j = 0; j < width; ++j) {
+    for (size_t i = 0; i < height; ++i)
+      f[i] = features(i, j) ? 0.0 : INF;
+    DistanceTransform1D(f.data(), height, d.data(), v, z);
+    for (size_t i = 0; i < height; ++i)
+      result(i, j) = d[i];
+  }
+
+  for (size_t i = 0; i < height; ++i) {
+    auto resultRow = result.row(i);
+    std::copy(resultRow.begin(), resultRow.end(), f.begin());
+    DistanceTransform1D(f.data(), width, resultRow.data(), v, z);
+  }
+}
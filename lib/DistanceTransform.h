@@ -0,0 +1,42 @@
+/**
+ * @file lib/DistanceTransform.h
+ *
+ * @brief Header with declaration of Euclidean distance transforms.
+ *
+ * Distance transforms are exact and take linear time: they follow
+ * P. Felzenszwalb, D. Huttenlocher. Distance Transforms of Sampled Functions.
+ * Theory of Computing, 8(19), 2012.
+ */
+
+
+#pragma once
+
+#include "Image.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * @brief Lower envelope of parabolas, 1D squared distance transform.
+ *
+ * d[q] = min over p of (q - p)^2 + f[p]. Samples with infinite f are not
+ * sources, d is infinite everywhere if there are no finite samples.
+ *
+ * @param [in] f Sampled function, @p n values.
+ * @param [out] d Transform, @p n values. Must not overlap @p f.
+ * @param [in,out] v, z Workspace, resized as needed.
+ */
+void DistanceTransform1D(const double *f, size_t n, double *d,
+                         std::vector<size_t> &v, std::vector<double> &z);
+
+
+/**
+ * @brief Squared Euclidean distance transform of a binary image.
+ *
+ * @param [in] features Pixels with non-zero values are features.
+ * @param [out] result Squared distance from every pixel to the nearest
+ *                     feature, infinity if there are no features.
+ */
+void SquaredDistanceTransform(const Image<uint8_t> &features,
+                              Image<double> &result);
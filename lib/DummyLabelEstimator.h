@@ -4,15 +4,17 @@
 
 
 template <class LabelType>
-class DummyLabelEstimator : public MultipointLabelEstimator<LabelType> {
+class DummyLabelEstimator
+  : public MultipointLabelEstimator<DummyLabelEstimator<LabelType>, LabelType>
+{
 public:
 
-  using SuperClass = MultipointLabelEstimator<LabelType>;
+  using SuperClass =
+    MultipointLabelEstimator<DummyLabelEstimator<LabelType>, LabelType>;
   using CandidateContainer = typename SuperClass::CandidateContainer;
   using WeightType = typename SuperClass::WeightType;
 
-  virtual LabelType
-  EstimateLabel(const CandidateContainer &candidates) const override final {
+  LabelType Estimate(const CandidateContainer &candidates) const {
     auto i = candidates.size() / 2;
     return candidates[i].first;
   }
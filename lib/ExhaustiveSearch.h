@@ -0,0 +1,328 @@
+/**
+ * @file lib/ExhaustiveSearch.h
+ *
+ * @brief Header file with definition of ExhaustiveSearch class.
+ */
+
+
+#pragma once
+
+#include "Image.h"
+#include "SSD.h"
+
+#include "util/thread/ParallelFor.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Exact nearest neighbor field of the OPAL search space.
+ *
+ * OPAL only copies offsets between pixels, so every offset it can reach is
+ * one given by constrained initialization: any template, offset within the
+ * initialization window, destination inside the image. This class checks
+ * all of them, which gives the field PatchMatch approximates. It is slow,
+ * but serves as a reference for OPAL and faster engines.
+ *
+ * Run calculates SSDs by SSD class from scratch, so costs are bit-exact
+ * with SSDs OPAL calculates for the same matches. RunSummedAreas gets the
+ * same field much faster for large windows and patches.
+ *
+ * @tparam TDb Type of image database. Must be ImageDatabase.
+ */
+template <class TDb>
+class ExhaustiveSearch {
+public:
+  using SSDType  = SSD<TDb>;
+  using CostType = typename SSDType::ValueType;
+
+  /// Best match of a single pixel.
+  struct Match {
+    int      offsetX;
+    int      offsetY;
+    size_t   t;    ///< Index of template in database.
+    CostType cost; ///< SSD of the match.
+  };
+
+  /**
+   * @param [in] database Image to be segmented is database[0]. Images must
+   *                      be padded by at least @p patchRadius.
+   * @param [in] patchRadius Radius of patches.
+   * @param [in] windowRadius Radius of initialization window.
+   *
+   * @throws std::logic_error if the database can't be used.
+   */
+  ExhaustiveSearch(const TDb &database, size_t patchRadius,
+                   size_t windowRadius);
+
+  /**
+   * @returns Match with the least cost for pixel (i,j). Of matches with
+   * equal costs, the one with the least t, then offsetY, then offsetX.
+   */
+  Match FindBestMatch(size_t i, size_t j) const;
+
+  /// Find best matches of all pixels, rows are shared between threads.
+  void Run(size_t threadCount = util::HardwareConcurrency());
+
+  /**
+   * @brief Find best matches of all pixels with summed-area tables.
+   *
+   * For every template and offset, squared differences of the images are
+   * summed into a table once, and SSD of every pixel is read from it with
+   * 4 lookups. That's O(N * W^2) per template instead of O(N * W^2 * r^2),
+   * where W is window side and r is patch radius.
+   *
+   * Gives the same field as Run up to rounding of costs, exactly the same
+   * for images with integer pixels. Bands of rows are shared between threads.
+   */
+  void RunSummedAreas(size_t threadCount = util::HardwareConcurrency());
+
+  /// @return X-coordinate offsets of best matches, valid after Run.
+  const Image<int>& getFieldX() const { return FieldX; }
+
+  /// @return Y-coordinate offsets of best matches, valid after Run.
+  const Image<int>& getFieldY() const { return FieldY; }
+
+  /// @return Indexes of templates of best matches, valid after Run.
+  const Image<size_t>& getFieldT() const { return FieldT; }
+
+  /// @return SSDs of best matches, valid after Run.
+  const Image<CostType>& getCosts() const { return Costs; }
+
+private:
+  /// FindBestMatch with SSD kernels for patch radius R.
+  template <size_t R>
+  Match FindBestMatchWith(size_t i, size_t j) const;
+
+  /// Select FindBestMatchWith for PatchRadius.
+  void SelectKernels();
+
+  /// Resize output fields, costs are set to infinity.
+  void ResetFields();
+
+  /// Best matches of rows [firstRow, lastRow) for RunSummedAreas.
+  void SearchBand(size_t firstRow, size_t lastRow);
+
+private:
+  const TDb &Database;
+
+  /// Keeps all pairs of the database in memory during the search.
+  std::vector<typename TDb::PinGuard> DatabasePins;
+
+  size_t PatchRadius;
+  int    WindowRadius;
+
+  /// FindBestMatchWith for the patch radius, see SelectKernels.
+  Match (ExhaustiveSearch::*SearchPixel)(size_t, size_t) const;
+
+  size_t ImageHeight;
+  size_t ImageWidth;
+
+  Image<int>      FieldX;
+  Image<int>      FieldY;
+  Image<size_t>   FieldT;
+  Image<CostType> Costs;
+};
+
+
+// ===== Implementation below =====
+
+template <class TDb>
+ExhaustiveSearch<TDb>::ExhaustiveSearch(const TDb &database,
+                                        size_t patchRadius,
+                                        size_t windowRadius)
+  : Database(database)
+  , PatchRadius(patchRadius)
+  , WindowRadius(static_cast<int>(windowRadius))
+{
+  if (Database.GetImageCount() < 2)
+    throw std::logic_error("Image database contains no templates!");
+  if (Database.GetBorder() < PatchRadius)
+    throw std::logic_error("Images in database are not padded enough!");
+
+  DatabasePins.reserve(Database.GetImageCount());
+  for (size_t t = 0; t < Database.GetImageCount(); ++t)
+    DatabasePins.emplace_back(Database, t);
+
+  ImageHeight = Database.GetImageHeight();
+  ImageWidth = Database.GetImageWidth();
+
+  SelectKernels();
+}
+
+
+template <class TDb>
+void ExhaustiveSearch<TDb>::SelectKernels()
+{
+  switch (PatchRadius) {
+  case 1: SearchPixel = &ExhaustiveSearch::FindBestMatchWith<1>; break;
+  case 2: SearchPixel = &ExhaustiveSearch::FindBestMatchWith<2>; break;
+  case 3: SearchPixel = &ExhaustiveSearch::FindBestMatchWith<3>; break;
+  case 4: SearchPixel = &ExhaustiveSearch::FindBestMatchWith<4>; break;
+  case 5: SearchPixel = &ExhaustiveSearch::FindBestMatchWith<5>; break;
+  default:
+    SearchPixel =
+      &ExhaustiveSearch::FindBestMatchWith<SSDType::DYNAMIC_RADIUS>;
+  }
+}
+
+
+template <class TDb>
+typename ExhaustiveSearch<TDb>::Match
+ExhaustiveSearch<TDb>::FindBestMatch(size_t i, size_t j) const
+{
+  return (this->*SearchPixel)(i, j);
+}
+
+
+template <class TDb>
+template <size_t R>
+typename ExhaustiveSearch<TDb>::Match
+ExhaustiveSearch<TDb>::FindBestMatchWith(size_t i, size_t j) const
+{
+  // Destination must stay inside the image, as in OPAL initialization.
+  const int y = static_cast<int>(i);
+  const int x = static_cast<int>(j);
+  const int minY = std::max(-WindowRadius, -y);
+  const int maxY = std::min(WindowRadius, static_cast<int>(ImageHeight) - 1 - y);
+  const int minX = std::max(-WindowRadius, -x);
+  const int maxX = std::min(WindowRadius, static_cast<int>(ImageWidth) - 1 - x);
+
+  Match best = { 0, 0, 1, std::numeric_limits<CostType>::infinity() };
+
+  for (size_t t = 1; t < Database.GetImageCount(); ++t)
+    for (int dy = minY; dy <= maxY; ++dy)
+      for (int dx = minX; dx <= maxX; ++dx) {
+        auto ssd = SSDType::template Calculate<R>(Database, t, j, i, j + dx,
+                                                  i + dy, PatchRadius);
+        if (ssd.GetValue() < best.cost)
+          best = Match{ dx, dy, t, ssd.GetValue() };
+      }
+
+  return best;
+}
+
+
+template <class TDb>
+void ExhaustiveSearch<TDb>::ResetFields()
+{
+  FieldX.Resize(ImageHeight, ImageWidth);
+  FieldY.Resize(ImageHeight, ImageWidth);
+  FieldT.Resize(ImageHeight, ImageWidth);
+  Costs.Resize(ImageHeight, ImageWidth);
+
+  FieldX.Fill(0);
+  FieldY.Fill(0);
+  FieldT.Fill(1);
+  Costs.Fill(std::numeric_limits<CostType>::infinity());
+}
+
+
+template <class TDb>
+void ExhaustiveSearch<TDb>::Run(size_t threadCount)
+{
+  ResetFields();
+
+  // Rows are independent, each thread writes its own ones.
+  util::ParallelFor(0, ImageHeight, [this](size_t i) {
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      auto best = FindBestMatch(i, j);
+      FieldX(i, j) = best.offsetX;
+      FieldY(i, j) = best.offsetY;
+      FieldT(i, j) = best.t;
+      Costs(i, j) = best.cost;
+    }
+  }, threadCount);
+}
+
+
+template <class TDb>
+void ExhaustiveSearch<TDb>::RunSummedAreas(size_t threadCount)
+{
+  ResetFields();
+
+  // Each band pays for 2 * PatchRadius extra rows of tables, so bands are
+  // as large as possible.
+  const size_t bands = std::max<size_t>(1, std::min(threadCount, ImageHeight));
+  util::ParallelFor(0, bands, [this, bands](size_t band) {
+    SearchBand(ImageHeight * band / bands, ImageHeight * (band + 1) / bands);
+  }, bands);
+}
+
+
+template <class TDb>
+void ExhaustiveSearch<TDb>::SearchBand(size_t firstRow, size_t lastRow)
+{
+  const auto &fixed = Database.GetImage(0);
+  const int height = static_cast<int>(ImageHeight);
+  const int width = static_cast<int>(ImageWidth);
+  const int r = static_cast<int>(PatchRadius);
+  const size_t side = 2 * PatchRadius + 1;
+
+  // sums[a * stride + b] is the sum of squared differences over the first
+  // a rows and b columns of the table area, row and column 0 are zeros.
+  std::vector<CostType> sums;
+
+  // Order of candidates is the one of FindBestMatch, so are ties.
+  for (size_t t = 1; t < Database.GetImageCount(); ++t) {
+    const auto &moving = Database.GetImage(t);
+
+    for (int dy = -WindowRadius; dy <= WindowRadius; ++dy) {
+      // Centers with destination inside the image.
+      const int top = std::max(static_cast<int>(firstRow), -dy);
+      const int bottom = std::min(static_cast<int>(lastRow), height - dy);
+      if (top >= bottom)
+        continue;
+
+      for (int dx = -WindowRadius; dx <= WindowRadius; ++dx) {
+        const int left = std::max(0, -dx);
+        const int right = std::min(width, width - dx);
+        if (left >= right)
+          continue;
+
+        // Table covers patches of all the centers, ghost pixels included.
+        const size_t rows = bottom - top + 2 * r;
+        const size_t cols = right - left + 2 * r;
+        const size_t stride = cols + 1;
+        sums.assign((rows + 1) * stride, CostType());
+
+        for (size_t a = 0; a < rows; ++a) {
+          // Negative coordinates wrap around to ghost pixels.
+          const size_t y = top - r + a;
+          const size_t x = left - r;
+          const auto *f = &fixed(y, x);
+          const auto *g = &moving(y + dy, x + dx);
+          const CostType *above = &sums[a * stride];
+          CostType *current = &sums[(a + 1) * stride];
+
+          CostType rowSum = CostType();
+          for (size_t b = 0; b < cols; ++b) {
+            CostType diff = f[b] - g[b];
+            rowSum += diff * diff;
+            current[b + 1] = above[b + 1] + rowSum;
+          }
+        }
+
+        for (int y = top; y < bottom; ++y) {
+          const CostType *upper = &sums[(y - top) * stride];
+          const CostType *lower = &sums[(y - top + side) * stride];
+          for (int x = left; x < right; ++x) {
+            const size_t b = x - left;
+            CostType cost = lower[b + side] - upper[b + side] -
+                            lower[b] + upper[b];
+            cost = std::max(cost, CostType());
+
+            if (cost < Costs(y, x)) {
+              Costs(y, x) = cost;
+              FieldX(y, x) = dx;
+              FieldY(y, x) = dy;
+              FieldT(y, x) = t;
+            }
+          }
+        }
+      } // for (dx)
+    } // for (dy)
+  } // for (t)
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "util/memory/AlignedAllocator.h"
+#include "util/memory/Span.h"
+
+#include <algorithm>
 #include <stdexcept>
 #include <cassert>
 #include <iostream>
@@ -7,19 +11,48 @@
 #include <string>
 
 
+// How ghost pixels around a padded image are filled, see Image::SetBorder.
+enum class BorderMode {
+  Constant,  ///< All ghost pixels have the given value.
+  Replicate, ///< Nearest edge pixel is repeated: aaa|abcd|ddd.
+  Mirror     ///< Reflection not repeating the edge pixel: dcb|abcd|cba.
+};
+
+
+// Two-dimensional image.
+//
+// By default pixels are stored row by row without gaps. SetBorder switches
+// the image to padded layout: each row starts at an ALIGNMENT-byte boundary
+// (if sizeof(T) divides ALIGNMENT) and the image is surrounded by a frame of
+// ghost pixels, so neighbourhood loops don't need boundary special cases.
+// Ghost pixels are addressed with "negative" indices, e.g. img(-1, j) or
+// img(i, Width), which wrap around in size_t arithmetic as intended.
+//
+// Linear access (operator[], begin(), end()) is only valid for contiguous
+// images, other operations work with both layouts.
 template <class T>
 class Image {
 public:
-  using PixelType = T;
+  using PixelType    = T;
+  using RowType      = util::Span<T>;
+  using ConstRowType = util::Span<const T>;
+
+  // Alignment of storage and rows of padded images in bytes.
+  static constexpr size_t ALIGNMENT = 64;
 
-  Image() : Height(0), Width(0), data() {}
+  Image()
+    : Height(0), Width(0), Border(0), Stride(0), Origin(0), Padded(false)
+    , data()
+  {}
 
   // Creates a new image and fills it with \p value.
   Image(size_t h, size_t w, const T &value = T())
-    : Height(h), Width(w), data(h * w, value)
+    : Height(h), Width(w), Border(0), Stride(w), Origin(0), Padded(false)
+    , data()
   {
     if (!h || !w)
-      Height = Width = 0;
+      Height = Width = Stride = 0;
+    data.resize(CheckedProduct(Height, Width), value);
   }
 
   Image(const Image<T> &other) = default;
@@ -28,21 +61,99 @@ public:
   virtual ~Image() = default;
 
 
+  // Changes the size of the image. Padded layout and border are kept.
+  //
+  // Contiguous image keeps its first pixels in linear order, padded image
+  // keeps pixels of the overlapping region. New pixels are set to \p value.
+  //
+  // Throws std::length_error if the image is too large.
   void Resize(size_t h, size_t w, const T &value = T()) {
     if (!h || !w)
-      Height = Width = 0;
-    else {
-      Height = h;
-      Width = w;
+      h = w = 0;
+
+    if (Padded) {
+      Relayout(h, w, Border, value);
+      return;
     }
-    data.resize(Height * Width, value);
+
+    data.resize(CheckedProduct(h, w), value);
+    Height = h;
+    Width = w;
+    Stride = w;
+  }
+
+
+  // Switches to padded layout with \p border ghost pixels on each side.
+  // Pixels are kept, ghost pixels are set to T() until UpdateBorder.
+  //
+  // Throws std::length_error if the image is too large.
+  void SetBorder(size_t border) {
+    Padded = true;
+    Relayout(Height, Width, border, T());
+  }
+
+
+  // Fills ghost pixels of a padded image according to \p mode.
+  // \p value is used by BorderMode::Constant only.
+  void UpdateBorder(BorderMode mode, const T &value = T()) {
+    if (isEmpty() || !Border)
+      return;
+
+    // Left and right parts of image rows.
+    for (size_t i = 0; i < Height; ++i) {
+      T *r = &data[RowStart(i)];
+      for (size_t k = 1; k <= Border; ++k) {
+        if (mode == BorderMode::Constant) {
+          *(r - k) = r[Width - 1 + k] = value;
+          continue;
+        }
+        size_t offset = BorderSource(k, Width, mode);
+        *(r - k) = r[offset];
+        r[Width - 1 + k] = r[Width - 1 - offset];
+      }
+    }
+
+    // Whole padded rows above and below, corners included.
+    const size_t rowLength = Width + 2 * Border;
+    for (size_t k = 1; k <= Border; ++k) {
+      T *above = &data[RowStart(0) - k * Stride - Border];
+      T *below = &data[RowStart(Height - 1) + k * Stride - Border];
+
+      if (mode == BorderMode::Constant) {
+        std::fill(above, above + rowLength, value);
+        std::fill(below, below + rowLength, value);
+        continue;
+      }
+
+      size_t offset = BorderSource(k, Height, mode);
+      const T *srcAbove = &data[RowStart(offset) - Border];
+      const T *srcBelow = &data[RowStart(Height - 1 - offset) - Border];
+      std::copy(srcAbove, srcAbove + rowLength, above);
+      std::copy(srcBelow, srcBelow + rowLength, below);
+    }
+  }
+
+
+  // Sets ghost pixels at distance \p k (1 <= k <= border) from the image to
+  // \p value, corners included. Other ghost pixels are kept.
+  void FillBorderRing(size_t k, const T &value) {
+    assert(k >= 1 && k <= Border && "Ring is out of the border!");
+    if (isEmpty())
+      return;
+
+    const size_t top = -k, bottom = Height - 1 + k;
+    const size_t left = -k, right = Width - 1 + k;
+    for (size_t j = left; j != right + 1; ++j)
+      (*this)(top, j) = (*this)(bottom, j) = value;
+    for (size_t i = top + 1; i != bottom; ++i)
+      (*this)(i, left) = (*this)(i, right) = value;
   }
 
 
   // Fill the whole image with the given value.
   void Fill(const T &value) {
-    for (auto &pixel : data)
-      pixel = value;
+    for (size_t i = 0; i < Height; ++i)
+      std::fill(row(i).begin(), row(i).end(), value);
   }
 
 
@@ -58,15 +169,17 @@ public:
     std::ios_base::sync_with_stdio(false);
     is.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
-    is >> m.Height >> m.Width;
-    m.data.resize(m.Height * m.Width);
+    size_t h = 0, w = 0;
+    is >> h >> w;
+    m.Resize(h, w);
 
-    for (auto &pixel : m.data) {
-      // If stream containes less data than declared - stop reading.
-      if (!is.good())
-        break;
-      is >> pixel;
-    }
+    for (size_t i = 0; i < m.getHeight(); ++i)
+      for (auto &pixel : m.row(i)) {
+        // If stream containes less data than declared - stop reading.
+        if (!is.good())
+          return is;
+        is >> pixel;
+      }
 
     return is;
   }
@@ -89,11 +202,19 @@ public:
 
   inline size_t getHeight() const { return Height; }
   inline size_t getWidth()  const { return Width;  }
-  inline size_t getSize()   const {
-    assert(data.size() == Height * Width &&
-           "Image size is different than Height * Width!");
-    return data.size();
-  }
+  inline size_t getSize()   const { return Height * Width; }
+
+  // Number of ghost pixels on each side.
+  inline size_t getBorder() const { return Border; }
+
+  // Distance between starts of adjacent rows in pixels.
+  inline size_t getStride() const { return Stride; }
+
+  // Number of pixels allocated, including ghost pixels and row padding.
+  inline size_t getStorageSize() const { return data.size(); }
+
+  // True if pixels are stored row by row without gaps.
+  inline bool isContiguous() const { return Stride == Width && !Border; }
 
 
   inline bool isEmpty() const { return data.empty(); }
@@ -109,21 +230,31 @@ public:
     using std::swap;
     swap(first.Height, second.Height);
     swap(first.Width, second.Width);
+    swap(first.Border, second.Border);
+    swap(first.Stride, second.Stride);
+    swap(first.Origin, second.Origin);
+    swap(first.Padded, second.Padded);
     swap(first.data, second.data);
   }
 
 
+  // Returns a contiguous image with pixels converted to U.
   template<class U>
   Image<U> castTo() const {
     Image<U> result(Height, Width);
 
-    for (size_t i = 0; i < data.size(); ++i)
-      result[i] = static_cast<U>(data[i]);
+    for (size_t i = 0; i < Height; ++i) {
+      auto src = row(i);
+      auto dst = result.row(i);
+      for (size_t j = 0; j < Width; ++j)
+        dst[j] = static_cast<U>(src[j]);
+    }
 
     return result;
   }
 
 
+  // Compares sizes and pixels, layouts may differ.
   bool operator==(const Image<T> &other) const {
     // Not actually needed check, but let's make this explicit for readability.
     if (isEmpty() != other.isEmpty())
@@ -131,8 +262,8 @@ public:
     if (Height != other.getHeight() || Width != other.getWidth())
       return false;
 
-    for (size_t i = 0; i < data.size(); ++i)
-      if (data[i] != other[i])
+    for (size_t i = 0; i < Height; ++i)
+      if (!std::equal(row(i).begin(), row(i).end(), other.row(i).begin()))
         return false;
     return true;
   }
@@ -147,8 +278,12 @@ public:
     assert(Height == other.getHeight() && "Height mismatch!");
     assert(Width == other.getWidth() && "Width mismatch!");
 
-    for (size_t i = 0; i < data.size(); ++i)
-      data[i] += other[i];
+    for (size_t i = 0; i < Height; ++i) {
+      auto dst = row(i);
+      auto src = other.row(i);
+      for (size_t j = 0; j < Width; ++j)
+        dst[j] += src[j];
+    }
 
     return *this;
   }
@@ -158,8 +293,12 @@ public:
     assert(Height == other.getHeight() && "Height mismatch!");
     assert(Width == other.getWidth() && "Width mismatch!");
 
-    for (size_t i = 0; i < data.size(); ++i)
-      data[i] -= other[i];
+    for (size_t i = 0; i < Height; ++i) {
+      auto dst = row(i);
+      auto src = other.row(i);
+      for (size_t j = 0; j < Width; ++j)
+        dst[j] -= src[j];
+    }
 
     return *this;
   }
@@ -178,34 +317,133 @@ public:
 
 
 protected:
+  using ContainerType = std::vector<T, util::AlignedAllocator<T, ALIGNMENT>>;
+
+  // Row alignment in pixels.
+  static constexpr size_t ALIGN_PIXELS =
+    ALIGNMENT % sizeof(T) ? 1 : ALIGNMENT / sizeof(T);
+
+  static size_t RoundUp(size_t n, size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+  }
+
+  static size_t CheckedProduct(size_t a, size_t b) {
+    if (b && a > ContainerType().max_size() / b)
+      throw std::length_error("Image is too large!");
+    return a * b;
+  }
+
+  // Index of pixel (i, 0), i may be a "negative" ghost row.
+  size_t RowStart(size_t i) const { return Origin + i * Stride; }
+
+  // Reallocates storage for padded layout, keeping the overlapping pixels.
+  void Relayout(size_t h, size_t w, size_t border, const T &value) {
+    size_t lead = RoundUp(border, ALIGN_PIXELS);
+    size_t stride = 0;
+    size_t origin = 0;
+    ContainerType newData;
+
+    if (h && w) {
+      if (w > ContainerType().max_size() - lead - border)
+        throw std::length_error("Image is too large!");
+      stride = RoundUp(lead + w + border, ALIGN_PIXELS);
+      origin = border * stride + lead;
+      if (h > ContainerType().max_size() - 2 * border)
+        throw std::length_error("Image is too large!");
+      newData.resize(CheckedProduct(h + 2 * border, stride), value);
+
+      for (size_t i = 0; i < std::min(h, Height); ++i) {
+        const T *src = &data[RowStart(i)];
+        std::copy(src, src + std::min(w, Width), &newData[origin + i * stride]);
+      }
+    }
+
+    data.swap(newData);
+    Height = h;
+    Width = w;
+    Border = border;
+    Stride = stride;
+    Origin = origin;
+  }
+
+  // Distance from the nearest edge of [0, n) to the pixel copied into the
+  // ghost pixel k (1..Border) steps outside of it.
+  static size_t BorderSource(size_t k, size_t n, BorderMode mode) {
+    if (mode == BorderMode::Replicate || n == 1)
+      return 0;
+
+    // Mirror, folded for images narrower than the border.
+    size_t period = 2 * (n - 1);
+    size_t m = k % period;
+    return m < n ? m : period - m;
+  }
+
   size_t Height;
   size_t Width;
-  std::vector<T> data;
+  size_t Border;
+  size_t Stride;
+  size_t Origin; ///< Index of pixel (0, 0) in data.
+  bool   Padded;
+  ContainerType data;
 
 
 public:
-  auto operator()(size_t i, size_t j) -> decltype(data[0]) {
-    assert(i < Height && "i index out of range!");
-    assert(j < Width && "i index out of range!");
+  T &operator()(size_t i, size_t j) {
+    assert(i + Border < Height + 2 * Border && "i index out of range!");
+    assert(j + Border < Width + 2 * Border && "j index out of range!");
+
+    return data[RowStart(i) + j];
+  }
 
-    return data[i * Width + j];
+
+  const T &operator()(size_t i, size_t j) const {
+    assert(i + Border < Height + 2 * Border && "i index out of range!");
+    assert(j + Border < Width + 2 * Border && "j index out of range!");
+
+    return data[RowStart(i) + j];
   }
 
 
-  auto operator()(size_t i, size_t j) const -> decltype(data[0]) {
-    assert(i < Height && "i index out of range!");
-    assert(j < Width && "i index out of range!");
+  // Pixels of i-th row, without ghost pixels.
+  RowType row(size_t i) {
+    assert(i < Height && "Row index out of range!");
+    return RowType(&data[RowStart(i)], Width);
+  }
 
-    return data[i * Width + j];
+  ConstRowType row(size_t i) const {
+    assert(i < Height && "Row index out of range!");
+    return ConstRowType(&data[RowStart(i)], Width);
   }
 
 
-  auto operator[](size_t i)       -> decltype(data.at(i)) { return data.at(i); }
-  auto operator[](size_t i) const -> decltype(data.at(i)) { return data.at(i); }
+  // Linear access, contiguous images only.
+  T &operator[](size_t i) {
+    assert(isContiguous() && "Linear access to padded image!");
+    assert(i < data.size() && "Index out of range!");
+    return data[i];
+  }
+
+  const T &operator[](size_t i) const {
+    assert(isContiguous() && "Linear access to padded image!");
+    assert(i < data.size() && "Index out of range!");
+    return data[i];
+  }
 
-  auto begin()       -> decltype(data.begin()) { return data.begin(); }
-  auto begin() const -> decltype(data.begin()) { return data.begin(); }
+  auto begin()       -> decltype(data.begin()) {
+    assert(isContiguous() && "Linear access to padded image!");
+    return data.begin();
+  }
+  auto begin() const -> decltype(data.begin()) {
+    assert(isContiguous() && "Linear access to padded image!");
+    return data.begin();
+  }
   auto end()         -> decltype(data.end())   { return data.end();   }
   auto end()   const -> decltype(data.end())   { return data.end();   }
 };
 
+
+template <class T>
+constexpr size_t Image<T>::ALIGNMENT;
+
+template <class T>
+constexpr size_t Image<T>::ALIGN_PIXELS;
@@ -1,14 +1,24 @@
 #pragma once
 
 #include "Image.h"
+#include "LabelTable.h"
 #include "ImageIO/ImageIO.h"
 
 #include "util/fs/File.h"
 #include "util/fs/Directory.h"
 #include "util/json/json.h"
+#include "util/thread/ThreadPool.h"
 
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -25,14 +35,77 @@ public:
   using SegType = Image<SegPixelType>;
 
   using ImgContainerType = std::vector<ImgType>;
-  using SegContainerType = std::vector<SegType>;
 
   using ConstImgIterator = typename ImgContainerType::const_iterator;
-  using ConstSegIterator = typename SegContainerType::const_iterator;
+
+  /// Types of label indices segmentations are stored as, see GetLabelIndices.
+  using NarrowLabelType = uint8_t;
+  using WideLabelType   = uint16_t;
+
+  using LabelTableType = LabelTable<SegPixelType>;
 
 public:
   ImageDatabase() = default;
 
+  /// @brief Keeps a pair of the database loaded while alive, see Pin.
+  class PinGuard {
+  public:
+    PinGuard(const ImageDatabase &db, size_t i)
+      : database(&db)
+      , index(i)
+    {
+      database->Pin(index);
+    }
+
+    PinGuard(PinGuard &&other) noexcept
+      : database(other.database)
+      , index(other.index)
+    {
+      other.database = nullptr;
+    }
+
+    PinGuard(const PinGuard &) = delete;
+    PinGuard & operator=(const PinGuard &) = delete;
+    PinGuard & operator=(PinGuard &&) = delete;
+
+    ~PinGuard() {
+      if (database)
+        database->Unpin(index);
+    }
+
+  private:
+    const ImageDatabase *database;
+    size_t index;
+  };
+
+  /// @brief Iterator over segmentations, decodes them on dereference.
+  class ConstSegIterator {
+  public:
+    ConstSegIterator(const ImageDatabase &db, size_t i)
+      : database(&db)
+      , index(i)
+    {}
+
+    SegType operator*() const { return database->GetSegmentation(index); }
+
+    ConstSegIterator & operator++() {
+      ++index;
+      return *this;
+    }
+
+    bool operator==(const ConstSegIterator &other) const {
+      return database == other.database && index == other.index;
+    }
+
+    bool operator!=(const ConstSegIterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    const ImageDatabase *database;
+    size_t index;
+  };
+
 public:
   /**
    * @brief Adds a pair of image and its segmentation. Reads both from files.
@@ -65,6 +138,19 @@ public:
            const std::string &imgFileName = "",
            const std::string &segFileName = "");
 
+  /**
+   * @brief Adds pairs of files, see Add. Files are decoded on loader threads
+   * (see SetLoaderThreads) and added in order.
+   *
+   * @param [in] imgFiles Names of image files.
+   * @param [in] segFiles Names of segmentation files, one per image.
+   *
+   * @throws std::runtime_error. The first error is rethrown, pairs preceding
+   * the failed one are added.
+   */
+  void AddFiles(const std::vector<std::string> &imgFiles,
+                const std::vector<std::string> &segFiles);
+
   // Read a JSON config file and fill the database accordingly.
   void ReadFromConfig(const std::string &fileName);
 
@@ -94,11 +180,142 @@ public:
   /// @brief Clear the contents of the database.
   void Clear();
 
+  /**
+   * @brief Set number of threads decoding files in AddFiles, ReadFromConfig
+   * and AppendFilesFromList.
+   *
+   * Files are still added in the order they are listed. 1 means loading
+   * sequentially in the calling thread. Default is the number of hardware
+   * threads.
+   *
+   * @param [in] threads Number of loader threads, 0 is treated as 1.
+   */
+  void SetLoaderThreads(size_t threads) { loaderThreads = threads ? threads : 1; }
+
+  /**
+   * @brief Set maximum number of decoded pairs waiting to be added.
+   *
+   * Bounds memory used by parallel loading: a new file is scheduled only when
+   * a loaded one is moved to the database. 0 means twice the number of loader
+   * threads.
+   *
+   * @param [in] pairs Maximum number of 'image, segmentation' pairs in flight.
+   */
+  void SetMaxPairsInFlight(size_t pairs) { maxPairsInFlight = pairs; }
+
+  /**
+   * @brief Enable lazy loading of pairs with a memory budget.
+   *
+   * Pairs added from files are only registered and decoded on first access.
+   * Loaded pairs are kept in an LRU cache of at most @p bytes of pixel data,
+   * least recently used ones are dropped and re-read from disk on the next
+   * access. Pinned pairs and pairs added from memory are never dropped, so
+   * the budget may be exceeded while they are held. The first pair is decoded
+   * at once, it defines the size of images in the database.
+   *
+   * Segmentations of registered pairs are read once by Add to fill the label
+   * table, so loading a pair later never converts label indices of others.
+   *
+   * Errors of files read on access are thrown from the getters. A reference
+   * returned by GetImage / GetLabelIndices of an unpinned pair is valid until
+   * the next access to the database.
+   *
+   * @param [in] bytes Cache budget, 0 disables lazy loading (default).
+   *
+   * @throws std::logic_error if the database is not empty.
+   */
+  void SetCacheBudget(size_t bytes);
+
+  /**
+   * @brief Pad images and segmentations with ghost pixels when they are added.
+   *
+   * Pairs get a frame of @p border pixels filled according to @p mode, so
+   * that patches centered at any pixel of an image can be read without
+   * boundary checks, see Image::SetBorder. Applies to pairs added from
+   * memory as well as to pairs read (or re-read in lazy mode) from files.
+   *
+   * @param [in] border Width of the frame, 0 disables padding (default).
+   * @param [in] mode How ghost pixels are filled.
+   *
+   * @throws std::logic_error if the database is not empty.
+   */
+  void SetBorder(size_t border, BorderMode mode = BorderMode::Mirror);
+
+  /// @returns Width of the frame of ghost pixels around images.
+  size_t GetBorder() const { return border; }
+
+  /**
+   * @brief Set the outermost ring of ghost pixels of images to @p value.
+   *
+   * Patches reaching the fence compare with @p value instead of image
+   * content, so an infinite fence gives infinite SSDs to patches which left
+   * the images by more than the rest of the border. Segmentations aren't
+   * fenced. Applies to pairs like SetBorder.
+   *
+   * @throws std::logic_error if the database is not empty or not padded.
+   */
+  void SetFence(const ImgPixelType &value);
+
+  /// @returns True if images are fenced, see SetFence.
+  bool HasFence() const { return fenced; }
+
+  /// @returns Value of the outermost ghost pixels of fenced images.
+  const ImgPixelType& GetFence() const { return fence; }
+
+  /**
+   * @brief Load i-th pair if needed and keep it loaded until Unpin.
+   *
+   * Pins are counted, each Pin must be matched by Unpin. Access to a pinned
+   * pair doesn't lock the cache. Prefer PinGuard to calling these directly.
+   */
+  void Pin(size_t i) const;
+  void Unpin(size_t i) const;
+
+  /// @returns True if pixels of i-th pair are in memory.
+  bool IsLoaded(size_t i) const;
+
+  /// @returns Size of pixel data of loaded pairs in bytes.
+  size_t GetCachedBytes() const;
+
   // Getters.
 
   // Get images.
-  inline const ImgType & GetImage(size_t i)        const;
-  inline const SegType & GetSegmentation(size_t i) const;
+  inline const ImgType & GetImage(size_t i) const;
+
+  /**
+   * @returns Decoded copy of i-th segmentation, padded like the images.
+   *
+   * Segmentations are stored as label indices, use GetLabelIndices to read
+   * them without copying.
+   */
+  inline SegType GetSegmentation(size_t i) const;
+
+  /**
+   * @brief Segmentations stored as indices into the label table.
+   *
+   * Labels of all segmentations are numbered densely in order of appearance.
+   * Indices are NarrowLabelType while there are at most 256 labels and
+   * WideLabelType after that, all pairs are converted once a new label
+   * doesn't fit, which invalidates references to label images. Label images
+   * are padded like the images.
+   *
+   * @tparam L NarrowLabelType or WideLabelType, must match HasWideLabels.
+   */
+  template <class L>
+  const Image<L> & GetLabelIndices(size_t i) const {
+    assert(i < images.size() && "Segmentation index is out of range!");
+    assert(wideLabels == (sizeof(L) == sizeof(WideLabelType)) &&
+           "Wrong type of label indices!");
+
+    Access(i);
+    return LabelIndices(i, L());
+  }
+
+  /// @returns True if label indices are WideLabelType.
+  bool HasWideLabels() const { return wideLabels; }
+
+  /// @returns Labels of segmentations by their indices.
+  const LabelTableType & GetLabelTable() const { return labelTable; }
 
   inline std::string GetImageName(size_t i)        const;
   inline std::string GetSegmentationName(size_t j) const;
@@ -106,17 +323,93 @@ public:
   inline size_t GetImageCount() const;
   inline bool   IsEmpty()       const;
 
+  // Wall time in seconds spent decoding i-th pair (the last time it was
+  // decoded in lazy mode), 0 for pairs not read from files.
+  inline double GetLoadTime(size_t i) const;
+
   // Get image dimensions.
   size_t GetImageHeight() const { return imageHeight; }
   size_t GetImageWidth()  const { return imageWidth;  }
 
-  // Iterators.
+  // Iterators. Pairs not loaded in lazy mode are empty images.
   inline ConstImgIterator img_cbegin() const { return images.cbegin(); }
-  inline ConstSegIterator seg_cbegin() const { return segmentations.cbegin(); }
+  inline ConstSegIterator seg_cbegin() const { return ConstSegIterator(*this, 0); }
   inline ConstImgIterator img_cend()   const { return images.end(); }
-  inline ConstSegIterator seg_cend()   const { return segmentations.cend(); }
+  inline ConstSegIterator seg_cend()   const {
+    return ConstSegIterator(*this, images.size());
+  }
 
 private:
+  struct LoadedPair {
+    ImgType image;
+    SegType segmentation;
+    double seconds;
+  };
+
+  // Reads both files, measuring the time it took.
+  static LoadedPair LoadPair(const std::string &imgFileName,
+                             const std::string &segFileName);
+
+  // Throws std::runtime_error if a pair can't be put to the database.
+  void CheckPair(const ImgType &imgMat, const SegType &segMat) const;
+
+  // Switches an image being added to the padded layout, see SetBorder.
+  template <class T>
+  void Pad(Image<T> &img) const;
+
+  // Pads an image of a pair and sets its fence, see SetFence.
+  void PadImage(ImgType &img) const;
+
+  // Extends the label table with labels of segMat, converting label indices
+  // once they don't fit. Throws std::runtime_error if there are too many
+  // labels.
+  void AddLabels(const SegType &segMat) const;
+
+  // Stores i-th segmentation as label indices, extending the label table.
+  // Throws std::runtime_error if there are too many labels.
+  void EncodeLabels(size_t i, const SegType &segMat) const;
+
+  // Converts label indices of all pairs to WideLabelType.
+  // Throws std::logic_error if any pair is pinned.
+  void WidenLabels() const;
+
+  const Image<NarrowLabelType> & LabelIndices(size_t i, NarrowLabelType) const {
+    return narrowLabels[i];
+  }
+
+  const Image<WideLabelType> & LabelIndices(size_t i, WideLabelType) const {
+    return wideLabelImages[i];
+  }
+
+  // Checks and appends a pair, see Add. Pairs read from files can be
+  // dropped from memory in lazy mode.
+  void Insert(ImgType &&imgMat, SegType &&segMat,
+              const std::string &imgFileName, const std::string &segFileName,
+              double loadTime, bool fromFile);
+
+  // Appends a pair to be loaded on first access (lazy mode).
+  void Register(const std::string &imgFileName,
+                const std::string &segFileName);
+
+  bool IsLazy() const { return cacheBudget != 0; }
+
+  size_t PairBytes(size_t i) const {
+    return images[i].getStorageSize() * sizeof(ImgPixelType) +
+           narrowLabels[i].getStorageSize() * sizeof(NarrowLabelType) +
+           wideLabelImages[i].getStorageSize() * sizeof(WideLabelType);
+  }
+
+  // Makes sure i-th pair is loaded in lazy mode.
+  inline void Access(size_t i) const;
+
+  // Loads i-th pair if needed and marks it as most recently used.
+  // cacheMutex must be held.
+  void TouchLocked(size_t i) const;
+
+  // Drops least recently used pairs until the budget is met, except for
+  // pinned ones and keep. cacheMutex must be held.
+  void EvictLocked(size_t keep) const;
+
   void ReadFromJson(const util::Json &jsonConfig);
 
   // Parse 'images' or 'segmentation' section. Section is required.
@@ -128,16 +421,46 @@ private:
                           std::vector<std::string> &absFiles);
 
 private:
-  ImgContainerType images;
-  SegContainerType segmentations;
+  // Pairs are loaded into their slots on access in lazy mode.
+  mutable ImgContainerType images;
+
+  // Segmentations as label indices, only one of the containers is filled.
+  mutable LabelTableType labelTable;
+  mutable bool wideLabels = false;
+  mutable std::vector<Image<NarrowLabelType>> narrowLabels;
+  mutable std::vector<Image<WideLabelType>>   wideLabelImages;
 
   std::vector<std::string> imgNames;
   std::vector<std::string> segNames;
 
-  size_t imageHeight;
-  size_t imageWidth;
+  mutable std::vector<double> loadTimes;
+
+  size_t imageHeight = 0;
+  size_t imageWidth  = 0;
 
   std::string dbName;
+
+  size_t border = 0;
+  BorderMode borderMode = BorderMode::Mirror;
+
+  bool fenced = false;
+  ImgPixelType fence = ImgPixelType();
+
+  size_t loaderThreads    = util::HardwareConcurrency();
+  size_t maxPairsInFlight = 0;
+
+  // Cache state. Guarded by cacheMutex, except for pin counts which are
+  // also read on the fast path of Access.
+  using LruList = std::list<size_t>;
+
+  size_t cacheBudget = 0;
+  std::vector<bool> reloadable; ///< Pair can be dropped and read again.
+
+  mutable std::mutex cacheMutex;
+  mutable LruList lruList; ///< Loaded reloadable pairs, most recent first.
+  mutable std::vector<typename LruList::iterator> lruPositions;
+  mutable std::deque<std::atomic<size_t>> pinCounts;
+  mutable size_t cachedBytes = 0;
 };
 
 
@@ -145,10 +468,13 @@ template<class I, class S>
 void ImageDatabase<I, S>::Add(const std::string &imgFileName,
                               const std::string &segFileName)
 {
-  auto imgMat = ImageIO::ReadImage<ImgPixelType>(imgFileName);
-  auto segMat = ImageIO::ReadImage<SegPixelType>(segFileName);
+  if (IsLazy() && !IsEmpty())
+    return Register(imgFileName, segFileName);
+
+  auto loaded = LoadPair(imgFileName, segFileName);
 
-  Add(imgMat, segMat, imgFileName, segFileName);
+  Insert(std::move(loaded.image), std::move(loaded.segmentation),
+         imgFileName, segFileName, loaded.seconds, /*fromFile=*/ true);
 }
 
 
@@ -157,6 +483,34 @@ void ImageDatabase<I, S>::Add(const ImgType &imgMat,
                               const SegType &segMat,
                               const std::string &imgFileName,
                               const std::string &segFileName)
+{
+  Insert(ImgType(imgMat), SegType(segMat), imgFileName, segFileName,
+         /*loadTime=*/ 0.0, /*fromFile=*/ false);
+}
+
+
+template <class I, class S>
+typename ImageDatabase<I, S>::LoadedPair
+ImageDatabase<I, S>::LoadPair(const std::string &imgFileName,
+                              const std::string &segFileName)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  LoadedPair result;
+  result.image = ImageIO::ReadImage<ImgPixelType>(imgFileName);
+  result.segmentation = ImageIO::ReadImage<SegPixelType>(segFileName);
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+
+  return result;
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::CheckPair(const ImgType &imgMat,
+                                    const SegType &segMat) const
 {
   // Don't add empty images.
   if (imgMat.isEmpty() || segMat.isEmpty())
@@ -167,28 +521,342 @@ void ImageDatabase<I, S>::Add(const ImgType &imgMat,
       imgMat.getWidth() != segMat.getWidth())
     throw std::runtime_error("Image/segmentation size mismatch!");
 
+  // The first pair defines size of images.
+  if (images.size() == 0)
+    return;
+
+  assert(imageHeight != 0 && imageWidth != 0 &&
+         "Only one of image dimensions is 0!");
+
+  // Don't add images which dimensions don't match the base.
+  if (imgMat.getHeight() != imageHeight || imgMat.getWidth() != imageWidth)
+    throw std::runtime_error(
+      "Size of new image/segmentation doesn't suit the database!");
+}
+
+
+template <class I, class S>
+template <class T>
+void ImageDatabase<I, S>::Pad(Image<T> &img) const
+{
+  if (!border)
+    return;
+
+  img.SetBorder(border);
+  img.UpdateBorder(borderMode);
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::PadImage(ImgType &img) const
+{
+  Pad(img);
+  if (fenced)
+    img.FillBorderRing(border, fence);
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::AddLabels(const SegType &segMat) const
+{
+  const size_t maxNarrow = size_t(1) << (8 * sizeof(NarrowLabelType));
+  const size_t maxWide   = size_t(1) << (8 * sizeof(WideLabelType));
+
+  labelTable.Insert(segMat);
+  if (labelTable.GetSize() > maxWide)
+    throw std::runtime_error("Too many labels in segmentations!");
+  if (!wideLabels && labelTable.GetSize() > maxNarrow)
+    WidenLabels();
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::EncodeLabels(size_t i, const SegType &segMat) const
+{
+  AddLabels(segMat);
+
+  if (wideLabels) {
+    labelTable.Encode(segMat, wideLabelImages[i]);
+    Pad(wideLabelImages[i]);
+  } else {
+    labelTable.Encode(segMat, narrowLabels[i]);
+    Pad(narrowLabels[i]);
+  }
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::WidenLabels() const
+{
+  // References to label images of pinned pairs must stay valid.
+  for (const auto &count : pinCounts)
+    if (count.load(std::memory_order_relaxed))
+      throw std::logic_error("Label indices of pinned pairs can't be widened!");
+
+  for (size_t j = 0; j < narrowLabels.size(); ++j) {
+    if (narrowLabels[j].isEmpty())
+      continue;
+
+    cachedBytes -= PairBytes(j);
+    wideLabelImages[j] = narrowLabels[j].template castTo<WideLabelType>();
+    Pad(wideLabelImages[j]);
+    narrowLabels[j] = Image<NarrowLabelType>();
+    cachedBytes += PairBytes(j);
+  }
+
+  wideLabels = true;
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::Insert(ImgType &&imgMat, SegType &&segMat,
+                                 const std::string &imgFileName,
+                                 const std::string &segFileName,
+                                 double loadTime, bool fromFile)
+{
+  CheckPair(imgMat, segMat);
+
   // Check size of images.
   if (images.size() == 0) {
     // This must be the first pair of images.
     imageHeight = imgMat.getHeight();
     imageWidth = imgMat.getWidth();
-  } else {
-    assert(imageHeight != 0 && imageWidth != 0 &&
-           "Only one of image dimensions is 0!");
-
-    // Don't add images which dimensions don't match the base.
-    if (imgMat.getHeight() != imageHeight || imgMat.getWidth() != imageWidth)
-      throw std::runtime_error(
-        "Size of new image/segmentation doesn't suit the database!");
   }
 
+  PadImage(imgMat);
+
   // Add images.
-  images.push_back(imgMat);
-  segmentations.push_back(segMat);
+  images.push_back(std::move(imgMat));
+  narrowLabels.emplace_back();
+  wideLabelImages.emplace_back();
+  EncodeLabels(images.size() - 1, segMat);
 
   // Add image names.
   imgNames.push_back(imgFileName);
   segNames.push_back(segFileName);
+
+  loadTimes.push_back(loadTime);
+
+  // Cache bookkeeping.
+  size_t i = images.size() - 1;
+  reloadable.push_back(IsLazy() && fromFile);
+  lruPositions.push_back(lruList.end());
+  pinCounts.emplace_back(0);
+  cachedBytes += PairBytes(i);
+
+  if (reloadable[i]) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    lruList.push_front(i);
+    lruPositions[i] = lruList.begin();
+    EvictLocked(i);
+  }
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::Register(const std::string &imgFileName,
+                                   const std::string &segFileName)
+{
+  assert(IsLazy() && !IsEmpty() && "The first pair must be loaded!");
+
+  // Labels of all pairs are known up front, so pairs loaded on access never
+  // change the label table or the type of label indices.
+  AddLabels(ImageIO::ReadImage<SegPixelType>(segFileName));
+
+  images.emplace_back();
+  narrowLabels.emplace_back();
+  wideLabelImages.emplace_back();
+
+  imgNames.push_back(imgFileName);
+  segNames.push_back(segFileName);
+
+  loadTimes.push_back(0.0);
+
+  reloadable.push_back(true);
+  lruPositions.push_back(lruList.end());
+  pinCounts.emplace_back(0);
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::SetCacheBudget(size_t bytes)
+{
+  if (!IsEmpty())
+    throw std::logic_error("Cache budget must be set on an empty database!");
+
+  cacheBudget = bytes;
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::SetBorder(size_t newBorder, BorderMode mode)
+{
+  if (!IsEmpty())
+    throw std::logic_error("Border must be set on an empty database!");
+
+  border = newBorder;
+  borderMode = mode;
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::SetFence(const ImgPixelType &value)
+{
+  if (!IsEmpty())
+    throw std::logic_error("Fence must be set on an empty database!");
+  if (!border)
+    throw std::logic_error("Fence needs a border!");
+
+  fenced = true;
+  fence = value;
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::Access(size_t i) const
+{
+  if (!IsLazy())
+    return;
+
+  // Pinned pairs can't be dropped, no need to lock.
+  if (pinCounts[i].load(std::memory_order_acquire))
+    return;
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  TouchLocked(i);
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::TouchLocked(size_t i) const
+{
+  if (!reloadable[i])
+    return;
+
+  if (lruPositions[i] != lruList.end()) {
+    lruList.splice(lruList.begin(), lruList, lruPositions[i]);
+    return;
+  }
+
+  auto loaded = LoadPair(imgNames[i], segNames[i]);
+  CheckPair(loaded.image, loaded.segmentation);
+  PadImage(loaded.image);
+
+  images[i] = std::move(loaded.image);
+  EncodeLabels(i, loaded.segmentation);
+  loadTimes[i] = loaded.seconds;
+  cachedBytes += PairBytes(i);
+
+  lruList.push_front(i);
+  lruPositions[i] = lruList.begin();
+
+  EvictLocked(i);
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::EvictLocked(size_t keep) const
+{
+  auto it = lruList.end();
+  while (cachedBytes > cacheBudget && it != lruList.begin()) {
+    --it;
+    size_t j = *it;
+    if (j == keep || pinCounts[j].load(std::memory_order_relaxed))
+      continue;
+
+    cachedBytes -= PairBytes(j);
+    images[j] = ImgType();
+    narrowLabels[j] = Image<NarrowLabelType>();
+    wideLabelImages[j] = Image<WideLabelType>();
+
+    lruPositions[j] = lruList.end();
+    it = lruList.erase(it);
+  }
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::Pin(size_t i) const
+{
+  assert(i < images.size() && "Index of pinned pair is out of range!");
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (IsLazy())
+    TouchLocked(i);
+  pinCounts[i].fetch_add(1, std::memory_order_release);
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::Unpin(size_t i) const
+{
+  assert(i < images.size() && "Index of unpinned pair is out of range!");
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  assert(pinCounts[i].load() > 0 && "Pair is not pinned!");
+  pinCounts[i].fetch_sub(1, std::memory_order_relaxed);
+  if (IsLazy())
+    EvictLocked(images.size());
+}
+
+
+template <class I, class S>
+bool ImageDatabase<I, S>::IsLoaded(size_t i) const
+{
+  assert(i < images.size() && "Index of pair is out of range!");
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return !images[i].isEmpty();
+}
+
+
+template <class I, class S>
+size_t ImageDatabase<I, S>::GetCachedBytes() const
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return cachedBytes;
+}
+
+
+template <class I, class S>
+void ImageDatabase<I, S>::AddFiles(const std::vector<std::string> &imgFiles,
+                                   const std::vector<std::string> &segFiles)
+{
+  if (imgFiles.size() != segFiles.size())
+    throw std::runtime_error("Images / segmentations files count mismatch");
+
+  const size_t count = imgFiles.size();
+  const size_t threads = std::min(loaderThreads, count);
+
+  // Lazy mode decodes only the first pair here.
+  if (threads <= 1 || IsLazy()) {
+    for (size_t i = 0; i < count; ++i)
+      Add(imgFiles[i], segFiles[i]);
+    return;
+  }
+
+  const size_t window = maxPairsInFlight ? maxPairsInFlight : 2 * threads;
+
+  // Pool is destroyed last, so it waits for tasks still referencing files.
+  util::ThreadPool pool(threads);
+  std::deque<std::future<LoadedPair>> pending;
+  size_t scheduled = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    for (; scheduled < count && pending.size() < window; ++scheduled) {
+      const auto &imgFileName = imgFiles[scheduled];
+      const auto &segFileName = segFiles[scheduled];
+      pending.push_back(pool.Submit([&imgFileName, &segFileName]() {
+        return LoadPair(imgFileName, segFileName);
+      }));
+    }
+
+    auto loaded = pending.front().get();
+    pending.pop_front();
+
+    Insert(std::move(loaded.image), std::move(loaded.segmentation),
+           imgFiles[i], segFiles[i], loaded.seconds, /*fromFile=*/ true);
+  }
 }
 
 
@@ -217,8 +885,7 @@ void ImageDatabase<I, S>::ReadFromJson(const util::Json &jsonConfig)
     throw std::runtime_error("Images / segmentations files count mismatch");
 
   // Read files.
-  for (size_t i = 0; i < imagesFiles.size(); ++i)
-    Add(imagesFiles[i], segFiles[i]);
+  AddFiles(imagesFiles, segFiles);
 }
 
 
@@ -282,13 +949,17 @@ void ImageDatabase<I, S>::AppendFilesFromList(const std::string &fileName)
 {
   std::ifstream ifs(fileName);
 
+  std::vector<std::string> imgFiles, segFiles;
   std::string imgFileName, segFileName;
   while (ifs >> imgFileName) {
     if (!(ifs >> segFileName))
       break;
-    Add(imgFileName, segFileName);
+    imgFiles.push_back(imgFileName);
+    segFiles.push_back(segFileName);
   }
   ifs.close();
+
+  AddFiles(imgFiles, segFiles);
 }
 
 
@@ -304,7 +975,21 @@ template<class I, class S>
 void ImageDatabase<I, S>::Clear()
 {
   images.clear();
-  segmentations.clear();
+  narrowLabels.clear();
+  wideLabelImages.clear();
+  labelTable.Clear();
+  wideLabels = false;
+  imgNames.clear();
+  segNames.clear();
+  loadTimes.clear();
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  reloadable.clear();
+  lruList.clear();
+  lruPositions.clear();
+  pinCounts.clear();
+  cachedBytes = 0;
+
   imageHeight = imageWidth = 0;
 }
 
@@ -315,18 +1000,27 @@ ImageDatabase<I, S>::GetImage(size_t i) const
 {
   assert(i < images.size() && "Image index is out of range!");
 
+  Access(i);
   return images[i];
 }
 
 
-// Throws std::out_of_range.
 template<class I, class S>
-const typename ImageDatabase<I, S>::SegType &
+typename ImageDatabase<I, S>::SegType
 ImageDatabase<I, S>::GetSegmentation(size_t i) const
 {
-  assert(i < segmentations.size() && "Segmentation index is out of range!");
+  assert(i < images.size() && "Segmentation index is out of range!");
 
-  return segmentations[i];
+  Access(i);
+
+  SegType result;
+  if (wideLabels)
+    labelTable.Decode(wideLabelImages[i], result);
+  else
+    labelTable.Decode(narrowLabels[i], result);
+  Pad(result);
+
+  return result;
 }
 
 
@@ -348,10 +1042,19 @@ std::string ImageDatabase<I, S>::GetSegmentationName(size_t i) const
 }
 
 
+template <class I, class S>
+double ImageDatabase<I, S>::GetLoadTime(size_t i) const
+{
+  assert(i < loadTimes.size() && "Index of load time is out of range!");
+
+  return loadTimes[i];
+}
+
+
 template<class I, class S>
 size_t ImageDatabase<I, S>::GetImageCount() const
 {
-  assert(images.size() == segmentations.size() &&
+  assert(images.size() == narrowLabels.size() &&
          "Image and segmentation databases must have the same size!");
   return images.size();
 }
@@ -360,7 +1063,7 @@ size_t ImageDatabase<I, S>::GetImageCount() const
 template<class I, class S>
 inline bool ImageDatabase<I, S>::IsEmpty() const
 {
-  assert(images.size() == segmentations.size() &&
+  assert(images.size() == narrowLabels.size() &&
          "Image and segmentation databases must have the same size!");
   return images.size() == 0;
 }
@@ -1,4 +1,5 @@
 #include "AnalyzeHeader.h"
+#include "ByteOrder.h"
 
 #include <stdexcept>
 
@@ -12,7 +13,9 @@ static void CheckSize() {
 
 namespace ImageIO {
 
-AnalyzeFileHeader::AnalyzeFileHeader() {
+AnalyzeFileHeader::AnalyzeFileHeader()
+  : byteSwapped(false)
+{
   CheckSize<HeaderKey, 40>();
   CheckSize<ImageDimensions, 108>();
   CheckSize<DataHistory, 200>();
@@ -22,7 +25,9 @@ AnalyzeFileHeader::AnalyzeFileHeader() {
 }
 
 
-AnalyzeFileHeader::AnalyzeFileHeader(FILE *f) {
+AnalyzeFileHeader::AnalyzeFileHeader(FILE *f)
+  : byteSwapped(false)
+{
   std::memset(&data, 0, sizeof(Data));
   ReadFromFile(f);
 }
@@ -35,6 +40,47 @@ void AnalyzeFileHeader::ReadFromFile(FILE *f) {
   auto elems = fread(&data, sizeof(Data), 1, f);
   if (elems != 1)
     throw std::runtime_error("Failed to read Analyze header");
+
+  const int32_t expectedSize = static_cast<int32_t>(sizeof(Data));
+  if (data.key.SizeOfHeader == expectedSize) {
+    byteSwapped = false;
+  } else if (ByteSwap(data.key.SizeOfHeader) == expectedSize) {
+    byteSwapped = true;
+    SwapByteOrder();
+  } else {
+    throw std::runtime_error("Failed to read Analyze header: bad header size");
+  }
+}
+
+
+void AnalyzeFileHeader::SwapByteOrder() {
+  ByteSwapInPlace(data.key.SizeOfHeader);
+  ByteSwapInPlace(data.key.Extents);
+  ByteSwapInPlace(data.key.SessionError);
+
+  ByteSwapInPlace(data.dims.Dimensions);
+  ByteSwapInPlace(data.dims.UnusedInt);
+  ByteSwapInPlace(data.dims.DataType);
+  ByteSwapInPlace(data.dims.BitsPerPixel);
+  ByteSwapInPlace(data.dims.DimUn0);
+  ByteSwapInPlace(data.dims.PixelDimensions);
+  ByteSwapInPlace(data.dims.VoxelOffset);
+  ByteSwapInPlace(data.dims.UnusedFloat);
+  ByteSwapInPlace(data.dims.CalibrationMax);
+  ByteSwapInPlace(data.dims.CalibrationMin);
+  ByteSwapInPlace(data.dims.Compressed);
+  ByteSwapInPlace(data.dims.Verified);
+  ByteSwapInPlace(data.dims.GlobalMax);
+  ByteSwapInPlace(data.dims.GlobalMin);
+
+  ByteSwapInPlace(data.hist.Views);
+  ByteSwapInPlace(data.hist.VolumesAdded);
+  ByteSwapInPlace(data.hist.StartField);
+  ByteSwapInPlace(data.hist.FieldSkip);
+  ByteSwapInPlace(data.hist.OMax);
+  ByteSwapInPlace(data.hist.OMin);
+  ByteSwapInPlace(data.hist.SMax);
+  ByteSwapInPlace(data.hist.SMin);
 }
 
 
@@ -69,9 +69,14 @@ public:
   AnalyzeFileHeader();
   AnalyzeFileHeader(FILE *f);
 
+  // Reads the header and converts it to host byte order.
+  // Byte order of the file is detected by SizeOfHeader, which must be 348.
   void ReadFromFile(FILE *f);
   Data GetData() const { return data; }
 
+  // True if the file has byte order different from the host one.
+  bool IsByteSwapped() const { return byteSwapped; }
+
   friend std::ostream & operator<<(std::ostream &os,
                                    const AnalyzeFileHeader &hdr);
 
@@ -80,10 +85,13 @@ private:
   void PrintImageDimensions(std::ostream &os) const;
   void PrintDataHistory(std::ostream &os) const;
 
+  void SwapByteOrder();
+
   static const char *DecodeOrientation(char orient);
 
 private:
   Data data;
+  bool byteSwapped;
 };
 
 } // namespace ImageIO
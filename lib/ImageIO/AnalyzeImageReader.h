@@ -2,13 +2,14 @@
 
 #include "AnalyzeHeader.h"
 #include "ImageReader.h"
+#include "Common.h"
+#include "VoxelConversion.h"
 #include "util/string/Split.h"
 
 #include <cstdio>
 #include <stdexcept>
 #include <iostream>
-#include <map>
-#include <functional>
+#include <vector>
 
 
 namespace ImageIO {
@@ -31,48 +32,52 @@ private:
   void ReadHdrFile() {
     auto hdrFileName = GetHeaderFileName();
 
-    FILE *headerInput = fopen(hdrFileName.c_str(), "r");
+    auto headerInput = OpenFile(hdrFileName, "rb");
     if (!headerInput)
       throw std::runtime_error("Cannot open hdr file for reading!");
 
-    header.ReadFromFile(headerInput);
-  }
-
-
-  template <class DataType>
-  static T ReadPixelValue(FILE *in, size_t size) {
-    assert(in && "Input file is null!");
-    DataType result;
-    if (fread(&result, size, 1, in) != 1)
-      throw std::runtime_error("Cannot read pixel from file!");
-
-    return static_cast<T>(result);
+    header.ReadFromFile(headerInput.get());
   }
 
 
+  // Reads the whole voxel block of the first slice at once and converts it
+  // to T in a single pass. If file stores exactly T in host byte order,
+  // the block is read right into the image buffer.
   void ReadImgFile() {
-    FILE *imgInput = fopen(SuperClass::fileName.c_str(), "r");
+    auto imgInput = OpenFile(SuperClass::fileName, "rb");
     if (!imgInput)
       throw std::runtime_error("Cannot open img file for reading!");
 
-    // Resolve reader for pixel type.
-    using ReaderType = std::function<T(FILE*, size_t)>;
-    std::map<int16_t, ReaderType> ReaderFuncMap;
-    ReaderFuncMap[2]  = & ReadPixelValue<unsigned char>;
-    ReaderFuncMap[4]  = & ReadPixelValue<int16_t>;
-    ReaderFuncMap[8]  = & ReadPixelValue<int32_t>;
-    ReaderFuncMap[16] = & ReadPixelValue<float>;
-    ReaderFuncMap[64] = & ReadPixelValue<double>;
-
     auto headerDims = header.GetData().dims;
-    auto PixelReader = ReaderFuncMap[headerDims.DataType];
+    if (headerDims.Dimensions[1] <= 0 || headerDims.Dimensions[2] <= 0)
+      throw std::runtime_error("Invalid image dimensions in hdr file!");
+
     size_t width  = headerDims.Dimensions[1];
     size_t height = headerDims.Dimensions[2];
-    SuperClass::image.Resize(height, width);
-
-    for (size_t i = 0; i < width * height; ++i) {
-      SuperClass::image[i] = PixelReader(imgInput, headerDims.BitsPerPixel / 8);
+    size_t count  = width * height;
+    size_t blockSize = VoxelBlockSize(headerDims.DataType, count);
+
+    long voxelOffset = static_cast<long>(headerDims.VoxelOffset);
+    if (voxelOffset > 0 && fseek(imgInput.get(), voxelOffset, SEEK_SET))
+      throw std::runtime_error("Cannot seek to voxel data in img file!");
+
+    auto &result = SuperClass::image;
+    result.Resize(height, width);
+    bool swap = header.IsByteSwapped();
+
+    if (headerDims.DataType == NativeDataType<T>::value) {
+      if (fread(&result[0], blockSize, 1, imgInput.get()) != 1)
+        throw std::runtime_error("Cannot read pixels from img file!");
+      if (swap)
+        SwapVoxels(&result[0], count);
+      return;
     }
+
+    std::vector<unsigned char> buffer(blockSize);
+    if (fread(buffer.data(), blockSize, 1, imgInput.get()) != 1)
+      throw std::runtime_error("Cannot read pixels from img file!");
+
+    ConvertVoxels(buffer.data(), count, headerDims.DataType, swap, &result[0]);
   }
 
 
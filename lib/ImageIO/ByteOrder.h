@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+
+namespace ImageIO {
+
+template <size_t Size>
+struct ByteSwapper;
+
+template <>
+struct ByteSwapper<1> {
+  using UIntType = uint8_t;
+  static UIntType Swap(UIntType v) { return v; }
+};
+
+template <>
+struct ByteSwapper<2> {
+  using UIntType = uint16_t;
+  static UIntType Swap(UIntType v) {
+    return static_cast<UIntType>((v >> 8) | (v << 8));
+  }
+};
+
+template <>
+struct ByteSwapper<4> {
+  using UIntType = uint32_t;
+  static UIntType Swap(UIntType v) {
+    return ((v & 0x000000FFu) << 24) | ((v & 0x0000FF00u) << 8) |
+           ((v & 0x00FF0000u) >> 8)  | ((v & 0xFF000000u) >> 24);
+  }
+};
+
+template <>
+struct ByteSwapper<8> {
+  using UIntType = uint64_t;
+  static UIntType Swap(UIntType v) {
+    return (static_cast<UIntType>(ByteSwapper<4>::Swap(
+              static_cast<uint32_t>(v))) << 32) |
+           ByteSwapper<4>::Swap(static_cast<uint32_t>(v >> 32));
+  }
+};
+
+
+// Reverses byte order of a value of integral or floating point type.
+template <class T>
+inline T ByteSwap(T value) {
+  using Swapper = ByteSwapper<sizeof(T)>;
+
+  typename Swapper::UIntType bits;
+  std::memcpy(&bits, &value, sizeof(T));
+  bits = Swapper::Swap(bits);
+  std::memcpy(&value, &bits, sizeof(T));
+  return value;
+}
+
+
+template <class T>
+inline void ByteSwapInPlace(T &value) {
+  value = ByteSwap(value);
+}
+
+
+template <class T, size_t N>
+inline void ByteSwapInPlace(T (&values)[N]) {
+  for (auto &v : values)
+    ByteSwapInPlace(v);
+}
+
+
+// Loads a value of type T from possibly unaligned memory.
+template <class T>
+inline T LoadUnaligned(const unsigned char *src) {
+  T value;
+  std::memcpy(&value, src, sizeof(T));
+  return value;
+}
+
+} // namespace ImageIO
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdio>
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -17,4 +19,13 @@ SplitFileName(const std::string &fileName) {
   return std::make_pair(name, ext);
 }
 
+
+// Owning handle of a C file stream, closes the file on destruction.
+using FileHandle = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+// Opens a file, handle holds nullptr if the file can't be opened.
+inline FileHandle OpenFile(const std::string &fileName, const char *mode) {
+  return FileHandle(std::fopen(fileName.c_str(), mode), &std::fclose);
+}
+
 } // namespace ImageIO
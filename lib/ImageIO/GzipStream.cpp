@@ -0,0 +1,529 @@
+#include "GzipStream.h"
+#include "../lodepng/lodepng.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr size_t INPUT_BUFFER_SIZE = 1 << 16;
+
+// Base values and extra bits of length (257..285) and distance (0..29) codes.
+const uint16_t LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const uint8_t LENGTH_EXTRA[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const uint16_t DIST_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+  16385, 24577
+};
+const uint8_t DIST_EXTRA[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Order in which code length code lengths are stored.
+const uint8_t CODE_LENGTH_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+
+unsigned ReverseBits(unsigned code, unsigned length) {
+  unsigned result = 0;
+  for (unsigned i = 0; i < length; ++i) {
+    result = (result << 1) | (code & 1);
+    code >>= 1;
+  }
+  return result;
+}
+
+
+struct Crc32Table {
+  Crc32Table() {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      values[n] = c;
+    }
+  }
+
+  uint32_t values[256];
+};
+
+
+void AppendLE32(std::vector<unsigned char> &out, uint32_t value) {
+  for (int i = 0; i < 4; ++i)
+    out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+} // namespace
+
+
+namespace ImageIO {
+
+constexpr size_t GzipInputStream::WINDOW_SIZE;
+constexpr size_t GzipInputStream::WINDOW_MASK;
+
+
+void Crc32::Update(const unsigned char *data, size_t size) {
+  static const Crc32Table table;
+
+  uint32_t c = value;
+  for (size_t i = 0; i < size; ++i)
+    c = table.values[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+  value = c;
+}
+
+
+void GzipInputStream::HuffmanTable::Build(const uint8_t *lengths,
+                                          size_t count) {
+  unsigned lengthCount[17] = { 0 };
+  std::memset(fast, 0, sizeof(fast));
+
+  for (size_t i = 0; i < count; ++i)
+    ++lengthCount[lengths[i]];
+  lengthCount[0] = 0;
+
+  // Canonical codes: first code and first symbol index of every length.
+  unsigned nextCode[16];
+  unsigned code = 0;
+  unsigned k = 0;
+  for (unsigned len = 1; len < 16; ++len) {
+    nextCode[len] = code;
+    firstCode[len] = static_cast<uint16_t>(code);
+    firstSymbol[len] = static_cast<uint16_t>(k);
+    code += lengthCount[len];
+    if (lengthCount[len] && code - 1 >= (1u << len))
+      throw std::runtime_error("Bad Huffman code lengths in gzip stream!");
+    // Pre-shifted so the slow path compares 16-bit prefixes directly.
+    maxCode[len] = code << (16 - len);
+    code <<= 1;
+    k += lengthCount[len];
+  }
+  maxCode[16] = 0x10000;
+
+  for (size_t i = 0; i < count; ++i) {
+    unsigned len = lengths[i];
+    if (!len)
+      continue;
+
+    unsigned idx = nextCode[len] - firstCode[len] + firstSymbol[len];
+    codeLength[idx] = static_cast<uint8_t>(len);
+    symbol[idx] = static_cast<uint16_t>(i);
+
+    if (len <= FAST_BITS) {
+      uint16_t fastValue = static_cast<uint16_t>((len << 9) | i);
+      for (unsigned j = ReverseBits(nextCode[len], len); j < (1u << FAST_BITS);
+           j += (1u << len))
+        fast[j] = fastValue;
+    }
+    ++nextCode[len];
+  }
+}
+
+
+GzipInputStream::GzipInputStream(FILE *f)
+  : file(f)
+  , rawDeflate(false)
+  , inBuffer(INPUT_BUFFER_SIZE)
+  , inData(inBuffer.data())
+  , inPos(0)
+  , inSize(0)
+  , overrunBytes(0)
+  , bitBuffer(0)
+  , bitCount(0)
+  , bytesFed(0)
+  , state(State::BlockHeader)
+  , lastBlock(false)
+  , blockStartBit(0)
+  , endBit(0)
+  , storedRemaining(0)
+  , copyLength(0)
+  , copyDistance(0)
+  , window(WINDOW_SIZE)
+  , totalOut(0)
+  , finished(false)
+{
+  if (!file)
+    throw std::runtime_error("Cannot read from null FILE*!");
+
+  ReadHeader();
+}
+
+
+GzipInputStream::GzipInputStream(const unsigned char *data, size_t size)
+  : file(nullptr)
+  , rawDeflate(true)
+  , inData(data)
+  , inPos(0)
+  , inSize(size)
+  , overrunBytes(0)
+  , bitBuffer(0)
+  , bitCount(0)
+  , bytesFed(0)
+  , state(State::BlockHeader)
+  , lastBlock(false)
+  , blockStartBit(0)
+  , endBit(0)
+  , storedRemaining(0)
+  , copyLength(0)
+  , copyDistance(0)
+  , window(WINDOW_SIZE)
+  , totalOut(0)
+  , finished(false)
+{}
+
+
+size_t GzipInputStream::Read(unsigned char *out, size_t size) {
+  if (finished)
+    return 0;
+
+  size_t n = 0;
+
+  while (n < size) {
+    // Finish pending back-reference first.
+    if (copyLength) {
+      size_t count = size - n < copyLength ? size - n : copyLength;
+      for (size_t i = 0; i < count; ++i) {
+        auto byte = window[(totalOut - copyDistance) & WINDOW_MASK];
+        window[totalOut++ & WINDOW_MASK] = out[n++] = byte;
+      }
+      copyLength -= count;
+      continue;
+    }
+
+    if (state == State::Done)
+      break;
+
+    if (state == State::BlockHeader) {
+      if (lastBlock)
+        state = State::Done;
+      else
+        ReadBlockHeader();
+      continue;
+    }
+
+    if (state == State::Stored) {
+      if (!storedRemaining) {
+        state = State::BlockHeader;
+        continue;
+      }
+      auto byte = static_cast<unsigned char>(GetBits(8));
+      window[totalOut++ & WINDOW_MASK] = out[n++] = byte;
+      --storedRemaining;
+      continue;
+    }
+
+    // Huffman-coded block: decode literals until a back-reference or the end
+    // of the block.
+    while (n < size) {
+      unsigned sym = DecodeSymbol(litTable);
+      if (sym < 256) {
+        auto byte = static_cast<unsigned char>(sym);
+        window[totalOut++ & WINDOW_MASK] = out[n++] = byte;
+        continue;
+      }
+
+      if (sym == 256) {
+        state = State::BlockHeader;
+        break;
+      }
+
+      sym -= 257;
+      if (sym >= 29)
+        throw std::runtime_error("Bad length code in gzip stream!");
+      copyLength = LENGTH_BASE[sym] + GetBits(LENGTH_EXTRA[sym]);
+
+      unsigned dist = DecodeSymbol(distTable);
+      if (dist >= 30)
+        throw std::runtime_error("Bad distance code in gzip stream!");
+      copyDistance = DIST_BASE[dist] + GetBits(DIST_EXTRA[dist]);
+      if (copyDistance > totalOut)
+        throw std::runtime_error("Bad distance in gzip stream!");
+      break;
+    }
+  }
+
+  CheckNotTruncated();
+  if (!rawDeflate)
+    crc.Update(out, n);
+
+  if (state == State::Done && !copyLength) {
+    endBit = GetBitPosition();
+    if (rawDeflate)
+      finished = true;
+    else
+      ReadTrailer();
+  }
+
+  return n;
+}
+
+
+void GzipInputStream::Finish() {
+  unsigned char buffer[4096];
+  while (!finished)
+    Read(buffer, sizeof(buffer));
+}
+
+
+size_t GzipInputStream::FindDeflateEnd(const unsigned char *data, size_t size,
+                                       size_t &finalBlockBit) {
+  // Blocks are decoded into the window only, output is thrown away.
+  GzipInputStream stream(data, size);
+  stream.Finish();
+  finalBlockBit = stream.blockStartBit;
+  return stream.endBit;
+}
+
+
+unsigned char GzipInputStream::NextInputByte() {
+  if (inPos == inSize) {
+    inSize = file ? fread(inBuffer.data(), 1, inBuffer.size(), file) : 0;
+    inPos = 0;
+    if (!inSize) {
+      // Let the bit buffer prefetch past the end, complain only if the
+      // decoder actually consumes these bytes.
+      ++overrunBytes;
+      return 0;
+    }
+  }
+  return inData[inPos++];
+}
+
+
+void GzipInputStream::FillBits() {
+  while (bitCount <= 56) {
+    bitBuffer |= static_cast<uint64_t>(NextInputByte()) << bitCount;
+    bitCount += 8;
+    ++bytesFed;
+  }
+}
+
+
+uint32_t GzipInputStream::GetBits(unsigned count) {
+  if (bitCount < count)
+    FillBits();
+
+  auto value = static_cast<uint32_t>(bitBuffer & ((1ull << count) - 1));
+  bitBuffer >>= count;
+  bitCount -= count;
+  return value;
+}
+
+
+void GzipInputStream::AlignToByte() {
+  GetBits(bitCount % 8);
+}
+
+
+unsigned GzipInputStream::DecodeSymbol(const HuffmanTable &table) {
+  if (bitCount < 16)
+    FillBits();
+
+  unsigned fast = table.fast[bitBuffer & ((1u << HuffmanTable::FAST_BITS) - 1)];
+  if (fast) {
+    unsigned len = fast >> 9;
+    bitBuffer >>= len;
+    bitCount -= len;
+    return fast & 511;
+  }
+
+  // Slow path for long codes: compare bit-reversed 16-bit prefix against
+  // the largest code of each length.
+  unsigned k = ReverseBits(static_cast<unsigned>(bitBuffer & 0xFFFF), 16);
+  unsigned len = HuffmanTable::FAST_BITS + 1;
+  while (k >= table.maxCode[len])
+    ++len;
+  if (len >= 16)
+    throw std::runtime_error("Bad Huffman code in gzip stream!");
+
+  unsigned idx = (k >> (16 - len)) - table.firstCode[len] +
+                 table.firstSymbol[len];
+  if (idx >= HuffmanTable::MAX_SYMBOLS || table.codeLength[idx] != len)
+    throw std::runtime_error("Bad Huffman code in gzip stream!");
+
+  bitBuffer >>= len;
+  bitCount -= len;
+  return table.symbol[idx];
+}
+
+
+void GzipInputStream::ReadHeader() {
+  constexpr unsigned FHCRC    = 0x02;
+  constexpr unsigned FEXTRA   = 0x04;
+  constexpr unsigned FNAME    = 0x08;
+  constexpr unsigned FCOMMENT = 0x10;
+
+  unsigned id1 = GetBits(8);
+  unsigned id2 = GetBits(8);
+  unsigned method = GetBits(8);
+  if (id1 != 0x1F || id2 != 0x8B || method != 8)
+    throw std::runtime_error("Not a gzip file!");
+
+  unsigned flags = GetBits(8);
+  GetBits(32); // Modification time.
+  GetBits(16); // Extra flags and OS.
+
+  if (flags & FEXTRA) {
+    unsigned extraLength = GetBits(16);
+    for (unsigned i = 0; i < extraLength; ++i)
+      GetBits(8);
+  }
+  if (flags & FNAME)
+    while (GetBits(8)) {}
+  if (flags & FCOMMENT)
+    while (GetBits(8)) {}
+  if (flags & FHCRC)
+    GetBits(16);
+
+  CheckNotTruncated();
+}
+
+
+void GzipInputStream::ReadBlockHeader() {
+  blockStartBit = GetBitPosition();
+  lastBlock = GetBits(1);
+  unsigned type = GetBits(2);
+
+  switch (type) {
+  case 0: {
+    AlignToByte();
+    unsigned len = GetBits(16);
+    unsigned nlen = GetBits(16);
+    if (len != (~nlen & 0xFFFF))
+      throw std::runtime_error("Bad stored block length in gzip stream!");
+    storedRemaining = len;
+    state = State::Stored;
+    break;
+  }
+  case 1: {
+    uint8_t lengths[HuffmanTable::MAX_SYMBOLS + 32];
+    std::memset(lengths, 8, 144);
+    std::memset(lengths + 144, 9, 256 - 144);
+    std::memset(lengths + 256, 7, 280 - 256);
+    std::memset(lengths + 280, 8, 288 - 280);
+    std::memset(lengths + 288, 5, 32);
+    litTable.Build(lengths, 288);
+    distTable.Build(lengths + 288, 32);
+    state = State::Huffman;
+    break;
+  }
+  case 2:
+    ReadDynamicTables();
+    state = State::Huffman;
+    break;
+  default:
+    throw std::runtime_error("Bad block type in gzip stream!");
+  }
+
+  CheckNotTruncated();
+}
+
+
+void GzipInputStream::ReadDynamicTables() {
+  unsigned litCount  = GetBits(5) + 257;
+  unsigned distCount = GetBits(5) + 1;
+  if (litCount > 286 || distCount > 30)
+    throw std::runtime_error("Bad dynamic block header in gzip stream!");
+  unsigned codeCount = GetBits(4) + 4;
+
+  uint8_t codeLengths[19] = { 0 };
+  for (unsigned i = 0; i < codeCount; ++i)
+    codeLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(GetBits(3));
+
+  HuffmanTable codeTable;
+  codeTable.Build(codeLengths, 19);
+
+  uint8_t lengths[286 + 32] = { 0 };
+  unsigned total = litCount + distCount;
+  unsigned n = 0;
+  while (n < total) {
+    unsigned sym = DecodeSymbol(codeTable);
+    if (sym < 16) {
+      lengths[n++] = static_cast<uint8_t>(sym);
+      continue;
+    }
+
+    uint8_t value = 0;
+    unsigned repeat = 0;
+    if (sym == 16) {
+      if (!n)
+        throw std::runtime_error("Bad code lengths in gzip stream!");
+      value = lengths[n - 1];
+      repeat = 3 + GetBits(2);
+    } else if (sym == 17) {
+      repeat = 3 + GetBits(3);
+    } else if (sym == 18) {
+      repeat = 11 + GetBits(7);
+    } else {
+      throw std::runtime_error("Bad code lengths in gzip stream!");
+    }
+
+    if (n + repeat > total)
+      throw std::runtime_error("Bad code lengths in gzip stream!");
+    std::memset(lengths + n, value, repeat);
+    n += repeat;
+  }
+
+  if (!lengths[256])
+    throw std::runtime_error("No end of block code in gzip stream!");
+
+  litTable.Build(lengths, litCount);
+  distTable.Build(lengths + litCount, distCount);
+}
+
+
+void GzipInputStream::ReadTrailer() {
+  AlignToByte();
+  uint32_t expectedCrc = GetBits(32);
+  uint32_t expectedSize = GetBits(32);
+  CheckNotTruncated();
+
+  if (expectedCrc != crc.GetValue())
+    throw std::runtime_error("CRC mismatch in gzip stream!");
+  if (expectedSize != static_cast<uint32_t>(totalOut))
+    throw std::runtime_error("Size mismatch in gzip stream!");
+
+  finished = true;
+}
+
+
+void GzipInputStream::CheckNotTruncated() const {
+  if (overrunBytes * 8 > bitCount)
+    throw std::runtime_error("Unexpected end of gzip stream!");
+}
+
+
+void GzipCompress(const unsigned char *data, size_t size,
+                  std::vector<unsigned char> &out) {
+  unsigned char *deflated = nullptr;
+  size_t deflatedSize = 0;
+
+  auto error = lodepng_deflate(&deflated, &deflatedSize, data, size,
+                               &lodepng_default_compress_settings);
+  if (error) {
+    std::free(deflated);
+    throw std::runtime_error("Error while compressing gzip data!");
+  }
+
+  // Minimal header: no name, no timestamp, unknown OS.
+  out.assign({ 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF });
+  out.insert(out.end(), deflated, deflated + deflatedSize);
+  std::free(deflated);
+
+  Crc32 crc;
+  crc.Update(data, size);
+  AppendLE32(out, crc.GetValue());
+  AppendLE32(out, static_cast<uint32_t>(size));
+}
+
+} // namespace ImageIO
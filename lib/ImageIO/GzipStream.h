@@ -0,0 +1,134 @@
+#pragma once
+
+#include "InputStream.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+
+namespace ImageIO {
+
+// Incremental CRC-32 (the one used by gzip and PNG).
+class Crc32 {
+public:
+  void Update(const unsigned char *data, size_t size);
+
+  uint32_t GetValue() const { return value ^ 0xFFFFFFFFu; }
+
+private:
+  uint32_t value = 0xFFFFFFFFu;
+};
+
+
+// Streaming decoder of gzip files (RFC 1952, RFC 1951).
+//
+// Data is inflated on demand right into the buffer passed to Read(), only the
+// last 32 KiB of output (DEFLATE window) and a small input buffer are kept.
+// So a reader can decode a compressed image into its pixel buffer without
+// a decompressed copy of the whole file.
+//
+// Only the first gzip member is decoded. CRC-32 and size of decompressed data
+// are verified when the end of the member is reached, readers which stop
+// before it call Finish().
+//
+// All methods throw std::runtime_error on malformed or truncated data.
+class GzipInputStream : public InputStream {
+public:
+  // Doesn't own the file. Reads gzip header immediately.
+  explicit GzipInputStream(FILE *f);
+
+  virtual size_t Read(unsigned char *out, size_t size) override;
+
+  // Decodes the rest of the member and verifies its trailer.
+  void Finish();
+
+  // Walks blocks of a complete raw deflate stream (RFC 1951) in memory.
+  // Returns bit position (LSB first) of the bit after the end of the
+  // stream, finalBlockBit gets the position of BFINAL bit of the final
+  // block.
+  static size_t FindDeflateEnd(const unsigned char *data, size_t size,
+                               size_t &finalBlockBit);
+
+private:
+  // Raw deflate stream in memory, no gzip header and trailer.
+  GzipInputStream(const unsigned char *data, size_t size);
+
+  struct HuffmanTable {
+    static constexpr unsigned FAST_BITS = 10;
+    static constexpr unsigned MAX_SYMBOLS = 288;
+
+    // Decodes code lengths of count symbols into the table.
+    void Build(const uint8_t *lengths, size_t count);
+
+    // For codes not longer than FAST_BITS: (code length << 9) | symbol,
+    // indexed by the next FAST_BITS input bits. 0 means "use slow path".
+    uint16_t fast[1 << FAST_BITS];
+
+    uint16_t firstCode[17];
+    uint16_t firstSymbol[17];
+    uint32_t maxCode[17];
+    uint8_t  codeLength[MAX_SYMBOLS];
+    uint16_t symbol[MAX_SYMBOLS];
+  };
+
+  enum class State { BlockHeader, Stored, Huffman, Done };
+
+  unsigned char NextInputByte();
+  void FillBits();
+  size_t GetBitPosition() const { return 8 * bytesFed - bitCount; }
+  uint32_t GetBits(unsigned count);
+  void AlignToByte();
+  unsigned DecodeSymbol(const HuffmanTable &table);
+
+  void ReadHeader();
+  void ReadBlockHeader();
+  void ReadDynamicTables();
+  void ReadTrailer();
+  void CheckNotTruncated() const;
+
+private:
+  static constexpr size_t WINDOW_SIZE = 1 << 15;
+  static constexpr size_t WINDOW_MASK = WINDOW_SIZE - 1;
+
+  FILE *file;        ///< Null for raw deflate in memory.
+  bool rawDeflate;
+
+  // Compressed input, inData is inBuffer or the whole raw stream.
+  std::vector<unsigned char> inBuffer;
+  const unsigned char *inData;
+  size_t inPos;
+  size_t inSize;
+  size_t overrunBytes; ///< Zero bytes fed to the bit buffer after EOF.
+
+  uint64_t bitBuffer;
+  unsigned bitCount;
+  uint64_t bytesFed; ///< Bytes ever fed to the bit buffer.
+
+  // Decoder state.
+  State state;
+  bool lastBlock;
+  size_t blockStartBit; ///< Position of BFINAL bit of the current block.
+  size_t endBit;        ///< Position after the end of the deflate stream.
+  size_t storedRemaining;
+  size_t copyLength;
+  size_t copyDistance;
+  HuffmanTable litTable;
+  HuffmanTable distTable;
+
+  // Decompressed output.
+  std::vector<unsigned char> window;
+  uint64_t totalOut;
+  Crc32 crc;
+  bool finished; ///< Trailer is read and verified.
+};
+
+
+// Compresses data into a complete gzip file image using lodepng's deflate.
+//
+// Throws std::runtime_error if compression fails.
+void GzipCompress(const unsigned char *data, size_t size,
+                  std::vector<unsigned char> &out);
+
+} // namespace ImageIO
@@ -3,13 +3,24 @@
 #include "util/string/Split.h"
 
 #include "AnalyzeImageReader.h"
+#include "NiftiImageReader.h"
 #include "PngImageReader.h"
 
+#include "NiftiImageWriter.h"
 #include "PngImageWriter.h"
 
 
 namespace ImageIO {
 
+// True for .nii and .nii.gz file names.
+inline bool IsNiftiFileName(const std::string &fileName) {
+  auto fileNameParts = util::SplitStringByLast(fileName, '.');
+  if (fileNameParts.second == "gz")
+    fileNameParts = util::SplitStringByLast(fileNameParts.first, '.');
+  return fileNameParts.second == "nii";
+}
+
+
 template <class T>
 Image<T> ReadImage(const std::string &fileName) {
   auto fileNameParts = util::SplitStringByLast(fileName, '.');
@@ -20,6 +31,8 @@ Image<T> ReadImage(const std::string &fileName) {
     reader = new AnalyzeImageReader<T>(fileName);
   else if (fileNameParts.second == "png")
     reader = new PngImageReader<T>(fileName);
+  else if (IsNiftiFileName(fileName))
+    reader = new NiftiImageReader<T>(fileName);
 
   if (!reader)
     return Image<T>();
@@ -41,6 +54,8 @@ void WriteImage(const Image<T> &image, const std::string &fileName) {
 
   if (fileNameParts.second == "png")
     writer = new PngImageWriter<T>;
+  else if (IsNiftiFileName(fileName))
+    writer = new NiftiImageWriter<T>;
 
   if (!writer)
     return;
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+
+namespace ImageIO {
+
+// Sequential source of bytes readers can decode from without knowing whether
+// data comes from a plain or a compressed file.
+class InputStream {
+public:
+  virtual ~InputStream() = default;
+
+  // Reads up to size bytes, returns less only at the end of the stream.
+  virtual size_t Read(unsigned char *out, size_t size) = 0;
+
+  // Reads exactly size bytes.
+  //
+  // Throws std::runtime_error if the stream ends earlier.
+  void ReadExactly(unsigned char *out, size_t size) {
+    if (Read(out, size) != size)
+      throw std::runtime_error("Unexpected end of stream!");
+  }
+
+  // Skips exactly count bytes.
+  //
+  // Throws std::runtime_error if the stream ends earlier.
+  void Skip(size_t count) {
+    unsigned char buffer[4096];
+    while (count) {
+      size_t chunk = count < sizeof(buffer) ? count : sizeof(buffer);
+      ReadExactly(buffer, chunk);
+      count -= chunk;
+    }
+  }
+};
+
+
+// Plain file stream. Doesn't own the file.
+class FileInputStream : public InputStream {
+public:
+  explicit FileInputStream(FILE *f)
+    : file(f)
+  {
+    if (!file)
+      throw std::runtime_error("Cannot read from null FILE*!");
+  }
+
+  virtual size_t Read(unsigned char *out, size_t size) override {
+    return fread(out, 1, size, file);
+  }
+
+private:
+  FILE *file;
+};
+
+} // namespace ImageIO
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace ImageIO {
+
+// Gray-scale intensity of an RGB color: 0.21 R + 0.72 G + 0.07 B, rounded.
+//
+// Weights are 16-bit fixed point numbers summing up to 1 << 16, so pure white
+// stays 255 and there's no floating point math per pixel.
+inline uint8_t Luminance(uint8_t r, uint8_t g, uint8_t b) {
+  constexpr uint32_t R_WEIGHT = 13763;
+  constexpr uint32_t G_WEIGHT = 47186;
+  constexpr uint32_t B_WEIGHT = 4587;
+  static_assert(R_WEIGHT + G_WEIGHT + B_WEIGHT == (1u << 16),
+                "Luminance weights must sum up to 1.0");
+
+  return static_cast<uint8_t>(
+    (R_WEIGHT * r + G_WEIGHT * g + B_WEIGHT * b + (1u << 15)) >> 16);
+}
+
+} // namespace ImageIO
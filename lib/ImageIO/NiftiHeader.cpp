@@ -0,0 +1,157 @@
+#include "NiftiHeader.h"
+#include "ByteOrder.h"
+#include "VoxelConversion.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace {
+
+bool IsExactly(float value, float expected) {
+  return !(value < expected) && !(value > expected);
+}
+
+} // namespace
+
+
+namespace ImageIO {
+
+constexpr size_t NiftiFileHeader::HEADER_SIZE;
+constexpr size_t NiftiFileHeader::SINGLE_FILE_VOXEL_OFFSET;
+
+
+NiftiFileHeader::NiftiFileHeader()
+  : byteSwapped(false)
+{
+  static_assert(sizeof(NiftiHeaderData) == HEADER_SIZE,
+                "NIfTI-1 header must be 348 bytes!");
+
+  std::memset(&data, 0, sizeof(data));
+}
+
+
+NiftiFileHeader::NiftiFileHeader(size_t height, size_t width,
+                                 int16_t dataType)
+  : NiftiFileHeader()
+{
+  if (height > INT16_MAX || width > INT16_MAX)
+    throw std::invalid_argument("Image is too large for NIfTI-1 header!");
+
+  data.SizeOfHeader = static_cast<int32_t>(HEADER_SIZE);
+  data.Regular = 'r';
+
+  data.Dimensions[0] = 2;
+  data.Dimensions[1] = static_cast<int16_t>(width);
+  data.Dimensions[2] = static_cast<int16_t>(height);
+  for (int i = 3; i < 8; ++i)
+    data.Dimensions[i] = 1;
+
+  data.DataType = dataType;
+  data.BitsPerPixel = dataType == DT_BINARY
+    ? 1 : static_cast<int16_t>(8 * BytesPerVoxel(dataType));
+
+  for (auto &pixDim : data.PixelDimensions)
+    pixDim = 1.0f;
+
+  data.VoxelOffset = static_cast<float>(SINGLE_FILE_VOXEL_OFFSET);
+  data.ScaleSlope = 1.0f;
+  std::memcpy(data.Magic, "n+1", 4);
+}
+
+
+void NiftiFileHeader::ReadFromStream(InputStream &is) {
+  unsigned char buffer[HEADER_SIZE];
+  if (is.Read(buffer, HEADER_SIZE) != HEADER_SIZE)
+    throw std::runtime_error("Failed to read NIfTI header");
+  std::memcpy(&data, buffer, HEADER_SIZE);
+
+  const int32_t expectedSize = static_cast<int32_t>(HEADER_SIZE);
+  if (data.SizeOfHeader == expectedSize) {
+    byteSwapped = false;
+  } else if (ByteSwap(data.SizeOfHeader) == expectedSize) {
+    byteSwapped = true;
+    SwapByteOrder();
+  } else {
+    throw std::runtime_error("Failed to read NIfTI header: bad header size");
+  }
+
+  // Only single-file images are supported: "ni1" keeps voxels in a paired
+  // .img file, which is never opened.
+  if (std::memcmp(data.Magic, "n+1", 4))
+    throw std::runtime_error("Failed to read NIfTI header: bad magic string");
+
+  // Voxels of a single-file image can't overlap the header and its extender.
+  if (!(data.VoxelOffset >= static_cast<float>(SINGLE_FILE_VOXEL_OFFSET)))
+    throw std::runtime_error("Failed to read NIfTI header: bad voxel offset");
+}
+
+
+void NiftiFileHeader::WriteToBuffer(unsigned char *out) const {
+  std::memcpy(out, &data, HEADER_SIZE);
+  std::memset(out + HEADER_SIZE, 0, SINGLE_FILE_VOXEL_OFFSET - HEADER_SIZE);
+}
+
+
+bool NiftiFileHeader::HasScaling() const {
+  // Zero or non-finite slope means "no scaling" by the standard.
+  if (!std::isfinite(data.ScaleSlope) || IsExactly(data.ScaleSlope, 0.0f))
+    return false;
+  return !IsExactly(data.ScaleSlope, 1.0f) ||
+         !IsExactly(data.ScaleIntercept, 0.0f);
+}
+
+
+void NiftiFileHeader::SwapByteOrder() {
+  ByteSwapInPlace(data.SizeOfHeader);
+  ByteSwapInPlace(data.Extents);
+  ByteSwapInPlace(data.SessionError);
+  ByteSwapInPlace(data.Dimensions);
+  ByteSwapInPlace(data.IntentP1);
+  ByteSwapInPlace(data.IntentP2);
+  ByteSwapInPlace(data.IntentP3);
+  ByteSwapInPlace(data.IntentCode);
+  ByteSwapInPlace(data.DataType);
+  ByteSwapInPlace(data.BitsPerPixel);
+  ByteSwapInPlace(data.SliceStart);
+  ByteSwapInPlace(data.PixelDimensions);
+  ByteSwapInPlace(data.VoxelOffset);
+  ByteSwapInPlace(data.ScaleSlope);
+  ByteSwapInPlace(data.ScaleIntercept);
+  ByteSwapInPlace(data.SliceEnd);
+  ByteSwapInPlace(data.CalibrationMax);
+  ByteSwapInPlace(data.CalibrationMin);
+  ByteSwapInPlace(data.SliceDuration);
+  ByteSwapInPlace(data.TimeOffset);
+  ByteSwapInPlace(data.GlobalMax);
+  ByteSwapInPlace(data.GlobalMin);
+  ByteSwapInPlace(data.QFormCode);
+  ByteSwapInPlace(data.SFormCode);
+  ByteSwapInPlace(data.Quaternion);
+  ByteSwapInPlace(data.QOffset);
+  ByteSwapInPlace(data.SRowX);
+  ByteSwapInPlace(data.SRowY);
+  ByteSwapInPlace(data.SRowZ);
+}
+
+
+std::ostream & operator<<(std::ostream &os, const NiftiFileHeader &hdr) {
+  const auto &d = hdr.data;
+  os << "NIfTI-1 header {"
+     << "\n  SizeOfHeader   : " << d.SizeOfHeader
+     << "\n  Dimensions     : " << d.Dimensions[0] << " ("
+     << d.Dimensions[1] << " x " << d.Dimensions[2] << " x "
+     << d.Dimensions[3] << ")"
+     << "\n  DataType       : " << d.DataType
+     << "\n  BitsPerPixel   : " << d.BitsPerPixel
+     << "\n  VoxelOffset    : " << d.VoxelOffset
+     << "\n  ScaleSlope     : " << d.ScaleSlope
+     << "\n  ScaleIntercept : " << d.ScaleIntercept
+     << "\n  Magic          : '" << d.Magic << "'"
+     << "\n  Byte swapped   : " << hdr.byteSwapped
+     << "\n}\n";
+  return os;
+}
+
+} // namespace ImageIO
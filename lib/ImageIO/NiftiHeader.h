@@ -0,0 +1,95 @@
+#pragma once
+
+#include "InputStream.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+
+
+namespace ImageIO {
+
+struct NiftiHeaderData {
+  int32_t SizeOfHeader;
+  char    DataTypeName   [10];
+  char    DatabaseName   [18];
+  int32_t Extents;
+  int16_t SessionError;
+  char    Regular;
+  char    DimInfo;
+  int16_t Dimensions     [8];
+  float   IntentP1;
+  float   IntentP2;
+  float   IntentP3;
+  int16_t IntentCode;
+  int16_t DataType;
+  int16_t BitsPerPixel;
+  int16_t SliceStart;
+  float   PixelDimensions[8];
+  float   VoxelOffset;
+  float   ScaleSlope;
+  float   ScaleIntercept;
+  int16_t SliceEnd;
+  char    SliceCode;
+  char    Units;
+  float   CalibrationMax;
+  float   CalibrationMin;
+  float   SliceDuration;
+  float   TimeOffset;
+  int32_t GlobalMax;
+  int32_t GlobalMin;
+  char    Description    [80];
+  char    AuxFile        [24];
+  int16_t QFormCode;
+  int16_t SFormCode;
+  float   Quaternion     [3];
+  float   QOffset        [3];
+  float   SRowX          [4];
+  float   SRowY          [4];
+  float   SRowZ          [4];
+  char    IntentName     [16];
+  char    Magic          [4];
+}; // 348 bytes.
+
+
+class NiftiFileHeader {
+public:
+  // Size of header and the (empty) extension block following it.
+  static constexpr size_t HEADER_SIZE = 348;
+  static constexpr size_t SINGLE_FILE_VOXEL_OFFSET = 352;
+
+  NiftiFileHeader();
+
+  // Header of a single-file 2D image with given dimensions and data type.
+  NiftiFileHeader(size_t height, size_t width, int16_t dataType);
+
+  // Reads the header and converts it to host byte order.
+  // Byte order of the file is detected by SizeOfHeader, which must be 348.
+  //
+  // Throws std::runtime_error if the data isn't a NIfTI-1 header.
+  void ReadFromStream(InputStream &is);
+
+  // Writes header in host byte order, followed by 4 zero bytes of
+  // extension flags. out must have SINGLE_FILE_VOXEL_OFFSET bytes.
+  void WriteToBuffer(unsigned char *out) const;
+
+  const NiftiHeaderData &GetData() const { return data; }
+
+  // True if the file has byte order different from the host one.
+  bool IsByteSwapped() const { return byteSwapped; }
+
+  // True if voxel values must be scaled by ScaleSlope and ScaleIntercept.
+  bool HasScaling() const;
+
+  friend std::ostream & operator<<(std::ostream &os,
+                                   const NiftiFileHeader &hdr);
+
+private:
+  void SwapByteOrder();
+
+private:
+  NiftiHeaderData data;
+  bool byteSwapped;
+};
+
+} // namespace ImageIO
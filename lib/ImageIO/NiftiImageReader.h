@@ -0,0 +1,113 @@
+#pragma once
+
+#include "NiftiHeader.h"
+#include "ImageReader.h"
+#include "InputStream.h"
+#include "GzipStream.h"
+#include "Common.h"
+#include "VoxelConversion.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+
+namespace ImageIO {
+
+// True for names of gzip-compressed files (*.gz).
+inline bool IsGzipFileName(const std::string &fileName) {
+  return SplitFileName(fileName).second == "gz";
+}
+
+
+// Reader of single-file NIfTI-1 images (.nii and gzipped .nii.gz).
+// Only the first slice of a volume is read.
+template <class T>
+class NiftiImageReader : public ImageReader<T> {
+public:
+  using Self       = NiftiImageReader<T>;
+  using SuperClass = ImageReader<T>;
+
+  // Inherit constructor.
+  using SuperClass::SuperClass;
+
+  virtual void Read() override {
+    auto input = OpenFile(SuperClass::fileName, "rb");
+    if (!input)
+      throw std::runtime_error("Cannot open nii file for reading!");
+
+    if (IsGzipFileName(SuperClass::fileName)) {
+      GzipInputStream is(input.get());
+      ReadFromStream(is);
+      // Voxels end before the trailer, it is checked anyway.
+      is.Finish();
+    } else {
+      FileInputStream is(input.get());
+      ReadFromStream(is);
+    }
+  }
+
+  const NiftiFileHeader &GetHeader() const { return header; }
+
+private:
+  // Voxels are decoded in chunks of this size when they need conversion.
+  static constexpr size_t CHUNK_VOXELS = 1 << 14;
+
+  void ReadFromStream(InputStream &is) {
+    header.ReadFromStream(is);
+
+    const auto &hdr = header.GetData();
+    if (hdr.Dimensions[1] <= 0 || hdr.Dimensions[2] <= 0)
+      throw std::runtime_error("Invalid image dimensions in nii file!");
+
+    auto voxelOffset = static_cast<size_t>(hdr.VoxelOffset);
+    if (voxelOffset > NiftiFileHeader::HEADER_SIZE)
+      is.Skip(voxelOffset - NiftiFileHeader::HEADER_SIZE);
+
+    size_t width  = hdr.Dimensions[1];
+    size_t height = hdr.Dimensions[2];
+    size_t count  = width * height;
+    bool swap = header.IsByteSwapped();
+    bool scaled = header.HasScaling() && hdr.DataType != DT_RGB;
+
+    auto &result = SuperClass::image;
+    result.Resize(height, width);
+
+    // Same type as stored: inflate right into the image buffer.
+    if (hdr.DataType == NativeDataType<T>::value && !scaled) {
+      is.ReadExactly(reinterpret_cast<unsigned char*>(&result[0]),
+                     VoxelBlockSize(hdr.DataType, count));
+      if (swap)
+        SwapVoxels(&result[0], count);
+      return;
+    }
+
+    std::vector<unsigned char> buffer(
+      VoxelBlockSize(hdr.DataType, std::min(count, CHUNK_VOXELS)));
+    std::vector<double> values(scaled ? std::min(count, CHUNK_VOXELS) : 0);
+
+    for (size_t done = 0; done < count; done += CHUNK_VOXELS) {
+      size_t n = std::min(count - done, CHUNK_VOXELS);
+      is.ReadExactly(buffer.data(), VoxelBlockSize(hdr.DataType, n));
+
+      if (!scaled) {
+        ConvertVoxels(buffer.data(), n, hdr.DataType, swap, &result[done]);
+        continue;
+      }
+
+      ConvertVoxels(buffer.data(), n, hdr.DataType, swap, values.data());
+      for (size_t i = 0; i < n; ++i)
+        result[done + i] = VoxelCast<T>::FromScalar(
+          values[i] * hdr.ScaleSlope + hdr.ScaleIntercept);
+    }
+  }
+
+private:
+  NiftiFileHeader header;
+};
+
+
+template <class T>
+constexpr size_t NiftiImageReader<T>::CHUNK_VOXELS;
+
+} // namespace ImageIO
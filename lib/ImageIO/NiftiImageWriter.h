@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ImageWriter.h"
+#include "NiftiHeader.h"
+#include "NiftiImageReader.h"
+#include "GzipStream.h"
+#include "Common.h"
+#include "VoxelConversion.h"
+
+#include <stdexcept>
+#include <vector>
+
+
+namespace ImageIO {
+
+// Writer of single-file NIfTI-1 images. Pixels are stored as is in host byte
+// order (RGBAPixel as DT_RGB), file is gzipped if its name ends with .gz.
+template <class T>
+class NiftiImageWriter : public ImageWriter<T> {
+public:
+  using Self       = NiftiImageWriter<T>;
+  using SuperClass = ImageWriter<T>;
+
+  NiftiImageWriter() = default;
+  ~NiftiImageWriter() = default;
+
+  virtual void Write(const Image<T> &image, const std::string &fileName) {
+    const int16_t dataType = StoredDataType<T>::value;
+    if (!dataType)
+      throw std::invalid_argument("Pixel type can't be stored in nii file!");
+
+    NiftiFileHeader header(image.getHeight(), image.getWidth(), dataType);
+
+    const size_t offset = NiftiFileHeader::SINGLE_FILE_VOXEL_OFFSET;
+    std::vector<unsigned char> bytes(
+      offset + VoxelBlockSize(dataType, image.getSize()));
+    header.WriteToBuffer(bytes.data());
+
+    // Rows of padded images aren't contiguous.
+    const size_t rowBytes = VoxelBlockSize(dataType, image.getWidth());
+    for (size_t i = 0; i < image.getHeight(); ++i)
+      StoreVoxels(image.row(i).data(), image.getWidth(),
+                  bytes.data() + offset + i * rowBytes);
+
+    if (IsGzipFileName(fileName)) {
+      std::vector<unsigned char> compressed;
+      GzipCompress(bytes.data(), bytes.size(), compressed);
+      bytes.swap(compressed);
+    }
+
+    auto output = OpenFile(fileName, "wb");
+    if (!output)
+      throw std::runtime_error("Cannot open nii file for writing!");
+
+    if (fwrite(bytes.data(), 1, bytes.size(), output.get()) != bytes.size())
+      throw std::runtime_error("Error while writing file " + fileName);
+  }
+};
+
+} // namespace ImageIO
@@ -0,0 +1,163 @@
+#include "ParallelDeflate.h"
+#include "GzipStream.h"
+
+#include "util/thread/ParallelFor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+
+namespace ImageIO {
+
+namespace {
+
+// Error code returned if a deflated chunk can't be parsed. Not used by
+// lodepng itself.
+constexpr unsigned MALFORMED_CHUNK_ERROR = 1000;
+constexpr unsigned ALLOCATION_ERROR = 83; // lodepng's "memory allocation failed"
+
+
+uint32_t Adler32(const unsigned char *data, size_t size) {
+  constexpr uint32_t BASE = 65521;
+  // Largest number of bytes summed up before b overflows 32 bits.
+  constexpr size_t NMAX = 5552;
+
+  uint32_t a = 1, b = 0;
+  while (size) {
+    size_t n = size < NMAX ? size : NMAX;
+    size -= n;
+    for (size_t i = 0; i < n; ++i) {
+      a += data[i];
+      b += a;
+    }
+    data += n;
+    a %= BASE;
+    b %= BASE;
+  }
+  return (b << 16) | a;
+}
+
+
+// Adler-32 of concatenation of data with checksum first and data with
+// checksum second of size secondSize.
+uint32_t CombineAdler32(uint32_t first, uint32_t second, size_t secondSize) {
+  constexpr uint64_t BASE = 65521;
+
+  uint64_t a1 = first & 0xFFFF, b1 = first >> 16;
+  uint64_t a2 = second & 0xFFFF, b2 = second >> 16;
+
+  uint64_t a = (a1 + a2 + BASE - 1) % BASE;
+  uint64_t b =
+    (b1 + b2 + (secondSize % BASE) * ((a1 + BASE - 1) % BASE)) % BASE;
+  return static_cast<uint32_t>((b << 16) | a);
+}
+
+
+// Deflated chunk of input.
+struct Chunk {
+  std::vector<unsigned char> bytes;
+  uint32_t adler = 1;
+  unsigned error = 0;
+};
+
+
+void DeflateChunk(const unsigned char *in, size_t size, bool last,
+                  const LodePNGCompressSettings &settings, Chunk &chunk) {
+  chunk.adler = Adler32(in, size);
+
+  // lodepng gives no blocks at all for empty input. Empty input is the
+  // only chunk, a final fixed Huffman block with end code alone is enough.
+  if (!size) {
+    chunk.bytes = { 0x03, 0x00 };
+    return;
+  }
+
+  unsigned char *deflated = nullptr;
+  size_t deflatedSize = 0;
+  chunk.error = lodepng_deflate(&deflated, &deflatedSize, in, size, &settings);
+  if (!chunk.error)
+    chunk.bytes.assign(deflated, deflated + deflatedSize);
+  std::free(deflated);
+
+  if (chunk.error || last)
+    return;
+
+  try {
+    size_t lastBlockBit = 0;
+    size_t endBit = GzipInputStream::FindDeflateEnd(
+      chunk.bytes.data(), chunk.bytes.size(), lastBlockBit);
+
+    // The stream goes on after this chunk.
+    chunk.bytes[lastBlockBit >> 3] &= ~(1u << (lastBlockBit & 7));
+
+    // Empty stored block: 3 zero header bits, zero bits up to byte
+    // boundary, LEN = 0, NLEN = 0xFFFF.
+    chunk.bytes.resize((endBit + 3 + 7) / 8, 0);
+    chunk.bytes.insert(chunk.bytes.end(), { 0x00, 0x00, 0xFF, 0xFF });
+  } catch (const std::exception &) {
+    chunk.error = MALFORMED_CHUNK_ERROR;
+  }
+}
+
+} // namespace
+
+
+unsigned ParallelZlibCompress(unsigned char **out, size_t *outsize,
+                              const unsigned char *in, size_t insize,
+                              const LodePNGCompressSettings *settings) {
+  // Chunks are deflated by lodepng itself.
+  LodePNGCompressSettings chunkSettings = *settings;
+  chunkSettings.custom_zlib = nullptr;
+  chunkSettings.custom_deflate = nullptr;
+
+  const size_t chunkSize = PARALLEL_DEFLATE_CHUNK_SIZE;
+  const size_t chunkCount = insize ? (insize - 1) / chunkSize + 1 : 1;
+  std::vector<Chunk> chunks(chunkCount);
+
+  util::ParallelFor(0, chunkCount, [&](size_t k) {
+    size_t begin = k * chunkSize;
+    size_t size = std::min(insize - begin, chunkSize);
+    DeflateChunk(in + begin, size, k + 1 == chunkCount, chunkSettings,
+                 chunks[k]);
+  });
+
+  // zlib header: deflate with 32K window, no dictionary, fastest level.
+  const unsigned char HEADER[2] = { 0x78, 0x01 };
+  size_t total = sizeof(HEADER) + 4;
+  uint32_t adler = 1;
+  for (size_t k = 0; k < chunkCount; ++k) {
+    if (chunks[k].error)
+      return chunks[k].error;
+    total += chunks[k].bytes.size();
+
+    size_t size = std::min(insize - k * chunkSize, chunkSize);
+    adler = CombineAdler32(adler, chunks[k].adler, size);
+  }
+
+  auto *result =
+    static_cast<unsigned char *>(std::realloc(*out, *outsize + total));
+  if (!result)
+    return ALLOCATION_ERROR;
+
+  unsigned char *dst = result + *outsize;
+  std::memcpy(dst, HEADER, sizeof(HEADER));
+  dst += sizeof(HEADER);
+  for (const auto &chunk : chunks) {
+    std::memcpy(dst, chunk.bytes.data(), chunk.bytes.size());
+    dst += chunk.bytes.size();
+  }
+
+  // Adler-32 is big endian.
+  for (int shift = 24; shift >= 0; shift -= 8)
+    *dst++ = static_cast<unsigned char>(adler >> shift);
+
+  *out = result;
+  *outsize += total;
+  return 0;
+}
+
+} // namespace ImageIO
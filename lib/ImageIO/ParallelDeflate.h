@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../lodepng/lodepng.h"
+
+#include <cstddef>
+
+
+namespace ImageIO {
+
+// Input of ParallelZlibCompress is cut into chunks of this size.
+constexpr size_t PARALLEL_DEFLATE_CHUNK_SIZE = 1 << 18;
+
+// Smallest input ParallelZlibCompress is worth using for.
+constexpr size_t PARALLEL_DEFLATE_MIN_SIZE = 2 * PARALLEL_DEFLATE_CHUNK_SIZE;
+
+
+// zlib compressor for LodePNGCompressSettings::custom_zlib.
+//
+// Chunks of input are deflated by lodepng with the given settings on all
+// cores. The final block of every chunk but the last one is turned into a
+// non-final one and followed by an empty stored block, which byte-aligns
+// the stream, so chunks are joined into a single valid zlib stream. Chunks
+// don't share LZ77 history, so output is slightly larger than the one of
+// lodepng_zlib_compress.
+//
+// Appends the stream to *out (allocated by malloc, may be null) and returns
+// 0, or returns a lodepng error code.
+unsigned ParallelZlibCompress(unsigned char **out, size_t *outsize,
+                              const unsigned char *in, size_t insize,
+                              const LodePNGCompressSettings *settings);
+
+} // namespace ImageIO
@@ -1,39 +1,61 @@
 #pragma once
 
 #include "ImageReader.h"
+#include "VoxelConversion.h"
 #include "../lodepng/lodepng.h"
 #include "RGBAPixel.h"
 
-#include <cmath>
-#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 
-namespace {
+namespace ImageIO {
+
+namespace detail {
 
-template <class PixelType>
-#if !_MSC_VER
-__attribute__((unused))
-#endif
-void CastRGBPixels(const Image<RGBAPixel> &rgb, Image<PixelType> &img) {
-  img.Resize(rgb.getHeight(), rgb.getWidth());
+// True if T holds 16-bit gray samples without overflow.
+template <class T, bool = std::is_arithmetic<T>::value>
+struct HoldsGray16
+  : std::integral_constant<bool, std::is_floating_point<T>::value ||
+                                 std::numeric_limits<T>::max() >= 0xFFFF> {};
+
+template <class T>
+struct HoldsGray16<T, false> : std::false_type {};
 
-  for (size_t i = 0; i < rgb.getSize(); ++i) {
-    img[i] =
-      std::lround(0.21 * rgb[i].r + 0.72 * rgb[i].g + 0.07 * rgb[i].b);
+// Conversion of rows of pixels decoded by lodepng to pixel type T.
+template <class T>
+struct PngRowConversion {
+  static void FromGray8(const unsigned char *src, size_t count, T *dst) {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = VoxelCast<T>::FromScalar(src[i]);
   }
-}
 
-template<>
-void CastRGBPixels<RGBAPixel>(const Image<RGBAPixel> &rgb,
-                              Image<RGBAPixel> &img) {
-  img = rgb;
-}
+  // 16-bit samples are big endian.
+  static void FromGray16(const unsigned char *src, size_t count, T *dst) {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = VoxelCast<T>::FromScalar(
+        static_cast<uint16_t>((src[2 * i] << 8) | src[2 * i + 1]));
+  }
 
-} // namespace
+  // Integer luminance, the loop has no branches and vectorizes.
+  static void FromRGB8(const unsigned char *src, size_t count, T *dst) {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = VoxelCast<T>::FromRGB(src[3 * i], src[3 * i + 1],
+                                     src[3 * i + 2]);
+  }
+};
 
+} // namespace detail
 
-namespace ImageIO {
 
+// Reader of PNG images.
+//
+// Gray images are decoded in their own bit depth (8 or 16 bits, lower ones
+// are expanded to 8) right into pixels, color ones are decoded to RGB and
+// converted by Luminance. 16-bit samples are cut to their high byte if T
+// can't hold them. RGBAPixel images get RGBA pixels as stored.
 template <class T>
 class PngImageReader : public ImageReader<T> {
 public:
@@ -44,30 +66,88 @@ public:
   using SuperClass::SuperClass;
 
   void Read() override {
-    std::vector<RGBAPixel::PixelType> png;
-    std::vector<RGBAPixel::PixelType> img;
-    unsigned width = 0, height = 0;
-
+    std::vector<unsigned char> png;
     if (lodepng::load_file(png, SuperClass::fileName))
       throw std::runtime_error("Error loading PNG file " +
                                SuperClass::fileName);
 
-    if (lodepng::decode(img, width, height, png))
+    lodepng::State state;
+    unsigned width = 0, height = 0;
+    if (lodepng_inspect(&width, &height, &state, png.data(), png.size()))
       throw std::runtime_error("Error decoding PNG file " +
                                SuperClass::fileName);
 
-    Image<RGBAPixel> rgbImage(height, width);
+    ChooseRawColor(state);
 
-    for (size_t i = 0; i < rgbImage.getSize(); ++i) {
-      auto r = img[4 * i + 0];
-      auto g = img[4 * i + 1];
-      auto b = img[4 * i + 2];
-      auto a = img[4 * i + 3];
-      rgbImage[i] = RGBAPixel(r, g, b, a);
+    std::vector<unsigned char> raw;
+    if (lodepng::decode(raw, width, height, state, png))
+      throw std::runtime_error("Error decoding PNG file " +
+                               SuperClass::fileName);
+
+    // Compressed data isn't needed any more.
+    std::vector<unsigned char>().swap(png);
+
+    auto &result = SuperClass::image;
+    result.Resize(height, width);
+
+    const auto &color = state.info_raw;
+    const size_t rowBytes = lodepng_get_raw_size(width, 1, &color);
+    for (size_t i = 0; i < height; ++i)
+      ConvertRow(raw.data() + i * rowBytes, color, result.row(i).data(),
+                 width);
+  }
+
+private:
+  static constexpr bool IS_RGBA = std::is_same<T, RGBAPixel>::value;
+
+  // Decoded color of the image given by its header in state.info_png.
+  static void ChooseRawColor(lodepng::State &state) {
+    const auto &stored = state.info_png.color;
+    auto &raw = state.info_raw;
+
+    bool gray = stored.colortype == LCT_GREY ||
+                stored.colortype == LCT_GREY_ALPHA;
+
+    if (IS_RGBA) {
+      raw.colortype = LCT_RGBA;
+      raw.bitdepth = 8;
+    } else if (gray) {
+      raw.colortype = LCT_GREY;
+      raw.bitdepth = stored.bitdepth == 16 && detail::HoldsGray16<T>::value
+                     ? 16 : 8;
+    } else {
+      raw.colortype = LCT_RGB;
+      raw.bitdepth = 8;
     }
+  }
+
+  static void ConvertRow(const unsigned char *src, const LodePNGColorMode &color,
+                         T *dst, size_t count) {
+    using Conversion = detail::PngRowConversion<T>;
 
-    CastRGBPixels<T>(rgbImage, SuperClass::image);
+    if (color.colortype == LCT_GREY && color.bitdepth == 16)
+      Conversion::FromGray16(src, count, dst);
+    else if (color.colortype == LCT_GREY)
+      Conversion::FromGray8(src, count, dst);
+    else
+      Conversion::FromRGB8(src, count, dst);
   }
 };
 
+
+template <class T>
+constexpr bool PngImageReader<T>::IS_RGBA;
+
+
+// RGBA pixels are taken as decoded, alpha included.
+template <>
+inline void
+PngImageReader<RGBAPixel>::ConvertRow(const unsigned char *src,
+                                      const LodePNGColorMode &,
+                                      RGBAPixel *dst, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = RGBAPixel(src[4 * i], src[4 * i + 1], src[4 * i + 2],
+                       src[4 * i + 3]);
+}
+
 } // namespace ImageIO
@@ -1,16 +1,114 @@
 #include "PngImageWriter.h"
+#include "ParallelDeflate.h"
+
+#include <stdexcept>
+#include <unordered_map>
 
 namespace ImageIO {
 
-template<>
-void PngImageWriter<RGBAPixel>::ConvertToRGB(const Image<RGBAPixel> &image) {
-  for (size_t i = 0; i < image.getSize(); ++i) {
-    rawPixels[4 * i + 0] = image[i].r;
-    rawPixels[4 * i + 1] = image[i].g;
-    rawPixels[4 * i + 2] = image[i].b;
-    rawPixels[4 * i + 3] = image[i].a;
+static uint32_t PackColor(const RGBAPixel &pixel) {
+  return (uint32_t(pixel.r) << 24) | (uint32_t(pixel.g) << 16) |
+         (uint32_t(pixel.b) << 8) | pixel.a;
+}
+
+
+void ToPngRaw(const Image<RGBAPixel> &image, PngRawImage &raw) {
+  constexpr size_t MAX_PALETTE_SIZE = 256;
+
+  // Palette index by packed color, filled until there are too many colors.
+  std::unordered_map<uint32_t, unsigned char> indices;
+  bool opaque = true;
+  raw.palette.clear();
+
+  for (size_t i = 0; i < image.getHeight(); ++i)
+    for (const auto &pixel : image.row(i)) {
+      opaque &= pixel.a == 255;
+      if (raw.palette.size() > MAX_PALETTE_SIZE)
+        continue;
+
+      if (indices.emplace(PackColor(pixel), raw.palette.size()).second)
+        raw.palette.push_back(pixel);
+    }
+
+  raw.bitDepth = 8;
+
+  if (raw.palette.size() <= MAX_PALETTE_SIZE) {
+    raw.colorType = LCT_PALETTE;
+    raw.pixels.resize(image.getSize());
+    auto *dst = raw.pixels.data();
+    for (size_t i = 0; i < image.getHeight(); ++i)
+      for (const auto &pixel : image.row(i))
+        *dst++ = indices[PackColor(pixel)];
+    return;
   }
+
+  raw.palette.clear();
+  raw.colorType = opaque ? LCT_RGB : LCT_RGBA;
+  const size_t channels = opaque ? 3 : 4;
+  raw.pixels.resize(channels * image.getSize());
+
+  auto *dst = raw.pixels.data();
+  for (size_t i = 0; i < image.getHeight(); ++i)
+    for (const auto &pixel : image.row(i)) {
+      *dst++ = pixel.r;
+      *dst++ = pixel.g;
+      *dst++ = pixel.b;
+      if (!opaque)
+        *dst++ = pixel.a;
+    }
 }
 
 
+void EncodePng(const PngRawImage &raw, unsigned width, unsigned height,
+               PngProfile profile, const std::string &fileName) {
+  lodepng::State state;
+  state.info_raw.colortype = raw.colorType;
+  state.info_raw.bitdepth = raw.bitDepth;
+  for (const auto &color : raw.palette)
+    if (lodepng_palette_add(&state.info_raw, color.r, color.g, color.b,
+                            color.a))
+      throw std::runtime_error("Error while encoding file " + fileName);
+
+  // Filter type of every row for LFS_PREDEFINED.
+  std::vector<unsigned char> filters;
+
+  switch (profile) {
+  case PngProfile::Archival:
+    // Encoder chooses the smallest color type itself.
+    break;
+
+  case PngProfile::Fast: {
+    // Raw color type is written as is, it's already compact.
+    state.encoder.auto_convert = 0;
+    if (lodepng_color_mode_copy(&state.info_png.color, &state.info_raw))
+      throw std::runtime_error("Error while encoding file " + fileName);
+
+    auto &zlib = state.encoder.zlibsettings;
+    zlib.windowsize = 512;
+    zlib.nicematch = 32;
+    zlib.lazymatching = 0;
+
+    // "Up" filter suits smooth images and label maps, palette rows are
+    // left unfiltered.
+    const unsigned char UP_FILTER = 2;
+    filters.assign(height, UP_FILTER);
+    state.encoder.filter_palette_zero = 1;
+    state.encoder.filter_strategy = LFS_PREDEFINED;
+    state.encoder.predefined_filters = filters.data();
+    break;
+  }
+  }
+
+  // Large images are deflated on all cores.
+  if (raw.pixels.size() >= PARALLEL_DEFLATE_MIN_SIZE)
+    state.encoder.zlibsettings.custom_zlib = ParallelZlibCompress;
+
+  std::vector<unsigned char> png;
+  if (lodepng::encode(png, raw.pixels.data(), width, height, state))
+    throw std::runtime_error("Error while encoding file " + fileName);
+
+  if (lodepng::save_file(png, fileName))
+    throw std::runtime_error("Error while writing file " + fileName);
+}
+
 } // namespace ImageIO
@@ -3,12 +3,72 @@
 #include "ImageWriter.h"
 #include "RGBAPixel.h"
 #include "../lodepng/lodepng.h"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
 #include <vector>
-#include <stdexcept>
 
 
 namespace ImageIO {
 
+// Encoder settings of PngImageWriter.
+enum class PngProfile {
+  Archival, // lodepng defaults, smallest files.
+  Fast      // Little zlib effort and a fixed filter, files are larger.
+};
+
+
+// Pixels in the form they are given to lodepng.
+struct PngRawImage {
+  std::vector<unsigned char> pixels;
+  LodePNGColorType colorType = LCT_GREY;
+  unsigned bitDepth = 8;
+  std::vector<RGBAPixel> palette; // Colors of LCT_PALETTE pixels.
+};
+
+
+// Scalar pixels are stored as gray16 if they are 16-bit integers, as gray8
+// (cut to 8 bits) otherwise.
+template <class T>
+void ToPngRaw(const Image<T> &image, PngRawImage &raw) {
+  constexpr bool WIDE = std::is_integral<T>::value && sizeof(T) == 2;
+
+  raw.colorType = LCT_GREY;
+  raw.bitDepth = WIDE ? 16 : 8;
+  raw.palette.clear();
+  raw.pixels.resize(image.getSize() * (WIDE ? 2 : 1));
+
+  auto *dst = raw.pixels.data();
+  for (size_t i = 0; i < image.getHeight(); ++i) {
+    auto row = image.row(i);
+    if (WIDE) {
+      // 16-bit samples are big endian.
+      for (size_t j = 0; j < row.size(); ++j, dst += 2) {
+        auto value = static_cast<uint16_t>(row[j]);
+        dst[0] = static_cast<unsigned char>(value >> 8);
+        dst[1] = static_cast<unsigned char>(value);
+      }
+    } else {
+      for (size_t j = 0; j < row.size(); ++j)
+        *dst++ = static_cast<unsigned char>(row[j]);
+    }
+  }
+}
+
+
+// Colors are stored as palette if there are at most 256 of them, as RGB if
+// all of them are opaque, as RGBA otherwise.
+void ToPngRaw(const Image<RGBAPixel> &image, PngRawImage &raw);
+
+
+// Encodes pixels and writes them to fileName.
+//
+// Throws std::runtime_error if encoding or writing fails.
+void EncodePng(const PngRawImage &raw, unsigned width, unsigned height,
+               PngProfile profile, const std::string &fileName);
+
+
 // Generic PNG image writer.
 template <class T>
 class PngImageWriter : public ImageWriter<T> {
@@ -16,35 +76,28 @@ public:
   using Self       = PngImageWriter<T>;
   using SuperClass = ImageWriter<T>;
 
-  PngImageWriter() = default;
+  explicit PngImageWriter(PngProfile defaultProfile = PngProfile::Archival)
+    : profile(defaultProfile)
+  {}
+
   ~PngImageWriter() = default;
 
   virtual void Write(const Image<T> &image, const std::string &fileName) {
-    rawPixels.resize(4 * image.getSize(), 0);
-    ConvertToRGB(image);
+    Write(image, fileName, profile);
+  }
 
-    auto error =
-      lodepng::encode(fileName, rawPixels, image.getWidth(), image.getHeight());
-    if (error)
-      throw std::runtime_error("Error while encoding file " + fileName);
+  void Write(const Image<T> &image, const std::string &fileName,
+             PngProfile writeProfile) {
+    ToPngRaw(image, raw);
+    EncodePng(raw, image.getWidth(), image.getHeight(), writeProfile,
+              fileName);
   }
 
 protected:
-  virtual void ConvertToRGB(const Image<T> &image) {
-    for (size_t i = 0; i < image.getSize(); ++i) {
-      rawPixels[4 * i + 0] = rawPixels[4 * i + 1] = rawPixels[4 * i + 2] =
-        image[i];
-      rawPixels[4 * i + 3] = 255;
-    }
-  }
+  PngProfile profile;
 
-  std::vector<RGBAPixel::PixelType> rawPixels;
+  // Kept between writes to reuse memory.
+  PngRawImage raw;
 };
 
-
-template<>
-void PngImageWriter<RGBAPixel>::ConvertToRGB(const Image<RGBAPixel> &image);
-
-template class PngImageWriter<RGBAPixel>;
-
 } // namespace ImageIO
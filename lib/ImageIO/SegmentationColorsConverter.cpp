@@ -0,0 +1,118 @@
+#include "SegmentationColorsConverter.h"
+
+#include <cmath>
+
+
+namespace ImageIO {
+
+constexpr size_t SegmentationColorsConverter::MAX_LABEL;
+
+
+namespace {
+
+// Colors of labels 0..120, label 0 (background) is black.
+const RGBAPixel::PixelType DEFAULT_COLORS[][3] = {
+  /*   0 */ {  0,   0,   0}, {  0,   0,   0}, {  0, 238,   0}, {160,  82,  45},
+  /*   4 */ {255, 218, 185}, {  0, 206, 209}, {127, 255, 212}, {178,  34,  34},
+  /*   8 */ {238,   0,   0}, { 34, 139,  34}, {208,  32, 144}, {173, 255,  47},
+  /*  12 */ {240, 230, 140}, {173, 216, 230}, {238, 238,   0}, { 50, 205,  50},
+  /*  16 */ {255,   0, 255}, {176,  48,  96}, {  0, 255, 127}, {245, 222, 179},
+  /*  20 */ {255, 165,   5}, {255, 165,   0}, {255,  69,   0}, {205,  91,  69},
+  /*  24 */ {255, 192, 203}, {152, 251, 152}, {100, 149, 237}, {160,  32, 240},
+  /*  28 */ {238, 130, 238}, {238, 201,   0}, {218, 112, 214}, {255,  62, 150},
+  /*  32 */ {  0,   0, 255}, { 39,  64, 139}, {250, 128, 114}, {255, 110, 180},
+  /*  36 */ {255,  99,  71}, {255, 255,   0}, {  0, 100,   0}, {205,  92,  92},
+  /*  40 */ {165,  42,  42}, {153,  50, 204}, {  0, 255, 255}, {221, 160, 221},
+  /*  44 */ {135, 206, 235}, {152, 200, 214}, {153,  29, 242}, {210, 180, 140},
+  /*  48 */ {255, 215,   0}, {  0,   0, 128}, { 46, 139,  87}, {102, 205, 170},
+  /*  52 */ {  0, 255,   0}, {  0,   0,   0}, {220, 216,  20}, { 60,  58, 210},
+  /*  56 */ {100,  50, 100}, {135,  50,  74}, {122, 135,  50}, { 51,  50, 135},
+  /*  60 */ { 74, 155,  60}, {  0, 238,   0}, {160,  82,  45}, {255, 218, 185},
+  /*  64 */ {  0, 206, 209}, {127, 255, 212}, {178,  34,  34}, {238,   0,   0},
+  /*  68 */ { 34, 139,  34}, {208,  32, 144}, {173, 255,  47}, {240, 230, 140},
+  /*  72 */ {173, 216, 230}, {238, 238,   0}, { 50, 205,  50}, {255,   0, 255},
+  /*  76 */ {176,  48,  96}, {  0, 255, 127}, {245, 222, 179}, {255, 165,   5},
+  /*  80 */ {255, 165,   0}, {255,  69,   0}, {205,  91,  69}, {255, 192, 203},
+  /*  84 */ {152, 251, 152}, {100, 149, 237}, {160,  32, 240}, {238, 130, 238},
+  /*  88 */ {238, 201,   0}, {218, 112, 214}, {255,  62, 150}, {  0,   0, 255},
+  /*  92 */ { 39,  64, 139}, {250, 128, 114}, {255, 110, 180}, {255,  99,  71},
+  /*  96 */ {255, 255,   0}, {  0, 100,   0}, {205,  92,  92}, {165,  42,  42},
+  /* 100 */ {153,  50, 204}, {  0, 255, 255}, {221, 160, 221}, {135, 206, 235},
+  /* 104 */ {152, 200, 214}, {153,  29, 242}, {210, 180, 140}, {255, 215,   0},
+  /* 108 */ {  0,   0, 128}, { 46, 139,  87}, {102, 205, 170}, {  0, 255,   0},
+  /* 112 */ {  0,   0,   0}, {220, 216,  20}, { 60,  58, 210}, {100,  50, 100},
+  /* 116 */ {135,  50,  74}, {122, 135,  50}, { 51,  50, 135}, { 74, 155,  60},
+  /* 120 */ {  1,   1,   1},
+};
+
+constexpr size_t DEFAULT_COLOR_COUNT =
+  sizeof(DEFAULT_COLORS) / sizeof(DEFAULT_COLORS[0]);
+
+
+// Colors of labels past the default ones. Hues go round by the golden ratio,
+// so labels close to each other get distinct colors.
+RGBAPixel GeneratedColor(size_t label) {
+  const double GOLDEN_RATIO_CONJUGATE = 0.6180339887498949;
+  const double hue = std::fmod(label * GOLDEN_RATIO_CONJUGATE, 1.0) * 6.0;
+  const double saturation = label % 2 ? 0.65 : 0.9;
+  const double value = label % 3 ? 0.95 : 0.75;
+
+  const int sector = static_cast<int>(hue) % 6;
+  const double f = hue - std::floor(hue);
+  const double p = value * (1.0 - saturation);
+  const double q = value * (1.0 - saturation * f);
+  const double t = value * (1.0 - saturation * (1.0 - f));
+
+  double r = 0.0, g = 0.0, b = 0.0;
+  switch (sector) {
+  case 0: r = value; g = t;     b = p;     break;
+  case 1: r = q;     g = value; b = p;     break;
+  case 2: r = p;     g = value; b = t;     break;
+  case 3: r = p;     g = q;     b = value; break;
+  case 4: r = t;     g = p;     b = value; break;
+  default: r = value; g = p;    b = q;     break;
+  }
+
+  auto channel = [](double x) {
+    return static_cast<RGBAPixel::PixelType>(std::lround(x * 255.0));
+  };
+  return RGBAPixel(channel(r), channel(g), channel(b));
+}
+
+} // namespace
+
+
+SegmentationColorsConverter::SegmentationColorsConverter() {
+  Colors.reserve(DEFAULT_COLOR_COUNT);
+  for (const auto &c : DEFAULT_COLORS)
+    Colors.emplace_back(c[0], c[1], c[2]);
+}
+
+
+const RGBAPixel& SegmentationColorsConverter::GetColor(size_t label) {
+  Reserve(label);
+  return Colors[label];
+}
+
+
+void SegmentationColorsConverter::Reserve(size_t maxLabel) {
+  if (maxLabel > MAX_LABEL)
+    throw std::out_of_range("Label is too large for color table!");
+
+  for (size_t label = Colors.size(); label <= maxLabel; ++label)
+    Colors.push_back(GeneratedColor(label));
+}
+
+
+void SegmentationColorsConverter::SetOpacity(double opacity) {
+  if (!(opacity >= 0.0 && opacity <= 1.0))
+    throw std::invalid_argument("Opacity must be in [0, 1]!");
+  Opacity = opacity;
+}
+
+
+unsigned SegmentationColorsConverter::OpacityWeight() const {
+  return static_cast<unsigned>(std::lround(Opacity * 256.0));
+}
+
+} // namespace ImageIO
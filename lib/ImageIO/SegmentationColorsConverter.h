@@ -2,185 +2,193 @@
 
 #include "RGBAPixel.h"
 #include "Image.h"
-#include <map>
+#include "util/thread/ParallelFor.h"
+
+#include <algorithm>
+#include <cstdint>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 
 namespace ImageIO {
 
+namespace detail {
+
+template <class S>
+typename std::enable_if<std::is_signed<S>::value, bool>::type
+IsNegativeLabel(S label) { return label < 0; }
+
+template <class S>
+typename std::enable_if<!std::is_signed<S>::value, bool>::type
+IsNegativeLabel(S) { return false; }
+
+
+// mask[j] = 1 if pixel j of row cur is labeled and one of its 4 neighbors has
+// another label, 0 otherwise. Rows above and below are nullptr outside the
+// image, pixels outside the image count as background. Interior pixels are
+// handled without branches, so the loop vectorizes.
+template <class S>
+void FindContourRow(const S *up, const S *cur, const S *down, size_t width,
+                    uint8_t *mask) {
+  if (!up || !down || width < 3) {
+    for (size_t j = 0; j < width; ++j)
+      mask[j] = cur[j] != S();
+    return;
+  }
+
+  mask[0] = cur[0] != S();
+  for (size_t j = 1; j + 1 < width; ++j) {
+    const S c = cur[j];
+    mask[j] = (c != S()) & ((up[j] != c) | (down[j] != c) |
+                            (cur[j - 1] != c) | (cur[j + 1] != c));
+  }
+  mask[width - 1] = cur[width - 1] != S();
+}
+
+
+// Channel of color drawn over base with weight/256 opacity.
+inline RGBAPixel::PixelType BlendChannel(unsigned base, unsigned color,
+                                         unsigned weight) {
+  return static_cast<RGBAPixel::PixelType>(
+    (base * (256 - weight) + color * weight + 128) >> 8);
+}
+
+} // namespace detail
+
+
+// Renders segmentations as RGB images, alone or drawn over gray images.
+//
+// Colors are kept in a flat table indexed by label: labels up to 120 have
+// fixed colors, larger ones get generated colors as they appear. Rows are
+// rendered in parallel and every pixel of the image is written.
 class SegmentationColorsConverter {
 public:
-  SegmentationColorsConverter() {
-    ColorsMap[0] = RGBAPixel(0, 0, 0);
-    ColorsMap[1] = RGBAPixel(0, 0, 0);
-    ColorsMap[2] = RGBAPixel(0, 238, 0);
-    ColorsMap[3] = RGBAPixel(160, 82, 45);
-    ColorsMap[4] = RGBAPixel(255, 218, 185);
-    ColorsMap[5] = RGBAPixel(0, 206, 209);
-    ColorsMap[6] = RGBAPixel(127, 255, 212);
-    ColorsMap[7] = RGBAPixel(178, 34, 34);
-    ColorsMap[8] = RGBAPixel(238, 0, 0);
-    ColorsMap[9] = RGBAPixel(34, 139, 34);
-    ColorsMap[10] = RGBAPixel(208, 32, 144);
-    ColorsMap[11] = RGBAPixel(173, 255, 47);
-    ColorsMap[12] = RGBAPixel(240, 230, 140);
-    ColorsMap[13] = RGBAPixel(173, 216, 230);
-    ColorsMap[14] = RGBAPixel(238, 238, 0);
-    ColorsMap[15] = RGBAPixel(50, 205, 50);
-    ColorsMap[16] = RGBAPixel(255, 0, 255);
-    ColorsMap[17] = RGBAPixel(176, 48, 96);
-    ColorsMap[18] = RGBAPixel(0, 255, 127);
-    ColorsMap[19] = RGBAPixel(245, 222, 179);
-    ColorsMap[20] = RGBAPixel(255, 165, 5);
-    ColorsMap[21] = RGBAPixel(255, 165, 0);
-    ColorsMap[22] = RGBAPixel(255, 69, 0);
-    ColorsMap[23] = RGBAPixel(205, 91, 69);
-    ColorsMap[24] = RGBAPixel(255, 192, 203);
-    ColorsMap[25] = RGBAPixel(152, 251, 152);
-    ColorsMap[26] = RGBAPixel(100, 149, 237);
-    ColorsMap[27] = RGBAPixel(160, 32, 240);
-    ColorsMap[28] = RGBAPixel(238, 130, 238);
-    ColorsMap[29] = RGBAPixel(238, 201, 0);
-    ColorsMap[30] = RGBAPixel(218, 112, 214);
-    ColorsMap[31] = RGBAPixel(255, 62, 150);
-    ColorsMap[32] = RGBAPixel(0, 0, 255);
-    ColorsMap[33] = RGBAPixel(39, 64, 139);
-    ColorsMap[34] = RGBAPixel(250, 128, 114);
-    ColorsMap[35] = RGBAPixel(255, 110, 180);
-    ColorsMap[36] = RGBAPixel(255, 99, 71);
-    ColorsMap[37] = RGBAPixel(255, 255, 0);
-    ColorsMap[38] = RGBAPixel(0, 100, 0);
-    ColorsMap[39] = RGBAPixel(205, 92, 92);
-    ColorsMap[40] = RGBAPixel(165, 42, 42);
-    ColorsMap[41] = RGBAPixel(153, 50, 204);
-    ColorsMap[42] = RGBAPixel(0, 255, 255);
-    ColorsMap[43] = RGBAPixel(221, 160, 221);
-    ColorsMap[44] = RGBAPixel(135, 206, 235);
-    ColorsMap[45] = RGBAPixel(152, 200, 214);
-    ColorsMap[46] = RGBAPixel(153, 29, 242);
-    ColorsMap[47] = RGBAPixel(210, 180, 140);
-    ColorsMap[48] = RGBAPixel(255, 215, 0);
-    ColorsMap[49] = RGBAPixel(0, 0, 128);
-    ColorsMap[50] = RGBAPixel(46, 139, 87);
-    ColorsMap[51] = RGBAPixel(102, 205, 170);
-    ColorsMap[52] = RGBAPixel(0, 255, 0);
-    ColorsMap[53] = RGBAPixel(0, 0, 0);
-    ColorsMap[54] = RGBAPixel(220, 216, 20);
-    ColorsMap[55] = RGBAPixel(60, 58, 210);
-    ColorsMap[56] = RGBAPixel(100, 50, 100);
-    ColorsMap[57] = RGBAPixel(135, 50, 74);
-    ColorsMap[58] = RGBAPixel(122, 135, 50);
-    ColorsMap[59] = RGBAPixel(51, 50, 135);
-    ColorsMap[60] = RGBAPixel(74, 155, 60);
-    ColorsMap[61] = RGBAPixel(0, 238, 0);
-    ColorsMap[62] = RGBAPixel(160, 82, 45);
-    ColorsMap[63] = RGBAPixel(255, 218, 185);
-    ColorsMap[64] = RGBAPixel(0, 206, 209);
-    ColorsMap[65] = RGBAPixel(127, 255, 212);
-    ColorsMap[66] = RGBAPixel(178, 34, 34);
-    ColorsMap[67] = RGBAPixel(238, 0, 0);
-    ColorsMap[68] = RGBAPixel(34, 139, 34);
-    ColorsMap[69] = RGBAPixel(208, 32, 144);
-    ColorsMap[70] = RGBAPixel(173, 255, 47);
-    ColorsMap[71] = RGBAPixel(240, 230, 140);
-    ColorsMap[72] = RGBAPixel(173, 216, 230);
-    ColorsMap[73] = RGBAPixel(238, 238, 0);
-    ColorsMap[74] = RGBAPixel(50, 205, 50);
-    ColorsMap[75] = RGBAPixel(255, 0, 255);
-    ColorsMap[76] = RGBAPixel(176, 48, 96);
-    ColorsMap[77] = RGBAPixel(0, 255, 127);
-    ColorsMap[78] = RGBAPixel(245, 222, 179);
-    ColorsMap[79] = RGBAPixel(255, 165, 5);
-    ColorsMap[80] = RGBAPixel(255, 165, 0);
-    ColorsMap[81] = RGBAPixel(255, 69, 0);
-    ColorsMap[82] = RGBAPixel(205, 91, 69);
-    ColorsMap[83] = RGBAPixel(255, 192, 203);
-    ColorsMap[84] = RGBAPixel(152, 251, 152);
-    ColorsMap[85] = RGBAPixel(100, 149, 237);
-    ColorsMap[86] = RGBAPixel(160, 32, 240);
-    ColorsMap[87] = RGBAPixel(238, 130, 238);
-    ColorsMap[88] = RGBAPixel(238, 201, 0);
-    ColorsMap[89] = RGBAPixel(218, 112, 214);
-    ColorsMap[90] = RGBAPixel(255, 62, 150);
-    ColorsMap[91] = RGBAPixel(0, 0, 255);
-    ColorsMap[92] = RGBAPixel(39, 64, 139);
-    ColorsMap[93] = RGBAPixel(250, 128, 114);
-    ColorsMap[94] = RGBAPixel(255, 110, 180);
-    ColorsMap[95] = RGBAPixel(255, 99, 71);
-    ColorsMap[96] = RGBAPixel(255, 255, 0);
-    ColorsMap[97] = RGBAPixel(0, 100, 0);
-    ColorsMap[98] = RGBAPixel(205, 92, 92);
-    ColorsMap[99] = RGBAPixel(165, 42, 42);
-    ColorsMap[100] = RGBAPixel(153, 50, 204);
-    ColorsMap[101] = RGBAPixel(0, 255, 255);
-    ColorsMap[102] = RGBAPixel(221, 160, 221);
-    ColorsMap[103] = RGBAPixel(135, 206, 235);
-    ColorsMap[104] = RGBAPixel(152, 200, 214);
-    ColorsMap[105] = RGBAPixel(153, 29, 242);
-    ColorsMap[106] = RGBAPixel(210, 180, 140);
-    ColorsMap[107] = RGBAPixel(255, 215, 0);
-    ColorsMap[108] = RGBAPixel(0, 0, 128);
-    ColorsMap[109] = RGBAPixel(46, 139, 87);
-    ColorsMap[110] = RGBAPixel(102, 205, 170);
-    ColorsMap[111] = RGBAPixel(0, 255, 0);
-    ColorsMap[112] = RGBAPixel(0, 0, 0);
-    ColorsMap[113] = RGBAPixel(220, 216, 20);
-    ColorsMap[114] = RGBAPixel(60, 58, 210);
-    ColorsMap[115] = RGBAPixel(100, 50, 100);
-    ColorsMap[116] = RGBAPixel(135, 50, 74);
-    ColorsMap[117] = RGBAPixel(122, 135, 50);
-    ColorsMap[118] = RGBAPixel(51, 50, 135);
-    ColorsMap[119] = RGBAPixel(74, 155, 60);
-    ColorsMap[120] = RGBAPixel(1, 1, 1);
-  }
+  // Largest label the converter accepts.
+  static constexpr size_t MAX_LABEL = 65535;
+
+  SegmentationColorsConverter();
+
+  // Color of label, throws std::out_of_range if label > MAX_LABEL.
+  const RGBAPixel& GetColor(size_t label);
 
+  // Make the table cover all labels up to maxLabel.
+  void Reserve(size_t maxLabel);
+
+  // Opacity of labels drawn over images: 1 draws pure label colors (default),
+  // 0 leaves images as they are. Throws std::invalid_argument outside [0, 1].
+  void SetOpacity(double opacity);
+  double GetOpacity() const { return Opacity; }
+
+  // Throws std::out_of_range for negative labels and labels above MAX_LABEL.
   template <class SegmentationPixelType>
-  Image<RGBAPixel> ConvertToRGB(const Image<SegmentationPixelType> &image) {
-    Image<RGBAPixel> result(image.getHeight(), image.getWidth());
-    for (size_t i = 0; i < image.getSize(); ++i) {
-      result[i] = ColorsMap.at(image[i]);
-    }
+  Image<RGBAPixel> ConvertToRGB(const Image<SegmentationPixelType> &seg,
+                                size_t threadCount =
+                                  util::HardwareConcurrency()) {
+    PrepareColors(seg, threadCount);
+
+    const RGBAPixel *colors = Colors.data();
+    Image<RGBAPixel> result(seg.getHeight(), seg.getWidth());
+    util::ParallelFor(0, seg.getHeight(), [&](size_t i) {
+      auto segRow = seg.row(i);
+      auto resultRow = result.row(i);
+      for (size_t j = 0; j < segRow.size(); ++j)
+        resultRow[j] = colors[static_cast<size_t>(segRow[j])];
+    }, threadCount);
     return result;
   }
 
+  // Labels drawn over image: whole structures or, in contoured mode, pixels
+  // which have a differently labeled neighbor. Background (label 0) is never
+  // drawn.
+  //
+  // Throws std::invalid_argument if sizes differ and std::out_of_range for
+  // labels ConvertToRGB(seg) doesn't accept.
   template <class ImagePixelType, class SegmentationPixelType>
   Image<RGBAPixel> ConvertToRGB(const Image<ImagePixelType> &image,
                                 const Image<SegmentationPixelType> &seg,
-                                bool contoured = true) {
+                                bool contoured = true,
+                                size_t threadCount =
+                                  util::HardwareConcurrency()) {
     if (image.getWidth() != seg.getWidth() ||
         image.getHeight() != seg.getHeight())
       throw std::invalid_argument("Image and segmentation size mismatch!");
 
-    Image<RGBAPixel> result(image.getHeight(), image.getWidth());
-    for (size_t i = 1; i + 1 < image.getHeight(); ++i) {
-      for (size_t j = 1; j + 1 < image.getWidth(); ++j) {
-        if (!seg(i, j)) {
-          // No label here, just draw image pixel.
-          result(i, j) = RGBAPixel(image(i, j));
-        } else {
-          // Segmentation label here.
-          if (!contoured) {
-            // Not contoured mode, just draw label.
-            result(i, j) = ColorsMap.at(seg(i, j));
-          } else {
-            auto currentLabel = seg(i, j);
-            bool insideStructure =
-              seg(i-1, j) == currentLabel &&
-              seg(i+1, j) == currentLabel &&
-              seg(i, j-1) == currentLabel &&
-              seg(i, j+1) == currentLabel;
-
-            result(i, j) = insideStructure ? RGBAPixel(image(i, j))
-                                            : ColorsMap.at(seg(i, j));
-          }
+    PrepareColors(seg, threadCount);
+
+    const RGBAPixel *colors = Colors.data();
+    const unsigned weight = OpacityWeight();
+    const size_t height = seg.getHeight();
+    const size_t width = seg.getWidth();
+
+    Image<RGBAPixel> result(height, width);
+    util::ParallelFor(0, height, [&](size_t i) {
+      const SegmentationPixelType *cur = seg.row(i).data();
+      const SegmentationPixelType *up = i > 0 ? seg.row(i - 1).data() : nullptr;
+      const SegmentationPixelType *down =
+        i + 1 < height ? seg.row(i + 1).data() : nullptr;
+
+      std::vector<uint8_t> drawn(width);
+      if (contoured) {
+        detail::FindContourRow(up, cur, down, width, drawn.data());
+      } else {
+        for (size_t j = 0; j < width; ++j)
+          drawn[j] = cur[j] != SegmentationPixelType();
+      }
+
+      auto imageRow = image.row(i);
+      auto resultRow = result.row(i);
+      for (size_t j = 0; j < width; ++j) {
+        RGBAPixel base(static_cast<RGBAPixel::PixelType>(imageRow[j]));
+        if (drawn[j]) {
+          const RGBAPixel &color = colors[static_cast<size_t>(cur[j])];
+          base.r = detail::BlendChannel(base.r, color.r, weight);
+          base.g = detail::BlendChannel(base.g, color.g, weight);
+          base.b = detail::BlendChannel(base.b, color.b, weight);
         }
-      } // for (j)
-    } // for (i)
+        resultRow[j] = base;
+      }
+    }, threadCount);
     return result;
   }
 
 private:
-  std::map<int, RGBAPixel> ColorsMap;
+  // Check labels of seg and make the table cover them.
+  template <class SegmentationPixelType>
+  void PrepareColors(const Image<SegmentationPixelType> &seg,
+                     size_t threadCount);
+
+  // Opacity as a weight in [0, 256].
+  unsigned OpacityWeight() const;
+
+private:
+  std::vector<RGBAPixel> Colors; // Color by label.
+  double Opacity = 1.0;
 };
 
+
+template <class SegmentationPixelType>
+void SegmentationColorsConverter::PrepareColors(
+  const Image<SegmentationPixelType> &seg, size_t threadCount) {
+  if (seg.isEmpty())
+    return;
+
+  // Extremes of each row, then of the image.
+  std::vector<SegmentationPixelType> rowMin(seg.getHeight());
+  std::vector<SegmentationPixelType> rowMax(seg.getHeight());
+  util::ParallelFor(0, seg.getHeight(), [&](size_t i) {
+    auto segRow = seg.row(i);
+    auto extremes = std::minmax_element(segRow.begin(), segRow.end());
+    rowMin[i] = *extremes.first;
+    rowMax[i] = *extremes.second;
+  }, threadCount);
+
+  auto minLabel = *std::min_element(rowMin.begin(), rowMin.end());
+  auto maxLabel = *std::max_element(rowMax.begin(), rowMax.end());
+  if (detail::IsNegativeLabel(minLabel))
+    throw std::out_of_range("Segmentation has negative labels!");
+
+  Reserve(static_cast<size_t>(maxLabel));
+}
+
 } // namespace ImageIO
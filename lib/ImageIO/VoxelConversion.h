@@ -0,0 +1,228 @@
+#pragma once
+
+#include "ByteOrder.h"
+#include "Luminance.h"
+#include "RGBAPixel.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+
+namespace ImageIO {
+
+// Voxel data type codes of Analyze 7.5 headers. NIfTI-1 uses the same codes
+// and extends the set with the unsigned/64-bit ones.
+constexpr int16_t DT_BINARY         = 1;
+constexpr int16_t DT_UNSIGNED_CHAR  = 2;
+constexpr int16_t DT_SIGNED_SHORT   = 4;
+constexpr int16_t DT_SIGNED_INT     = 8;
+constexpr int16_t DT_FLOAT          = 16;
+constexpr int16_t DT_COMPLEX        = 32;
+constexpr int16_t DT_DOUBLE         = 64;
+constexpr int16_t DT_RGB            = 128;
+constexpr int16_t DT_INT8           = 256;
+constexpr int16_t DT_UINT16         = 512;
+constexpr int16_t DT_UINT32         = 768;
+constexpr int16_t DT_INT64          = 1024;
+constexpr int16_t DT_UINT64         = 1280;
+
+
+// Data type code of a pixel type which is stored in files as is,
+// 0 if there's no such code. Codes are integral_constants, so their value
+// members are defined and can be bound to references.
+template <int16_t Code>
+using DataTypeCode = std::integral_constant<int16_t, Code>;
+
+template <class T> struct NativeDataType : DataTypeCode<0> {};
+template <> struct NativeDataType<uint8_t>  : DataTypeCode<DT_UNSIGNED_CHAR> {};
+template <> struct NativeDataType<int8_t>   : DataTypeCode<DT_INT8> {};
+template <> struct NativeDataType<int16_t>  : DataTypeCode<DT_SIGNED_SHORT> {};
+template <> struct NativeDataType<uint16_t> : DataTypeCode<DT_UINT16> {};
+template <> struct NativeDataType<int32_t>  : DataTypeCode<DT_SIGNED_INT> {};
+template <> struct NativeDataType<uint32_t> : DataTypeCode<DT_UINT32> {};
+template <> struct NativeDataType<int64_t>  : DataTypeCode<DT_INT64> {};
+template <> struct NativeDataType<uint64_t> : DataTypeCode<DT_UINT64> {};
+template <> struct NativeDataType<float>    : DataTypeCode<DT_FLOAT> {};
+template <> struct NativeDataType<double>   : DataTypeCode<DT_DOUBLE> {};
+
+
+// Size of one voxel in bytes. DT_BINARY voxels are packed 8 per byte, 0 is
+// returned for them.
+//
+// Throws std::runtime_error for unsupported data types.
+inline size_t BytesPerVoxel(int16_t dataType) {
+  switch (dataType) {
+  case DT_BINARY:        return 0;
+  case DT_UNSIGNED_CHAR: return 1;
+  case DT_INT8:          return 1;
+  case DT_SIGNED_SHORT:  return 2;
+  case DT_UINT16:        return 2;
+  case DT_SIGNED_INT:    return 4;
+  case DT_UINT32:        return 4;
+  case DT_FLOAT:         return 4;
+  case DT_RGB:           return 3;
+  case DT_COMPLEX:       return 8;
+  case DT_DOUBLE:        return 8;
+  case DT_INT64:         return 8;
+  case DT_UINT64:        return 8;
+  default:
+    throw std::runtime_error("Unsupported voxel data type " +
+                             std::to_string(dataType));
+  }
+}
+
+
+// Size in bytes of a block of voxelCount voxels of the given type.
+inline size_t VoxelBlockSize(int16_t dataType, size_t voxelCount) {
+  if (dataType == DT_BINARY)
+    return (voxelCount + 7) / 8;
+  return BytesPerVoxel(dataType) * voxelCount;
+}
+
+
+// Conversion of a single stored value to pixel type T.
+template <class T>
+struct VoxelCast {
+  template <class S>
+  static T FromScalar(S value) { return static_cast<T>(value); }
+
+  static T FromRGB(uint8_t r, uint8_t g, uint8_t b) {
+    return static_cast<T>(Luminance(r, g, b));
+  }
+};
+
+
+template <>
+struct VoxelCast<RGBAPixel> {
+  template <class S>
+  static RGBAPixel FromScalar(S value) {
+    return RGBAPixel(static_cast<RGBAPixel::PixelType>(value));
+  }
+
+  static RGBAPixel FromRGB(uint8_t r, uint8_t g, uint8_t b) {
+    return RGBAPixel(r, g, b);
+  }
+};
+
+
+namespace detail {
+
+// Branches on byte order once per block, so both loops are plain
+// load-convert-store loops the compiler can vectorize.
+template <class S, class T>
+void ConvertScalarVoxels(const unsigned char *src, size_t count, bool swap,
+                         T *dst) {
+  if (swap) {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = VoxelCast<T>::FromScalar(
+        ByteSwap(LoadUnaligned<S>(src + i * sizeof(S))));
+  } else {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = VoxelCast<T>::FromScalar(LoadUnaligned<S>(src + i * sizeof(S)));
+  }
+}
+
+
+// Complex voxels are pairs of floats, only real part is kept.
+template <class T>
+void ConvertComplexVoxels(const unsigned char *src, size_t count, bool swap,
+                          T *dst) {
+  for (size_t i = 0; i < count; ++i) {
+    float re = LoadUnaligned<float>(src + 2 * i * sizeof(float));
+    dst[i] = VoxelCast<T>::FromScalar(swap ? ByteSwap(re) : re);
+  }
+}
+
+
+template <class T>
+void ConvertRGBVoxels(const unsigned char *src, size_t count, T *dst) {
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = VoxelCast<T>::FromRGB(src[3 * i], src[3 * i + 1], src[3 * i + 2]);
+}
+
+
+// Bits are packed starting from the most significant one.
+template <class T>
+void ConvertBinaryVoxels(const unsigned char *src, size_t count, T *dst) {
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = VoxelCast<T>::FromScalar((src[i / 8] >> (7 - i % 8)) & 1);
+}
+
+} // namespace detail
+
+
+// Converts count voxels of the given data type from raw file bytes to pixels.
+// If swap is true, the data has byte order different from the host one.
+//
+// Throws std::runtime_error for unsupported data types.
+template <class T>
+void ConvertVoxels(const unsigned char *src, size_t count, int16_t dataType,
+                   bool swap, T *dst) {
+  switch (dataType) {
+  case DT_BINARY:
+    return detail::ConvertBinaryVoxels(src, count, dst);
+  case DT_UNSIGNED_CHAR:
+    return detail::ConvertScalarVoxels<uint8_t>(src, count, swap, dst);
+  case DT_INT8:
+    return detail::ConvertScalarVoxels<int8_t>(src, count, swap, dst);
+  case DT_SIGNED_SHORT:
+    return detail::ConvertScalarVoxels<int16_t>(src, count, swap, dst);
+  case DT_UINT16:
+    return detail::ConvertScalarVoxels<uint16_t>(src, count, swap, dst);
+  case DT_SIGNED_INT:
+    return detail::ConvertScalarVoxels<int32_t>(src, count, swap, dst);
+  case DT_UINT32:
+    return detail::ConvertScalarVoxels<uint32_t>(src, count, swap, dst);
+  case DT_INT64:
+    return detail::ConvertScalarVoxels<int64_t>(src, count, swap, dst);
+  case DT_UINT64:
+    return detail::ConvertScalarVoxels<uint64_t>(src, count, swap, dst);
+  case DT_FLOAT:
+    return detail::ConvertScalarVoxels<float>(src, count, swap, dst);
+  case DT_DOUBLE:
+    return detail::ConvertScalarVoxels<double>(src, count, swap, dst);
+  case DT_COMPLEX:
+    return detail::ConvertComplexVoxels(src, count, swap, dst);
+  case DT_RGB:
+    return detail::ConvertRGBVoxels(src, count, dst);
+  default:
+    throw std::runtime_error("Unsupported voxel data type " +
+                             std::to_string(dataType));
+  }
+}
+
+
+// Data type code pixels of type T are written with, 0 if they can't be.
+template <class T> struct StoredDataType : NativeDataType<T> {};
+template <> struct StoredDataType<RGBAPixel> : DataTypeCode<DT_RGB> {};
+
+
+// Converts count pixels to raw file bytes of StoredDataType<T>.
+template <class T>
+void StoreVoxels(const T *src, size_t count, unsigned char *dst) {
+  std::memcpy(dst, src, count * sizeof(T));
+}
+
+template <>
+inline void StoreVoxels<RGBAPixel>(const RGBAPixel *src, size_t count,
+                                   unsigned char *dst) {
+  for (size_t i = 0; i < count; ++i) {
+    dst[3 * i + 0] = src[i].r;
+    dst[3 * i + 1] = src[i].g;
+    dst[3 * i + 2] = src[i].b;
+  }
+}
+
+
+// Swaps byte order of pixels already stored in the image buffer.
+template <class T>
+void SwapVoxels(T *data, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    ByteSwapInPlace(data[i]);
+}
+
+} // namespace ImageIO
@@ -0,0 +1,142 @@
+/**
+ * @file lib/LabelTable.h
+ *
+ * @brief Header file with definition of LabelTable class.
+ */
+
+
+#pragma once
+
+#include "Image.h"
+
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Dense numbering of segmentation labels.
+ *
+ * Labels get indices 0, 1, 2, ... in order of appearance, so segmentations
+ * with few labels can be stored as images of narrow integers and label
+ * statistics can be kept in plain arrays.
+ *
+ * @tparam S Type of labels.
+ */
+template <class S>
+class LabelTable {
+public:
+  LabelTable() = default;
+
+  /// @returns Index of @p label, a new index is given to an unknown label.
+  size_t Insert(const S &label);
+
+  /// @brief Give indices to all labels of @p seg.
+  void Insert(const Image<S> &seg);
+
+  /**
+   * @returns Index of @p label.
+   *
+   * @throws std::out_of_range if the label is not in the table.
+   */
+  size_t IndexOf(const S &label) const { return indices.at(label); }
+
+  /// @returns Label with the given index.
+  const S & operator[](size_t index) const {
+    assert(index < labels.size() && "Label index is out of range!");
+    return labels[index];
+  }
+
+  size_t GetSize() const { return labels.size(); }
+  bool   IsEmpty() const { return labels.empty(); }
+
+  void Clear() {
+    labels.clear();
+    indices.clear();
+  }
+
+  /**
+   * @brief Replace labels of @p seg with their indices.
+   *
+   * All labels must be in the table and their indices must fit into L.
+   * @p result gets the size of @p seg and contiguous layout.
+   *
+   * @throws std::out_of_range if a label is not in the table.
+   */
+  template <class L>
+  void Encode(const Image<S> &seg, Image<L> &result) const;
+
+  /// @brief Replace indices with labels, inverse of Encode.
+  template <class L>
+  void Decode(const Image<L> &encoded, Image<S> &result) const;
+
+private:
+  std::vector<S> labels;       ///< Label by index.
+  std::map<S, size_t> indices; ///< Index by label.
+};
+
+
+// ===== Implementation below =====
+
+template <class S>
+size_t LabelTable<S>::Insert(const S &label)
+{
+  auto it = indices.find(label);
+  if (it != indices.end())
+    return it->second;
+
+  indices.emplace(label, labels.size());
+  labels.push_back(label);
+  return labels.size() - 1;
+}
+
+
+template <class S>
+void LabelTable<S>::Insert(const Image<S> &seg)
+{
+  for (size_t i = 0; i < seg.getHeight(); ++i) {
+    auto segRow = seg.row(i);
+    for (size_t j = 0; j < segRow.size(); ++j)
+      // Labels come in runs, skip repeated lookups.
+      if (j == 0 || segRow[j] != segRow[j - 1])
+        Insert(segRow[j]);
+  }
+}
+
+
+template <class S>
+template <class L>
+void LabelTable<S>::Encode(const Image<S> &seg, Image<L> &result) const
+{
+  assert(labels.size() <= size_t(1) << (8 * sizeof(L)) &&
+         "Label indices don't fit into the index type!");
+
+  result = Image<L>(seg.getHeight(), seg.getWidth());
+
+  for (size_t i = 0; i < seg.getHeight(); ++i) {
+    auto segRow = seg.row(i);
+    auto resultRow = result.row(i);
+    L index = 0;
+    for (size_t j = 0; j < segRow.size(); ++j) {
+      if (j == 0 || segRow[j] != segRow[j - 1])
+        index = static_cast<L>(IndexOf(segRow[j]));
+      resultRow[j] = index;
+    }
+  }
+}
+
+
+template <class S>
+template <class L>
+void LabelTable<S>::Decode(const Image<L> &encoded, Image<S> &result) const
+{
+  result = Image<S>(encoded.getHeight(), encoded.getWidth());
+
+  for (size_t i = 0; i < encoded.getHeight(); ++i) {
+    auto encodedRow = encoded.row(i);
+    auto resultRow = result.row(i);
+    for (size_t j = 0; j < encodedRow.size(); ++j)
+      resultRow[j] = (*this)[encodedRow[j]];
+  }
+}
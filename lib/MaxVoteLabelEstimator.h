@@ -1,31 +1,54 @@
 #pragma once
 
 #include "MultipointLabelEstimator.h"
-#include <unordered_map>
-#include <algorithm>
+#include <cstddef>
+#include <vector>
 
 
+// Labels are indices from 0, as in LabelTable. They index the vote array
+// directly, so negative labels are not allowed. Each thread needs its own
+// copy of the estimator.
 template <class LabelType>
-class MaxVoteLabelEstimator : public MultipointLabelEstimator<LabelType> {
+class MaxVoteLabelEstimator
+  : public MultipointLabelEstimator<MaxVoteLabelEstimator<LabelType>, LabelType>
+{
 public:
 
-  using SuperClass = MultipointLabelEstimator<LabelType>;
+  using SuperClass =
+    MultipointLabelEstimator<MaxVoteLabelEstimator<LabelType>, LabelType>;
   using CandidateContainer = typename SuperClass::CandidateContainer;
   using WeightType = typename SuperClass::WeightType;
 
-  virtual LabelType
-  EstimateLabel(const CandidateContainer &candidates) const override final {
-    std::unordered_map<LabelType, WeightType> sumWeightMap;
+  // Votes are preallocated for labelCount labels, others are added on first
+  // use.
+  explicit MaxVoteLabelEstimator(size_t labelCount = 0)
+    : votes(labelCount, WeightType())
+  {}
+
+  // Ties go to the lowest label.
+  LabelType Estimate(const CandidateContainer &candidates) {
+    for (const auto &p : candidates) {
+      auto index = static_cast<size_t>(p.first);
+      if (index >= votes.size())
+        votes.resize(index + 1, WeightType());
+      votes[index] += p.second;
+    }
+
+    LabelType best = candidates.front().first;
     for (const auto &p : candidates) {
-      sumWeightMap[p.first] += p.second;
+      auto weight = votes[p.first];
+      auto bestWeight = votes[best];
+      if (bestWeight < weight || (!(weight < bestWeight) && p.first < best))
+        best = p.first;
     }
 
-    auto maxIt =
-      std::max_element(sumWeightMap.begin(), sumWeightMap.end(),
-                       [](const std::pair<LabelType, WeightType> &f,
-                          const std::pair<LabelType, WeightType> &s) -> bool {
-                            return f.second < s.second;
-                       });
-    return maxIt->first;
+    // Only entries of the candidates were touched.
+    for (const auto &p : candidates)
+      votes[p.first] = WeightType();
+
+    return best;
   }
+
+private:
+  std::vector<WeightType> votes;
 };
@@ -4,7 +4,15 @@
 #include <utility>
 
 
-template <class LabelType>
+// Base of label estimators, Derived implements
+//
+//   LabelType Estimate(const CandidateContainer &candidates);
+//
+// which may update scratch data of the estimator.
+//
+// Estimators are used as template arguments of label fusion loops, so calls
+// are resolved at compile time and inlined into the loops.
+template <class Derived, class LabelType>
 class MultipointLabelEstimator {
 public:
   using WeightType = double;
@@ -18,6 +26,12 @@ public:
   //
   // For example, each pixel contributes to NxN patches in PM algorithm
   // where N is patch side. Each of NxN patches votes for its own label.
-  virtual LabelType
-  EstimateLabel(const CandidateContainer &candidates) const = 0;
+  //
+  // Estimators may keep scratch data, so the call is not const.
+  LabelType EstimateLabel(const CandidateContainer &candidates) {
+    return static_cast<Derived &>(*this).Estimate(candidates);
+  }
+
+protected:
+  ~MultipointLabelEstimator() = default;
 };
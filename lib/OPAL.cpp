@@ -1,6 +1,11 @@
 #include "OPAL.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
+#include <sstream>
 #include "../tools/FloFileIO.h"
+#include "util/random/CounterRandom.h"
 
 static std::string
 FullFileName(const std::string &path, const std::string &name) {
@@ -13,6 +18,11 @@ FullFileName(const std::string &path, const std::string &name) {
 }
 
 
+/// Cost of candidates which must never be taken. Stays infinite when shifted.
+static const OPAL::SSDType::ValueType INVALID_COST =
+  std::numeric_limits<OPAL::SSDType::ValueType>::infinity();
+
+
 OPAL::OPAL(const OPALSettings &settings, const DatabaseType &database)
   : Sets(settings)
   , Database(database)
@@ -23,6 +33,22 @@ OPAL::OPAL(const OPALSettings &settings, const DatabaseType &database)
   // We need more images to proceed.
   if (Database.GetImageCount() == 1)
     throw std::logic_error("Image database contains only 1 pair!");
+  // Patches around border pixels and their shifts read ghost pixels.
+  if (Database.GetBorder() < GetRequiredBorder(Sets))
+    throw std::logic_error("Images in database are not padded enough!");
+  // Candidates leaving the image are rejected by the fence only.
+  if (Database.GetBorder() != GetRequiredBorder(Sets) ||
+      !Database.HasFence() || Database.GetFence() < INVALID_COST)
+    throw std::logic_error("Images in database are not fenced for OPAL!");
+  // Checks that matches can be packed.
+  if (Sets.propagationMode == PropagationMode::Async)
+    PackedMatchCodec(Database.GetImageCount(), Database.GetImageHeight(),
+                     Database.GetImageWidth());
+
+  // Every template can be matched, so all of them are used by the run.
+  DatabasePins.reserve(Database.GetImageCount());
+  for (size_t i = 0; i < Database.GetImageCount(); ++i)
+    DatabasePins.emplace_back(Database, i);
 
   ImageHeight = Database.GetImageHeight();
   ImageWidth = Database.GetImageWidth();
@@ -31,59 +57,83 @@ OPAL::OPAL(const OPALSettings &settings, const DatabaseType &database)
   OutputSegmentation.Resize(ImageHeight, ImageWidth);
 
   // Allocate memory, but don't fill.
+  // Fields are padded for candidate labels of border pixels, SSD map is
+  // padded by 1 for neighbors of border pixels during propagation. Ghost
+  // matches are valid, but their infinite SSDs never let them win.
+  const size_t fieldBorder = std::max<size_t>(1, Sets.patchRadius);
+  FieldX.SetBorder(fieldBorder);
+  FieldY.SetBorder(fieldBorder);
+  FieldT.SetBorder(fieldBorder);
+  SSDMap.SetBorder(1);
   FieldX.Resize(ImageHeight, ImageWidth);
   FieldY.Resize(ImageHeight, ImageWidth);
   FieldT.Resize(ImageHeight, ImageWidth);
   SSDMap.Resize(ImageHeight, ImageWidth);
+  FieldT.UpdateBorder(BorderMode::Constant, 1);
+
+  SelectKernels(Sets.patchRadius);
+
+  ComputeRoi();
+}
+
 
-  // Initialize random generator.
-  std::random_device rd;
-  randGen.seed(0);
+void OPAL::PrepareDatabase(DatabaseType &database,
+                           const OPALSettings &settings) {
+  database.SetBorder(GetRequiredBorder(settings));
+  database.SetFence(INVALID_COST);
 }
 
 
 void OPAL::ConstrainedInitialization() {
-  int distLowerBound = (-1) * static_cast<int>(Sets.initWindowRadius);
-  int distUpperBound = static_cast<int>(Sets.initWindowRadius);
-  std::uniform_int_distribution<int> distT(1, Database.GetImageCount()-1);
-  std::uniform_int_distribution<int> distX(distLowerBound, distUpperBound);
+  if (Sets.initMode == InitMode::Exact) {
+    ExhaustiveSearch<DatabaseType> search(Database, Sets.patchRadius,
+                                          Sets.initWindowRadius);
+    search.RunSummedAreas();
+
+    // Copy pixels, keeping padded layout of the fields.
+    util::ParallelFor(0, ImageHeight, [&](size_t i) {
+      for (size_t j = 0; j < ImageWidth; ++j) {
+        FieldX(i, j) = search.getFieldX()(i, j);
+        FieldY(i, j) = search.getFieldY()(i, j);
+        FieldT(i, j) = search.getFieldT()(i, j);
+      }
+    });
+
+    UpdateSSDMap();
+    SaveCurrentFields("0_Initialization.flo");
+    return;
+  }
+
+  const int windowRadius = static_cast<int>(Sets.initWindowRadius);
+  const int lastImage = static_cast<int>(Database.GetImageCount()) - 1;
 
   // (i, j) is mapped to (i+offsetY, j+offsetX) at Database[t].
-  // Make sure we'll be able to consider a patch around destination loc.
-  int xLowerConstraint = Sets.patchRadius + 1;
-  int yLowerConstraint = Sets.patchRadius + 1;
-  int yUpperConstraint = ImageHeight - Sets.patchRadius - 2;
-  int xUpperConstraint = ImageWidth - Sets.patchRadius - 2;
-
-  // Fill FieldX, FieldY, FieldT.
-  for (int i = 0; i < static_cast<int>(ImageHeight); ++i) {
+  // Offsets are drawn from the part of the window inside the image, patch
+  // around the destination may cover ghost pixels.
+  const int height = static_cast<int>(ImageHeight);
+  const int width = static_cast<int>(ImageWidth);
+
+  // Fill FieldX, FieldY, FieldT. Pixels draw from their own streams, so
+  // rows can be shared between threads.
+  util::ParallelFor(0, ImageHeight, [&](size_t row) {
+    const int i = static_cast<int>(row);
     for (int j = 0; j < static_cast<int>(ImageWidth); ++j) {
+      util::CounterRandom random(Sets.randomSeed, i * ImageWidth + j);
 
       // Index of image in Database.
-      size_t t = distT(randGen);
+      size_t t = random.UniformInt(1, lastImage);
       // x and y coordinates.
-      int offsetX = distX(randGen);
-      int offsetY = distX(randGen); // can use distX for y (same bounds).
-
-      // y coordinate
-      if (i + offsetY < yLowerConstraint)
-        offsetY = yLowerConstraint - i; // (i, j) -> (patchRadius, ...)
-      if (i + offsetY > yUpperConstraint)
-        offsetY = yUpperConstraint - i;
-
-      // x coordinate
-      if (j + offsetX < xLowerConstraint)
-        offsetX = xLowerConstraint - j;
-      if (j + offsetX > xUpperConstraint)
-        offsetX = xUpperConstraint - j;
+      int offsetX = random.UniformInt(std::max(-windowRadius, -j),
+                                      std::min(windowRadius, width - 1 - j));
+      int offsetY = random.UniformInt(std::max(-windowRadius, -i),
+                                      std::min(windowRadius, height - 1 - i));
 
       // Initialize the fields.
       FieldT(i, j) = t;
       FieldX(i, j) = offsetX;
       FieldY(i, j) = offsetY;
-
     } // for (j)
-  } // for (i)
+  });
 
   UpdateSSDMap();
 
@@ -92,42 +142,211 @@ void OPAL::ConstrainedInitialization() {
 }
 
 
+template <size_t R>
+void OPAL::SelectKernels() {
+  EvenPass   = &OPAL::PropagateEven<R>;
+  OddPass    = &OPAL::PropagateOdd<R>;
+  UpdateRow  = &OPAL::UpdateSSDRow<R>;
+  AsyncSweep = &OPAL::SweepStrip<R>;
+}
+
+
+void OPAL::SelectKernels(size_t patchRadius) {
+  switch (patchRadius) {
+  case 1: return SelectKernels<1>();
+  case 2: return SelectKernels<2>();
+  case 3: return SelectKernels<3>();
+  case 4: return SelectKernels<4>();
+  case 5: return SelectKernels<5>();
+  default:
+    return SelectKernels<SSDType::DYNAMIC_RADIUS>();
+  }
+}
+
+
 void OPAL::EvenPropagation(size_t iteration)
 {
-  size_t propagatedPixels = 0;
+  (this->*EvenPass)();
 
-  size_t xStart = Sets.patchRadius + 1;
-  size_t xEnd   = ImageWidth - Sets.patchRadius - 2;
-  size_t yStart = Sets.patchRadius + 1;
-  size_t yEnd   = ImageHeight - Sets.patchRadius - 2;
+  SaveCurrentFields("Iteration_" + std::to_string(iteration));
+}
 
-  for (size_t y = yStart; y < yEnd; ++y)
-    for (size_t x = xStart; x < xEnd; ++x) {
-      propagatedPixels += PropagateRightDown(x, y);
-    }
+
+void OPAL::OddPropagation(size_t iteration)
+{
+  (this->*OddPass)();
 
   SaveCurrentFields("Iteration_" + std::to_string(iteration));
 }
 
 
-void OPAL::OddPropagation(size_t iteration)
+template <size_t R>
+size_t OPAL::PropagateEven()
 {
   size_t propagatedPixels = 0;
 
-  size_t xStart = ImageWidth - Sets.patchRadius - 2;
-  size_t xEnd   = Sets.patchRadius + 1;
-  size_t yStart = ImageHeight - Sets.patchRadius - 2;
-  size_t yEnd   = Sets.patchRadius + 1;
+  for (size_t y = RoiBox.Top; y < RoiBox.Bottom; ++y)
+    for (size_t x = RoiBox.Left; x < RoiBox.Right; ++x) {
+      if (IsPropagated(RoiMask(y, x)))
+        propagatedPixels += PropagateRightDown<R>(x, y);
+    }
+
+  return propagatedPixels;
+}
+
+
+template <size_t R>
+size_t OPAL::PropagateOdd()
+{
+  size_t propagatedPixels = 0;
 
-  for (size_t y = yStart; y > yEnd; --y)
-    for (size_t x = xStart; x > xEnd; --x) {
-      propagatedPixels += PropagateLeftUp(x, y);
+  for (size_t y = RoiBox.Bottom; y-- > RoiBox.Top; )
+    for (size_t x = RoiBox.Right; x-- > RoiBox.Left; ) {
+      if (IsPropagated(RoiMask(y, x)))
+        propagatedPixels += PropagateLeftUp<R>(x, y);
     }
 
-  SaveCurrentFields("Iteration_" + std::to_string(iteration));
+  return propagatedPixels;
+}
+
+
+bool OPAL::NeedsStateBetweenIterations() const
+{
+  return Sets.intermediateSaving || !Sets.checkpointPath.empty() ||
+         Sets.consensusIteration || Sets.errorReportSamples;
 }
 
 
+void OPAL::AsyncPropagation(size_t first, size_t last)
+{
+  PackedMatchCodec codec(Database.GetImageCount(), ImageHeight, ImageWidth);
+  std::unique_ptr<std::atomic<uint64_t>[]> matches(
+    new std::atomic<uint64_t>[ImageHeight * ImageWidth]);
+
+  // Pixels out of ROI are never taken, as with their SSDs.
+  util::ParallelFor(0, ImageHeight, [&](size_t i) {
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      auto cost = RoiMask(i, j) != OUT_OF_ROI ? SSDMap(i, j).GetValue()
+                                              : INVALID_COST;
+      matches[i * ImageWidth + j].store(
+        codec.Pack(FieldT(i, j), FieldX(i, j), FieldY(i, j), cost),
+        std::memory_order_relaxed);
+    }
+  });
+
+  const size_t threads = Sets.propagationThreads ? Sets.propagationThreads
+                                                 : util::HardwareConcurrency();
+  const size_t rows = RoiBox.Bottom - RoiBox.Top;
+  const size_t strips = std::max<size_t>(1, std::min(threads, rows));
+  util::ParallelFor(0, strips, [&](size_t strip) {
+    (this->*AsyncSweep)(first, last, RoiBox.Top + rows * strip / strips,
+                        RoiBox.Top + rows * (strip + 1) / strips, codec,
+                        matches.get());
+  }, strips);
+
+  // Costs were rounded to float, the SSD map is recalculated exactly.
+  util::ParallelFor(0, ImageHeight, [&](size_t i) {
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      auto match = codec.Unpack(
+        matches[i * ImageWidth + j].load(std::memory_order_relaxed));
+      FieldT(i, j) = match.t;
+      FieldX(i, j) = match.offsetX;
+      FieldY(i, j) = match.offsetY;
+    }
+  });
+  UpdateSSDMap();
+
+  SaveCurrentFields("Iteration_" + std::to_string(last - 1));
+}
+
+
+template <size_t R>
+void OPAL::SweepStrip(size_t first, size_t last, size_t top, size_t bottom,
+                      const PackedMatchCodec &codec,
+                      std::atomic<uint64_t> *matches) const
+{
+  for (size_t iteration = first; iteration < last; ++iteration) {
+    if (iteration % 2 == 0) {
+      for (size_t y = top; y < bottom; ++y)
+        for (size_t x = RoiBox.Left; x < RoiBox.Right; ++x)
+          if (IsPropagated(RoiMask(y, x)))
+            AsyncPropagate<R, true>(x, y, codec, matches);
+    } else {
+      for (size_t y = bottom; y-- > top; )
+        for (size_t x = RoiBox.Right; x-- > RoiBox.Left; )
+          if (IsPropagated(RoiMask(y, x)))
+            AsyncPropagate<R, false>(x, y, codec, matches);
+    }
+  }
+}
+
+
+template <size_t R, bool Forward>
+int OPAL::AsyncPropagate(size_t x, size_t y, const PackedMatchCodec &codec,
+                         std::atomic<uint64_t> *matches) const
+{
+  using ValueType = SSDType::ValueType;
+
+  // Neighbors outside the image wrap around and fail the checks.
+  const size_t newX = Forward ? x + 1 : x - 1;
+  const size_t newY = Forward ? y + 1 : y - 1;
+
+  // Cost of the match of neighbor (nx,ny) shifted to (x,y).
+  auto shifted = [&](size_t nx, size_t ny, PackedMatchCodec::Match &match) {
+    if (nx >= ImageWidth || ny >= ImageHeight)
+      return INVALID_COST;
+
+    match = codec.Unpack(
+      matches[ny * ImageWidth + nx].load(std::memory_order_relaxed));
+    if (std::isinf(match.cost))
+      return INVALID_COST;
+
+    SSDType ssd(Database, match.t, nx, ny, nx + match.offsetX,
+                ny + match.offsetY, Sets.patchRadius, match.cost);
+    if (ny != y)
+      Forward ? ssd.ShiftUp<R>() : ssd.ShiftDown<R>();
+    else
+      Forward ? ssd.ShiftLeft<R>() : ssd.ShiftRight<R>();
+
+    // Destinations shifted off the template reach the fence. Rounding of
+    // the float cost can't make it negative.
+    return std::max(ssd.GetValue(), ValueType());
+  };
+
+  auto &entry = matches[y * ImageWidth + x];
+  uint64_t current = entry.load(std::memory_order_relaxed);
+  const ValueType currentCost = PackedMatchCodec::Cost(current);
+
+  PackedMatchCodec::Match vertical, horizontal;
+  const ValueType fromVertical = shifted(x, newY, vertical);
+  const ValueType fromHorizontal = shifted(newX, y, horizontal);
+
+  // Same choice as in the serial kernels.
+  const PackedMatchCodec::Match *best = nullptr;
+  ValueType bestCost = currentCost;
+  if (fromVertical < currentCost && fromVertical < fromHorizontal) {
+    best = &vertical;
+    bestCost = fromVertical;
+  } else if (fromHorizontal < currentCost && fromHorizontal < fromVertical) {
+    best = &horizontal;
+    bestCost = fromHorizontal;
+  }
+
+  if (!best)
+    return 0;
+
+  const uint64_t improved =
+    codec.Pack(best->t, best->offsetX, best->offsetY, bestCost);
+  while (PackedMatchCodec::Cost(improved) < PackedMatchCodec::Cost(current))
+    if (entry.compare_exchange_weak(current, improved,
+                                    std::memory_order_relaxed))
+      return 1;
+
+  return 0;
+}
+
+
+template <size_t R>
 int OPAL::PropagateRightDown(size_t x, size_t y)
 {
   size_t newX = x + 1;
@@ -137,8 +356,10 @@ int OPAL::PropagateRightDown(size_t x, size_t y)
   SSDType fromDown  = SSDMap(newY, x);
   SSDType fromRight = SSDMap(y, newX);
 
-  fromDown.ShiftUp();
-  fromRight.ShiftLeft();
+  // Destinations shifted off the template reach the fence, SSDs are
+  // infinite.
+  fromDown.ShiftUp<R>();
+  fromRight.ShiftLeft<R>();
 
   if (current < fromRight && current < fromDown)
     return 0;
@@ -165,6 +386,7 @@ int OPAL::PropagateRightDown(size_t x, size_t y)
 }
 
 
+template <size_t R>
 int OPAL::PropagateLeftUp(size_t x, size_t y)
 {
   size_t newX = x - 1;
@@ -174,8 +396,10 @@ int OPAL::PropagateLeftUp(size_t x, size_t y)
   SSDType fromUp   = SSDMap(newY, x);
   SSDType fromLeft = SSDMap(y, newX);
 
-  fromUp.ShiftDown();
-  fromLeft.ShiftRight();
+  // Destinations shifted off the template reach the fence, SSDs are
+  // infinite.
+  fromUp.ShiftDown<R>();
+  fromLeft.ShiftRight<R>();
 
   if (current < fromUp && current < fromLeft)
     return 0;
@@ -202,91 +426,556 @@ int OPAL::PropagateLeftUp(size_t x, size_t y)
 }
 
 
-void OPAL::BuildSegmentation() {
-  CandidateLabelsContainer candidates;
+OPAL::FusionStats OPAL::BuildSegmentation() {
+  // Patches around border pixels take labels of ghost pixels, those
+  // repeat offsets of the nearest pixel.
+  FieldX.UpdateBorder(BorderMode::Replicate);
+  FieldY.UpdateBorder(BorderMode::Replicate);
+  FieldT.UpdateBorder(BorderMode::Replicate);
+
+  // Width of label indices is chosen by the database once for all pixels.
+  if (Database.HasWideLabels())
+    return BuildSegmentation<DatabaseType::WideLabelType>();
+  else
+    return BuildSegmentation<DatabaseType::NarrowLabelType>();
+}
+
+
+template <class L>
+OPAL::FusionStats OPAL::BuildSegmentation() {
+  // Estimator is chosen once, fusion loop is compiled for each of them.
+  switch (Sets.labelEstimator) {
+  case LabelEstimatorType::Dummy:
+    return FuseLabels<L>(DummyLabelEstimator<SegPixelType>());
+  case LabelEstimatorType::MaxVote:
+    return FuseLabels<L>(MaxVoteLabelEstimator<SegPixelType>(
+      Database.GetLabelTable().GetSize()));
+  }
+  return FusionStats();
+}
 
-  size_t mismatchTimes = 0;
 
-  for (size_t i = Sets.patchRadius; i + Sets.patchRadius < ImageHeight; ++i)
-    for (size_t j = Sets.patchRadius; j + Sets.patchRadius < ImageWidth; ++j) {
-      const auto &curDst = Database.GetSegmentation(FieldT(i, j));
-      const auto OffsetX = FieldX(i, j);
-      const auto OffsetY = FieldY(i, j);
+template <class L, class Estimator>
+OPAL::FusionStats OPAL::FuseLabels(const Estimator &estimator) {
+  Image<L> matched;
+  BuildMatchedLabels(matched);
+
+  // Pixels out of ROI are background.
+  OutputSegmentation.Fill(SegPixelType());
+
+  // Each band has its own estimator, scratch and counts, so there are as
+  // few as possible.
+  const size_t rows = RoiBox.Bottom - RoiBox.Top;
+  const size_t bands =
+    std::max<size_t>(1, std::min(util::HardwareConcurrency(), rows));
+  std::vector<FusionStats> stats(bands, FusionStats());
+  util::ParallelFor(0, bands, [&](size_t band) {
+    Estimator bandEstimator(estimator);
+    CandidateLabelsContainer candidates;
+    FuseRows<L>(bandEstimator, matched, RoiBox.Top + rows * band / bands,
+                RoiBox.Top + rows * (band + 1) / bands, candidates,
+                stats[band]);
+  }, bands);
+
+  FusionStats total = FusionStats();
+  for (const auto &band : stats) {
+    total.fused += band.fused;
+    total.settled += band.settled;
+    total.mismatches += band.mismatches;
+  }
+  return total;
+}
 
-      auto oldRes = curDst(i + OffsetY, j + OffsetX);
-      GetCandidateLabelsForPixel(i, j, candidates);
-      OutputSegmentation(i,j) = finalLabelEstimator.EstimateLabel(candidates);
 
-      if (OutputSegmentation(i,j) != oldRes)
-        ++mismatchTimes;
+template <class L, class Estimator>
+void OPAL::FuseRows(Estimator &estimator, const Image<L> &matched,
+                    size_t firstRow, size_t lastRow,
+                    CandidateLabelsContainer &candidates, FusionStats &stats)
+{
+  const auto &labelTable = Database.GetLabelTable();
+  const size_t r = Sets.patchRadius;
+
+  for (size_t i = firstRow; i < lastRow; ++i)
+    for (size_t j = RoiBox.Left; j < RoiBox.Right; ++j) {
+      if (!IsInRoi(RoiMask(i, j)))
+        continue;
+
+      const L own = matched(i + r, j + r);
+
+      // Candidates were unanimous when the pixel was settled.
+      if (RoiMask(i, j) == SETTLED) {
+        OutputSegmentation(i, j) = labelTable[own];
+        ++stats.settled;
+        continue;
+      }
+
+      GetCandidateLabelsForPixel<L>(matched, i, j, candidates);
+      auto result = estimator.EstimateLabel(candidates);
+      OutputSegmentation(i, j) = labelTable[result];
+
+      ++stats.fused;
+      if (result != own)
+        ++stats.mismatches;
     }
-
-  std::cout << "Mismatch times: " << mismatchTimes << std::endl;
 }
 
 
 void OPAL::Run() {
   ConstrainedInitialization();
-  for (size_t i = 0; i < Sets.maxIterations; ++i) {
-    if (i % 2 == 0)
+  ReportApproximationError(0);
+  SaveCheckpoint(0);
+
+  RunIterations(0);
+}
+
+
+void OPAL::ResumeFrom(const std::string &fileName) {
+  auto checkpoint = OPALCheckpoint::ReadFromFile(fileName);
+
+  RestoreCheckpoint(checkpoint);
+  RunIterations(checkpoint.nextIteration);
+}
+
+
+void OPAL::RunIterations(size_t first) {
+  for (size_t i = first; i < Sets.maxIterations; ++i) {
+    if (Sets.propagationMode == PropagationMode::Async) {
+      // Iterations nobody looks between run without barriers.
+      size_t last = NeedsStateBetweenIterations() ? i + 1
+                                                  : Sets.maxIterations;
+      AsyncPropagation(i, last);
+      i = last - 1;
+    } else if (i % 2 == 0) {
       EvenPropagation(i);
-    else
+    } else {
       OddPropagation(i);
+    }
+
+    if (Sets.consensusIteration && i + 1 >= Sets.consensusIteration)
+      SettlePixels();
+
+    ReportApproximationError(i + 1);
+
+    SaveCheckpoint(i + 1);
   }
 
-  BuildSegmentation();
+  LastFusionStats = BuildSegmentation();
+
+  WaitForSavedFields();
 }
 
 
-void OPAL::SaveCurrentFields(const std::string &fileName) const {
+OPALCheckpoint OPAL::GetCheckpoint(size_t nextIteration) const {
+  OPALCheckpoint checkpoint;
+  checkpoint.nextIteration = nextIteration;
+  checkpoint.settingsHash = Sets.GetHash();
+  checkpoint.imageCount = Database.GetImageCount();
+
+  // Checkpoint keeps contiguous images.
+  checkpoint.fieldX = FieldX.castTo<int>();
+  checkpoint.fieldY = FieldY.castTo<int>();
+  checkpoint.fieldT = FieldT.castTo<size_t>();
+
+  checkpoint.costs.Resize(ImageHeight, ImageWidth);
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j)
+      checkpoint.costs(i, j) = SSDMap(i, j).GetValue();
+
+  checkpoint.settled.Resize(ImageHeight, ImageWidth);
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j)
+      checkpoint.settled(i, j) = RoiMask(i, j) == SETTLED;
+
+  return checkpoint;
+}
+
+
+void OPAL::RestoreCheckpoint(const OPALCheckpoint &checkpoint) {
+  if (checkpoint.settingsHash != Sets.GetHash())
+    throw std::runtime_error("Checkpoint was saved with different settings!");
+  if (checkpoint.imageCount != Database.GetImageCount())
+    throw std::runtime_error("Checkpoint was saved for different database!");
+  if (checkpoint.fieldX.getHeight() != ImageHeight ||
+      checkpoint.fieldX.getWidth() != ImageWidth)
+    throw std::runtime_error("Checkpoint has wrong size of fields!");
+
+  for (size_t i = 0; i < checkpoint.fieldT.getSize(); ++i)
+    if (checkpoint.fieldT[i] == 0 ||
+        checkpoint.fieldT[i] >= Database.GetImageCount())
+      throw std::runtime_error("Checkpoint has wrong template index!");
+
+  // Patches are read around destinations, they must be inside the image.
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j)
+      if (i + checkpoint.fieldY(i, j) >= ImageHeight ||
+          j + checkpoint.fieldX(i, j) >= ImageWidth)
+        throw std::runtime_error("Checkpoint has match out of image!");
+
+  // Only pixels in ROI can be settled.
+  for (size_t i = 0; i < checkpoint.settled.getSize(); ++i)
+    if (checkpoint.settled[i] &&
+        !IsInRoi(RoiMask(i / ImageWidth, i % ImageWidth)))
+      throw std::runtime_error("Checkpoint has settled pixels out of ROI!");
+
+  // Copy pixels, keeping padded layout of the fields.
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      FieldX(i, j) = checkpoint.fieldX(i, j);
+      FieldY(i, j) = checkpoint.fieldY(i, j);
+      FieldT(i, j) = checkpoint.fieldT(i, j);
+    }
+
+  for (size_t i = 0; i < checkpoint.settled.getSize(); ++i)
+    if (checkpoint.settled[i])
+      RoiMask(i / ImageWidth, i % ImageWidth) = SETTLED;
+
+  // Positions of patches are recalculated, values are taken as saved.
+  UpdateSSDMap();
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j)
+      SSDMap(i, j).SetValue(checkpoint.costs(i, j));
+}
+
+
+void OPAL::SaveCheckpoint(size_t nextIteration) const {
+  if (Sets.checkpointPath.empty())
+    return;
+
+  GetCheckpoint(nextIteration).WriteToFile(Sets.checkpointPath);
+}
+
+
+constexpr size_t OPAL::MAX_PENDING_SAVES;
+
+
+void OPAL::SaveCurrentFields(const std::string &fileName) {
   // If intermediate saving is not enabled, we are done.
   if (!Sets.intermediateSaving)
     return;
 
   auto fullFileName = FullFileName(Sets.intermediateSavingPath, fileName);
-  FlowIO::WriteFlowFile(fullFileName, FieldX, FieldY);
+
+  // Snapshot of the fields, the solver is free to change them after this.
+  auto contents =
+    std::make_shared<std::vector<char>>(FlowIO::EncodeFlow(FieldX, FieldY));
+
+  if (!FieldsWriter)
+    FieldsWriter.reset(new util::ThreadPool(1));
+
+  // Bound memory held by snapshots.
+  while (PendingSaves.size() >= MAX_PENDING_SAVES) {
+    auto oldest = std::move(PendingSaves.front());
+    PendingSaves.pop_front();
+    oldest.get();
+  }
+
+  PendingSaves.push_back(FieldsWriter->Submit([fullFileName, contents]() {
+    FlowIO::WriteFlowContents(fullFileName, *contents);
+  }));
 }
 
 
+void OPAL::WaitForSavedFields() {
+  while (!PendingSaves.empty()) {
+    auto oldest = std::move(PendingSaves.front());
+    PendingSaves.pop_front();
+    oldest.get();
+  }
+}
+
+
+template <size_t R>
 OPAL::SSDType OPAL::SSDAt(size_t i, size_t j) const {
   auto movIndex = FieldT(i, j);
   auto movX = j + FieldX(i, j);
   auto movY = i + FieldY(i, j);
 
-  return SSDType(Database, movIndex,
-                 j, i, movX, movY,
-                 Sets.patchRadius);
+  return SSDType::Calculate<R>(Database, movIndex,
+                               j, i, movX, movY,
+                               Sets.patchRadius);
+}
+
+
+template <size_t R>
+void OPAL::UpdateSSDRow(size_t i) {
+  for (size_t j = 0; j < ImageWidth; ++j) {
+    if (RoiMask(i, j) == OUT_OF_ROI) {
+      SSDMap(i, j) = InvalidSSD(i, j);
+      continue;
+    }
+
+    // Matches of neighbors are inside the image, so is the patch column
+    // ShiftRight adds, with ghost pixels.
+    bool sameMatch = j > 0 && RoiMask(i, j - 1) != OUT_OF_ROI &&
+                     FieldT(i, j) == FieldT(i, j - 1) &&
+                     FieldX(i, j) == FieldX(i, j - 1) &&
+                     FieldY(i, j) == FieldY(i, j - 1);
+    if (sameMatch) {
+      SSDMap(i, j) = SSDMap(i, j - 1);
+      SSDMap(i, j).template ShiftRight<R>();
+    } else {
+      SSDMap(i, j) = SSDAt<R>(i, j);
+    }
+  } // for (j)
+}
+
+
+OPAL::SSDType OPAL::InvalidSSD(size_t i, size_t j) const {
+  return SSDType(Database, 1, j, i, j, i, Sets.patchRadius, INVALID_COST);
 }
 
 
 void OPAL::UpdateSSDMap() {
-  for (size_t i = Sets.patchRadius; i + Sets.patchRadius < ImageHeight; ++i) {
-    for (size_t j = Sets.patchRadius; j + Sets.patchRadius < ImageWidth; ++j) {
-      SSDMap(i, j) = SSDAt(i, j);
-    } // for (j)
-  } // for (i)
+  util::ParallelFor(0, ImageHeight, [this](size_t i) {
+    (this->*UpdateRow)(i);
+  });
+
+  // Neighbors of border pixels, -1 wraps around to the ghost pixel.
+  // Patches are at the nearest pixel, so shifts into the image only reach
+  // the fence and the value stays infinite rather than NaN.
+  for (size_t i = 0; i < ImageHeight; ++i) {
+    SSDMap(i, -1) = InvalidSSD(i, 0);
+    SSDMap(i, ImageWidth) = InvalidSSD(i, ImageWidth - 1);
+  }
+  for (size_t j = 0; j < ImageWidth; ++j) {
+    SSDMap(-1, j) = InvalidSSD(0, j);
+    SSDMap(ImageHeight, j) = InvalidSSD(ImageHeight - 1, j);
+  }
+}
+
+
+void OPAL::ComputeRoi() {
+  RoiMask.Resize(ImageHeight, ImageWidth);
+
+  switch (Sets.roiMode) {
+  case RoiMode::None:
+    RoiMask.Fill(ACTIVE);
+    break;
+
+  case RoiMode::Threshold:
+    for (size_t i = 0; i < ImageHeight; ++i)
+      for (size_t j = 0; j < ImageWidth; ++j)
+        RoiMask(i, j) =
+          InputImage(i, j) > Sets.roiThreshold ? ACTIVE : OUT_OF_ROI;
+    break;
+
+  case RoiMode::Labels:
+    RoiMask.Fill(OUT_OF_ROI);
+    for (size_t t = 1; t < Database.GetImageCount(); ++t) {
+      const auto seg = Database.GetSegmentation(t);
+      for (size_t i = 0; i < ImageHeight; ++i)
+        for (size_t j = 0; j < ImageWidth; ++j)
+          if (seg(i, j) != SegPixelType())
+            RoiMask(i, j) = ACTIVE;
+    }
+    break;
+  }
+
+  AddRoiMargin();
+
+  // Tight bounding box, empty if no pixel is in ROI.
+  RoiBox = Box{ImageHeight, 0, ImageWidth, 0};
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j)
+      if (RoiMask(i, j)) {
+        RoiBox.Top    = std::min(RoiBox.Top, i);
+        RoiBox.Bottom = std::max(RoiBox.Bottom, i + 1);
+        RoiBox.Left   = std::min(RoiBox.Left, j);
+        RoiBox.Right  = std::max(RoiBox.Right, j + 1);
+      }
+
+  if (RoiBox.Top >= RoiBox.Bottom)
+    RoiBox = Box{0, 0, 0, 0};
+}
+
+
+void OPAL::AddRoiMargin() {
+  // Rows first: nearInRow(i, j) is 1 if row i has ROI pixel up to r from j.
+  const size_t r = Sets.patchRadius;
+  Image<uint8_t> nearInRow(ImageHeight, ImageWidth, 0);
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      if (RoiMask(i, j) != ACTIVE)
+        continue;
+      size_t last = std::min(ImageWidth, j + r + 1);
+      for (size_t k = j > r ? j - r : 0; k < last; ++k)
+        nearInRow(i, k) = 1;
+    }
+
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      if (!nearInRow(i, j))
+        continue;
+      size_t last = std::min(ImageHeight, i + r + 1);
+      for (size_t k = i > r ? i - r : 0; k < last; ++k)
+        if (RoiMask(k, j) == OUT_OF_ROI)
+          RoiMask(k, j) = MARGIN;
+    }
+}
+
+
+void OPAL::ReportApproximationError(size_t iteration) {
+  if (!Sets.errorReportSamples)
+    return;
+
+  if (ReferenceSamples.empty()) {
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < ImageHeight; ++i)
+      for (size_t j = 0; j < ImageWidth; ++j)
+        if (IsInRoi(RoiMask(i, j)))
+          candidates.push_back(i * ImageWidth + j);
+
+    // Partial shuffle, first samples are chosen without repetitions.
+    util::CounterRandom sampleGen(0, 0);
+    size_t count = std::min(Sets.errorReportSamples, candidates.size());
+    for (size_t k = 0; k < count; ++k) {
+      auto other = sampleGen.UniformInt(k, candidates.size() - 1);
+      std::swap(candidates[k], candidates[other]);
+    }
+
+    ReferenceSamples.resize(count);
+    ExhaustiveSearch<DatabaseType> reference(Database, Sets.patchRadius,
+                                             Sets.initWindowRadius);
+    util::ParallelFor(0, count, [&](size_t k) {
+      auto &sample = ReferenceSamples[k];
+      sample.i = candidates[k] / ImageWidth;
+      sample.j = candidates[k] % ImageWidth;
+      sample.cost = reference.FindBestMatch(sample.i, sample.j).cost;
+    });
+  }
+
+  if (ReferenceSamples.empty())
+    return;
+
+  // Costs are recalculated, shifted ones may differ in last bits.
+  double gapSum = 0;
+  size_t optimal = 0;
+  for (const auto &sample : ReferenceSamples) {
+    auto cost =
+      SSDAt<SSDType::DYNAMIC_RADIUS>(sample.i, sample.j).GetValue();
+    gapSum += cost - sample.cost;
+    if (!(sample.cost < cost))
+      ++optimal;
+  }
+
+  ApproximationError error;
+  error.iteration = iteration;
+  error.meanCostGap = gapSum / ReferenceSamples.size();
+  error.optimalFraction = double(optimal) / ReferenceSamples.size();
+  ApproximationErrors.push_back(error);
 }
 
+
+size_t OPAL::getSettledCount() const {
+  size_t count = 0;
+  for (size_t i = 0; i < ImageHeight; ++i)
+    for (size_t j = 0; j < ImageWidth; ++j)
+      count += RoiMask(i, j) == SETTLED;
+  return count;
+}
+
+
+size_t OPAL::SettlePixels() {
+  // Patches of border pixels see offsets of the nearest pixels, as in
+  // BuildSegmentation.
+  FieldX.UpdateBorder(BorderMode::Replicate);
+  FieldY.UpdateBorder(BorderMode::Replicate);
+  FieldT.UpdateBorder(BorderMode::Replicate);
+
+  if (Database.HasWideLabels())
+    return SettlePixels<DatabaseType::WideLabelType>();
+  else
+    return SettlePixels<DatabaseType::NarrowLabelType>();
+}
+
+
+template <class L>
+size_t OPAL::SettlePixels() {
+  const size_t r = Sets.patchRadius;
+  const size_t side = 2 * r + 1;
+  const size_t height = ImageHeight + 2 * r;
+  const size_t width = ImageWidth + 2 * r;
+
+  // One lookup per pixel instead of one per patch element.
+  Image<L> matched;
+  BuildMatchedLabels(matched);
+
+  // rowUniform(i, j) is 1 if matched(i, j .. j + 2r) are all the same, so
+  // a patch is unanimous if side rows of it are uniform and equal.
+  Image<uint8_t> rowUniform(height, ImageWidth);
+  std::vector<size_t> sameUntil(width);
+  for (size_t i = 0; i < height; ++i) {
+    sameUntil[width - 1] = width - 1;
+    for (size_t j = width - 1; j-- > 0; )
+      sameUntil[j] = matched(i, j) == matched(i, j + 1) ? sameUntil[j + 1] : j;
+    for (size_t j = 0; j < ImageWidth; ++j)
+      rowUniform(i, j) = sameUntil[j] >= j + side - 1;
+  }
+
+  // Same runs down the columns, rows bottom-up keep memory access linear.
+  size_t settled = 0;
+  std::vector<size_t> uniformUntil(ImageWidth);
+  for (size_t i = height; i-- > 0; ) {
+    for (size_t j = 0; j < ImageWidth; ++j) {
+      // Run of uniform equal rows continues from the row below or starts.
+      if (i + 1 == height || !rowUniform(i, j) || !rowUniform(i + 1, j) ||
+          matched(i, j) != matched(i + 1, j))
+        uniformUntil[j] = i;
+
+      if (i >= ImageHeight || !rowUniform(i, j) ||
+          uniformUntil[j] < i + side - 1)
+        continue;
+
+      if (RoiMask(i, j) == ACTIVE) {
+        RoiMask(i, j) = SETTLED;
+        ++settled;
+      }
+    }
+  }
+
+  return settled;
+}
+
+template <class L>
+void OPAL::BuildMatchedLabels(Image<L> &matched) const
+{
+  const size_t r = Sets.patchRadius;
+  const size_t height = ImageHeight + 2 * r;
+  const size_t width = ImageWidth + 2 * r;
+
+  matched.Resize(height, width);
+  util::ParallelFor(0, height, [&](size_t i) {
+    size_t y = i - r;
+    for (size_t j = 0; j < width; ++j) {
+      size_t x = j - r;
+      const auto &curDst = Database.GetLabelIndices<L>(FieldT(y, x));
+      matched(i, j) = curDst(y + FieldY(y, x), x + FieldX(y, x));
+    }
+  });
+}
+
+
+template <class L>
 void OPAL::GetCandidateLabelsForPixel(
-    size_t i, size_t j, OPAL::CandidateLabelsContainer &result) const
+    const Image<L> &matched, size_t i, size_t j,
+    OPAL::CandidateLabelsContainer &result) const
 {
-  assert(i >= Sets.patchRadius && i + Sets.patchRadius < ImageHeight &&
-         "index i is out of range!");
-  assert(j >= Sets.patchRadius && j + Sets.patchRadius < ImageWidth &&
-         "index j is out of range!");
+  assert(i < ImageHeight && "index i is out of range!");
+  assert(j < ImageWidth && "index j is out of range!");
 
   constexpr double CANDIDATE_WEIGHT = 1.0;
 
   result.clear();
 
-  for (size_t di = i - Sets.patchRadius; di <= i + Sets.patchRadius; ++di)
-    for (size_t dj = j - Sets.patchRadius; dj <= j + Sets.patchRadius; ++dj) {
-      const auto &curDst = Database.GetSegmentation(FieldT(di, dj));
-      const auto OffsetX = FieldX(di, dj);
-      const auto OffsetY = FieldY(di, dj);
-
-      const auto label = curDst(di + OffsetY, dj + OffsetX);
+  // Patch around (i,j) starts at (i,j) of matched labels, rows of it are
+  // contiguous.
+  const size_t patchSide = 2 * Sets.patchRadius + 1;
 
+  for (size_t dy = 0; dy < patchSide; ++dy) {
+    const L *row = &matched(i + dy, j);
+    for (size_t dx = 0; dx < patchSide; ++dx) {
+      const SegPixelType label = row[dx];
       result.push_back(std::make_pair(label, CANDIDATE_WEIGHT));
     }
+  }
 }
@@ -10,14 +10,22 @@
 #pragma once
 
 #include "ImageDatabase.h"
+#include "ExhaustiveSearch.h"
 #include "OPALSettings.h"
+#include "OPALCheckpoint.h"
 #include "SSD.h"
 #include "MaxVoteLabelEstimator.h"
 #include "DummyLabelEstimator.h"
+#include "PackedMatch.h"
 
+#include "util/thread/ThreadPool.h"
+
+#include <atomic>
 #include <chrono>
-#include <random>
 #include <functional>
+#include <deque>
+#include <future>
+#include <memory>
 
 /**
  * @brief Class implementing the core of OPAL algorithm.
@@ -44,10 +52,38 @@ public:
   /**
    * @param [in] settings Set of OPAL options.
    * @param [in] database Set of input images and their segmentations.
-   *                      Image to be segmented is database[0].
+   *                      Image to be segmented is database[0]. Images must
+   *                      be padded and fenced, see PrepareDatabase.
+   *
+   * @throws std::logic_error if the database can't be used, or matches
+   * can't be packed for PropagationMode::Async, see PackedMatchCodec.
    */
   OPAL(const OPALSettings &settings, const DatabaseType &database);
 
+  /**
+   * @returns Padding of database images needed to process every pixel,
+   * border ones included, without boundary checks.
+   *
+   * Patches of all pixels fit into patchRadius ghost pixels, one more is
+   * the fence, see PrepareDatabase.
+   */
+  static size_t GetRequiredBorder(const OPALSettings &settings) {
+    return settings.patchRadius + 1;
+  }
+
+  /**
+   * @brief Pad an empty @p database for OPAL with @p settings.
+   *
+   * Images get GetRequiredBorder(settings) ghost pixels, the outermost ones
+   * are an infinite fence. A match shifted from a neighbor can point one
+   * pixel off the image, its patch then reaches the fence and the SSD is
+   * infinite. So such candidates are never taken without checking them.
+   *
+   * @throws std::logic_error if the database is not empty.
+   */
+  static void PrepareDatabase(DatabaseType &database,
+                              const OPALSettings &settings);
+
   /**
    * @brief Constraint initialization.
    *
@@ -57,10 +93,28 @@ public:
    * located at {(x',y'), t'} where t' is the index of template in the library
    * is assigned. x' and y' are within the square initialization window around
    * (x, y).
+   *
+   * With InitMode::Exact the best correspondence in the window is assigned
+   * instead of a random one.
    */
   void ConstrainedInitialization();
 
-  void BuildSegmentation();
+  /// Counts of the last label fusion.
+  struct FusionStats {
+    size_t fused;      ///< Pixels whose candidates went to the estimator.
+    size_t settled;    ///< Settled pixels, which took their own match.
+    size_t mismatches; ///< Fused pixels whose label isn't their own match.
+  };
+
+  /**
+   * @brief Fuse labels of matches into output segmentation.
+   *
+   * Bands of rows are shared between threads.
+   */
+  FusionStats BuildSegmentation();
+
+  /// @return Counts of label fusion done by Run or ResumeFrom.
+  const FusionStats& getFusionStats() const { return LastFusionStats; }
 
   /// @return The result segmentation of input image.
   SegType GetOutput() const {
@@ -69,9 +123,29 @@ public:
 
   /**
    * @brief Run OPAL algorithm. Executes all stages successively.
+   *
+   * If checkpointPath is set, a checkpoint is saved after initialization and
+   * after each iteration.
    */
   void Run();
 
+  /**
+   * @brief Continue a run from a checkpoint saved by Run.
+   *
+   * Restores fields and costs, then performs the remaining iterations and
+   * builds segmentation. Random numbers are only drawn in initialization,
+   * so the result is exactly the same as of an uninterrupted run.
+   *
+   * @param [in] fileName Name of checkpoint file.
+   *
+   * @throws std::runtime_error if the checkpoint is damaged or doesn't match
+   * the settings or the database.
+   */
+  void ResumeFrom(const std::string &fileName);
+
+  /// @returns Current state as a checkpoint before iteration nextIteration.
+  OPALCheckpoint GetCheckpoint(size_t nextIteration) const;
+
 
   /// @return X-coordinate offsets between nearest neighbor patches.
   const Image<int>& getFieldX() const { return FieldX; }
@@ -85,6 +159,35 @@ public:
   /// @return Map of SSD values between patches.
   const Image<SSDType>& getSSDMap() const { return SSDMap; }
 
+  /**
+   * @return States of pixels, OUT_OF_ROI (0) and MARGIN for ones not in
+   * region of interest.
+   */
+  const Image<uint8_t>& getRoiMask() const { return RoiMask; }
+
+  /// @return Number of pixels settled by consensus so far.
+  size_t getSettledCount() const;
+
+  /// Distance of the field from the exact one, see Sets.errorReportSamples.
+  struct ApproximationError {
+    size_t iteration;       ///< Iterations done, 0 after initialization.
+    double meanCostGap;     ///< Mean of SSD minus exact SSD over samples.
+    double optimalFraction; ///< Part of samples matched at exact SSD.
+  };
+
+  /// @return Reports of the run, empty if Sets.errorReportSamples is 0.
+  const std::vector<ApproximationError>& getApproximationErrors() const {
+    return ApproximationErrors;
+  }
+
+  /// Values of RoiMask.
+  enum PixelState : uint8_t {
+    OUT_OF_ROI = 0, ///< Not matched, gets label 0.
+    ACTIVE     = 1, ///< Propagated and fused.
+    SETTLED    = 2, ///< Whole patch agrees on a label, see SettlePixels.
+    MARGIN     = 3  ///< Out of ROI in a patch of ROI pixel, propagated only.
+  };
+
 
 private:
   /// Global OPAL settings.
@@ -93,6 +196,9 @@ private:
   /// Database of images. Image to be segmented at index 0.
   const DatabaseType &Database;
 
+  /// Keeps all pairs of the database in memory while OPAL uses them.
+  std::vector<DatabaseType::PinGuard> DatabasePins;
+
   // Output displacement fields.
   Image<int>     FieldX; ///< x-coordinate *offset*
   Image<int>     FieldY; ///< y-coordinate *offset*
@@ -115,16 +221,78 @@ private:
   /// Result segmentation of input image.
   SegType OutputSegmentation;
 
+  /**
+   * @brief PixelState of each pixel, see OPALSettings::roiMode.
+   *
+   * Pixels out of ROI keep their initial offsets, are never propagated from
+   * and get label 0. Margin pixels are propagated like active ones, so that
+   * all candidates of ROI pixels come from real matches, but get label 0
+   * too. Settled pixels keep their offsets, but are still propagated from.
+   */
+  Image<uint8_t> RoiMask;
+
+  /// Rectangle of image, [Top, Bottom) x [Left, Right).
+  struct Box {
+    size_t Top;
+    size_t Bottom;
+    size_t Left;
+    size_t Right;
+  };
+
+  /// Bounding box of RoiMask, loops over pixels don't leave it.
+  Box RoiBox;
+
+
+  /// Candidates are the same for all estimators, see Sets.labelEstimator.
+  using CandidateLabelsContainer =
+    DummyLabelEstimator<SegPixelType>::CandidateContainer;
+
+
+  /// Pixel compared with the exact nearest neighbor field.
+  struct ReferenceSample {
+    size_t i;
+    size_t j;
+    SSDType::ValueType cost; ///< SSD of the exact best match.
+  };
+
+  /// Found on first report, see ReportApproximationError.
+  std::vector<ReferenceSample> ReferenceSamples;
+
+  std::vector<ApproximationError> ApproximationErrors;
+
+  FusionStats LastFusionStats = FusionStats();
+
+
+  /// Maximum number of field snapshots waiting to be written.
+  static constexpr size_t MAX_PENDING_SAVES = 2;
+
+  /// Background thread writing intermediate fields, started on first save.
+  std::unique_ptr<util::ThreadPool> FieldsWriter;
+
+  /// Writes of intermediate fields not waited for yet, oldest first.
+  std::deque<std::future<void>> PendingSaves;
 
-  using RandomGeneratorType = std::mt19937;
 
-  /// Pseudo-random generator for initialization step.
-  RandomGeneratorType randGen;
+  /// Propagation pass over the whole image, returns number of changed pixels.
+  using PropagationPass = size_t (OPAL::*)();
 
+  /// Passes with SSD kernels for the patch radius, see SelectKernels.
+  PropagationPass EvenPass;
+  PropagationPass OddPass;
 
-  using FinalLabelEstimator      = DummyLabelEstimator<SegPixelType>;
-  using CandidateLabelsContainer = FinalLabelEstimator::CandidateContainer;
-  FinalLabelEstimator finalLabelEstimator;
+  /// Update of a row of SSD map, see UpdateSSDRow.
+  using SSDRowUpdate = void (OPAL::*)(size_t);
+
+  /// Row update with SSD kernels for the patch radius, see SelectKernels.
+  SSDRowUpdate UpdateRow;
+
+  /// Sweeps of a strip of rows, see SweepStrip.
+  using StripSweep = void (OPAL::*)(size_t, size_t, size_t, size_t,
+                                    const PackedMatchCodec &,
+                                    std::atomic<uint64_t> *) const;
+
+  /// Strip sweeps with SSD kernels for the patch radius, see SelectKernels.
+  StripSweep AsyncSweep;
 
 private:
   /**
@@ -141,12 +309,34 @@ private:
    */
   void OddPropagation(size_t iteration);
 
+  /**
+   * @brief Choose propagation passes for the patch radius.
+   *
+   * Radii 1 to 5 get SSD kernels with loops unrolled at compile time, other
+   * ones use kernels with run time patch size.
+   */
+  void SelectKernels(size_t patchRadius);
+
+  template <size_t R>
+  void SelectKernels();
+
+  /// Pass of EvenPropagation with SSD kernels for patch radius R.
+  template <size_t R>
+  size_t PropagateEven();
+
+  /// Pass of OddPropagation with SSD kernels for patch radius R.
+  template <size_t R>
+  size_t PropagateOdd();
+
   /**
    * @brief Propagate offsets from right and down neighbors to pixel at (x,y).
    *
    * @param [in] x X-coordinate of pixel to update
    * @param [in] y Y-coordinate of pixel to update
+   *
+   * @tparam R Patch radius of SSD kernels, SSDType::DYNAMIC_RADIUS for any.
    */
+  template <size_t R>
   int PropagateRightDown(size_t x, size_t y);
 
   /**
@@ -154,11 +344,75 @@ private:
    *
    * @param [in] x X-coordinate of pixel to update
    * @param [in] y Y-coordinate of pixel to update
+   *
+   * @tparam R Patch radius of SSD kernels, SSDType::DYNAMIC_RADIUS for any.
    */
+  template <size_t R>
   int PropagateLeftUp(size_t x, size_t y);
 
-  /// Save current displacement fields.
-  void SaveCurrentFields(const std::string &fileName) const;
+  /// Propagation iterations from first on and building segmentation.
+  void RunIterations(size_t first);
+
+  /**
+   * @returns True if fields are used between iterations: by intermediate
+   * saving, checkpoints, settling or reports.
+   */
+  bool NeedsStateBetweenIterations() const;
+
+  /**
+   * @brief Iterations [first, last) of PropagationMode::Async.
+   *
+   * Matches are packed into 64-bit atomic words with their costs. Each
+   * thread sweeps its own strip of rows of ROI, top-down on even iterations
+   * and bottom-up on odd ones, with no barriers between sweeps. Neighbors in
+   * other strips are read as they are at the moment, PatchMatch tolerates
+   * stale matches. Fields and exact SSD map are restored after the sweeps.
+   */
+  void AsyncPropagation(size_t first, size_t last);
+
+  /**
+   * @brief Sweeps of rows [top, bottom) for iterations [first, last).
+   *
+   * @tparam R Patch radius of SSD kernels, SSDType::DYNAMIC_RADIUS for any.
+   */
+  template <size_t R>
+  void SweepStrip(size_t first, size_t last, size_t top, size_t bottom,
+                  const PackedMatchCodec &codec,
+                  std::atomic<uint64_t> *matches) const;
+
+  /**
+   * @brief Async counterpart of PropagateRightDown (Forward) and
+   * PropagateLeftUp.
+   *
+   * Costs of neighbors are shifted as in the serial kernels. An improved
+   * match is published by compare-and-swap only while it is better than
+   * the stored one.
+   *
+   * @returns 1 if the match of (x,y) is improved, 0 otherwise.
+   */
+  template <size_t R, bool Forward>
+  int AsyncPropagate(size_t x, size_t y, const PackedMatchCodec &codec,
+                     std::atomic<uint64_t> *matches) const;
+
+  /// Restore state from a checkpoint, checking it suits this run.
+  void RestoreCheckpoint(const OPALCheckpoint &checkpoint);
+
+  /// Save checkpoint to Sets.checkpointPath if it's set.
+  void SaveCheckpoint(size_t nextIteration) const;
+
+  /**
+   * @brief Save current displacement fields.
+   *
+   * Fields are copied into a file image right away and written by a
+   * background thread, so the next iteration doesn't wait for the disk.
+   * Blocks if MAX_PENDING_SAVES snapshots are still being written.
+   *
+   * @throws Errors of previous writes.
+   */
+  void SaveCurrentFields(const std::string &fileName);
+
+  /// Wait until all intermediate fields are written. Rethrows write errors.
+  void WaitForSavedFields();
 
   /** @brief Calculate SSD at (i,j).
    *
@@ -167,12 +421,124 @@ private:
    *
    * @param [in] i y-coordinate in the images.
    * @param [in] j x-coordinate in the images.
+   *
+   * @tparam R Patch radius of SSD kernels, SSDType::DYNAMIC_RADIUS for any.
    */
+  template <size_t R>
   SSDType SSDAt(size_t i, size_t j) const;
 
-  /// Recalculate the whole SSD map.
+  /**
+   * @brief Recalculate the whole SSD map.
+   *
+   * Rows are shared between threads.
+   */
   void UpdateSSDMap();
 
-  void GetCandidateLabelsForPixel(size_t i, size_t j,
+  /**
+   * @brief Recalculate row @p i of SSD map.
+   *
+   * A pixel matched like its left neighbor, with the destination shifted
+   * by one, takes the neighbor's SSD shifted right instead of calculating
+   * it from scratch.
+   *
+   * @tparam R Patch radius of SSD kernels, SSDType::DYNAMIC_RADIUS for any.
+   */
+  template <size_t R>
+  void UpdateSSDRow(size_t i);
+
+  /**
+   * @returns SSD of patches at pixel (i,j) which is never propagated, for
+   * ghost pixels of SSD map and pixels out of ROI. Patches are not read,
+   * shifts keep the value infinite.
+   */
+  SSDType InvalidSSD(size_t i, size_t j) const;
+
+  /// Find RoiMask and RoiBox according to settings.
+  void ComputeRoi();
+
+  /// Mark pixels out of ROI up to patch radius from it as MARGIN.
+  void AddRoiMargin();
+
+  /// @return Whether pixel in @p state is matched by propagation.
+  static bool IsPropagated(uint8_t state) {
+    return state == ACTIVE || state == MARGIN;
+  }
+
+  /// @return Whether pixel in @p state is labeled by OPAL.
+  static bool IsInRoi(uint8_t state) {
+    return state == ACTIVE || state == SETTLED;
+  }
+
+  /**
+   * @brief Compare current SSDs with exact ones on sampled pixels.
+   *
+   * Samples are chosen from ROI by their own generator, so the run isn't
+   * changed by reports. Does nothing if Sets.errorReportSamples is 0.
+   *
+   * @param [in] iteration Number of iterations done.
+   */
+  void ReportApproximationError(size_t iteration);
+
+  /**
+   * @brief Settle active pixels whose whole patch is matched to one label.
+   *
+   * Settled pixels are skipped by propagation and take the label of their
+   * own match in BuildSegmentation, which is the same as all candidates
+   * had when they were settled.
+   *
+   * @returns Number of newly settled pixels.
+   */
+  size_t SettlePixels();
+
+  /// SettlePixels with label indices of type L.
+  template <class L>
+  size_t SettlePixels();
+
+  /**
+   * @brief Label index of type L matched to every pixel a patch can cover.
+   *
+   * @p matched gets size of the image padded by patch radius, (0,0) is ghost
+   * pixel (-r,-r). Borders of fields must be up to date.
+   */
+  template <class L>
+  void BuildMatchedLabels(Image<L> &matched) const;
+
+  /**
+   * @brief Build segmentation from label indices of type L.
+   *
+   * Candidates and results of the estimator are label indices, they are
+   * mapped to labels only when written to the output.
+   */
+  template <class L>
+  FusionStats BuildSegmentation();
+
+  /**
+   * @brief Fuse label indices of type L into output segmentation.
+   *
+   * Each band uses its own copy of @p estimator.
+   */
+  template <class L, class Estimator>
+  FusionStats FuseLabels(const Estimator &estimator);
+
+  /**
+   * @brief Fuse rows [firstRow, lastRow) of ROI.
+   *
+   * @param [in] matched Matched labels, see BuildMatchedLabels.
+   * @param [in,out] candidates Scratch container of the calling thread.
+   * @param [in,out] stats Counts of the band.
+   */
+  template <class L, class Estimator>
+  void FuseRows(Estimator &estimator, const Image<L> &matched,
+                size_t firstRow, size_t lastRow,
+                CandidateLabelsContainer &candidates,
+                FusionStats &stats);
+
+  /**
+   * @brief Collect label indices of type L matched to the patch around (i,j).
+   *
+   * @param [in] matched Matched labels, see BuildMatchedLabels.
+   */
+  template <class L>
+  void GetCandidateLabelsForPixel(const Image<L> &matched, size_t i, size_t j,
                                   CandidateLabelsContainer &result) const;
 };
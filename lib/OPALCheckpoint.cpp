@@ -0,0 +1,152 @@
+#include "OPALCheckpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+
+static const char     CHECKPOINT_MAGIC[8] = { 'O', 'P', 'A', 'L',
+                                              'C', 'K', 'P', 'T' };
+static const uint32_t CHECKPOINT_VERSION = 1;
+static const uint32_t BYTE_ORDER_MARK    = 0x01020304;
+
+static_assert(sizeof(int) == sizeof(int32_t), "FieldX/FieldY must be int32");
+static_assert(sizeof(double) == 8, "Costs must be float64");
+
+// FieldX, FieldY, FieldT, costs and settled flag of one pixel.
+static const uint64_t PIXEL_BYTES = 2 * sizeof(int32_t) + sizeof(uint64_t) +
+                                    sizeof(double) + sizeof(uint8_t);
+
+
+template <class T>
+static void WriteValue(std::ofstream &ofs, const T &value) {
+  ofs.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+template <class T>
+static T ReadValue(std::ifstream &ifs) {
+  T value;
+  ifs.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+
+template <class T, class F>
+static void WritePixels(std::ofstream &ofs, const Image<T> &image) {
+  std::vector<F> pixels(image.getSize());
+  for (size_t i = 0; i < pixels.size(); ++i)
+    pixels[i] = static_cast<F>(image[i]);
+  ofs.write(reinterpret_cast<const char*>(pixels.data()),
+            pixels.size() * sizeof(F));
+}
+
+
+// Number of bytes from the current position to the end of the file.
+static uint64_t RemainingBytes(std::ifstream &ifs) {
+  auto position = ifs.tellg();
+  ifs.seekg(0, std::ios::end);
+  auto end = ifs.tellg();
+  ifs.seekg(position);
+  if (!ifs || end < position)
+    return 0;
+  return static_cast<uint64_t>(end - position);
+}
+
+
+template <class T, class F>
+static void ReadPixels(std::ifstream &ifs, size_t height, size_t width,
+                       Image<T> &image) {
+  std::vector<F> pixels(height * width);
+  ifs.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(F));
+
+  image.Resize(height, width);
+  for (size_t i = 0; i < pixels.size(); ++i)
+    image[i] = static_cast<T>(pixels[i]);
+}
+
+
+void OPALCheckpoint::WriteToFile(const std::string &fileName) const
+{
+  if (fieldX.getSize() != fieldY.getSize() ||
+      fieldX.getSize() != fieldT.getSize() ||
+      fieldX.getSize() != costs.getSize() ||
+      fieldX.getSize() != settled.getSize())
+    throw std::runtime_error("Checkpoint fields have different sizes!");
+
+  auto tmpFileName = fileName + ".tmp";
+  {
+    std::ofstream ofs(tmpFileName, std::ios::binary);
+    if (!ofs)
+      throw std::runtime_error("Cannot open checkpoint file " + tmpFileName);
+
+    ofs.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    WriteValue(ofs, CHECKPOINT_VERSION);
+    WriteValue(ofs, BYTE_ORDER_MARK);
+
+    WriteValue<uint64_t>(ofs, fieldX.getHeight());
+    WriteValue<uint64_t>(ofs, fieldX.getWidth());
+    WriteValue(ofs, nextIteration);
+    WriteValue(ofs, settingsHash);
+    WriteValue(ofs, imageCount);
+
+    WritePixels<int, int32_t>(ofs, fieldX);
+    WritePixels<int, int32_t>(ofs, fieldY);
+    WritePixels<size_t, uint64_t>(ofs, fieldT);
+    WritePixels<double, double>(ofs, costs);
+    WritePixels<uint8_t, uint8_t>(ofs, settled);
+
+    ofs.close();
+    if (!ofs)
+      throw std::runtime_error("Error while writing checkpoint " + tmpFileName);
+  }
+
+  if (std::rename(tmpFileName.c_str(), fileName.c_str()))
+    throw std::runtime_error("Cannot replace checkpoint file " + fileName);
+}
+
+
+OPALCheckpoint OPALCheckpoint::ReadFromFile(const std::string &fileName)
+{
+  std::ifstream ifs(fileName, std::ios::binary);
+  if (!ifs)
+    throw std::runtime_error("Cannot open checkpoint file " + fileName);
+
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  ifs.read(magic, sizeof(magic));
+  if (!ifs || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)))
+    throw std::runtime_error("Not an OPAL checkpoint: " + fileName);
+
+  if (ReadValue<uint32_t>(ifs) != CHECKPOINT_VERSION)
+    throw std::runtime_error("Unsupported checkpoint version: " + fileName);
+  if (ReadValue<uint32_t>(ifs) != BYTE_ORDER_MARK)
+    throw std::runtime_error("Checkpoint has foreign byte order: " + fileName);
+
+  OPALCheckpoint result;
+  auto height = ReadValue<uint64_t>(ifs);
+  auto width = ReadValue<uint64_t>(ifs);
+  result.nextIteration = ReadValue<uint64_t>(ifs);
+  result.settingsHash = ReadValue<uint64_t>(ifs);
+  result.imageCount = ReadValue<uint64_t>(ifs);
+
+  if (!ifs || height > (1 << 20) || width > (1 << 20))
+    throw std::runtime_error("Damaged checkpoint header: " + fileName);
+
+  // Sizes from the header must match the rest of the file before anything
+  // is allocated for them.
+  if (height * width * PIXEL_BYTES != RemainingBytes(ifs))
+    throw std::runtime_error("Truncated checkpoint file: " + fileName);
+
+  ReadPixels<int, int32_t>(ifs, height, width, result.fieldX);
+  ReadPixels<int, int32_t>(ifs, height, width, result.fieldY);
+  ReadPixels<size_t, uint64_t>(ifs, height, width, result.fieldT);
+  ReadPixels<double, double>(ifs, height, width, result.costs);
+  ReadPixels<uint8_t, uint8_t>(ifs, height, width, result.settled);
+
+  if (!ifs)
+    throw std::runtime_error("Truncated checkpoint file: " + fileName);
+
+  return result;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file lib/OPALCheckpoint.h
+ *
+ * @brief Header with declaration of OPALCheckpoint class.
+ *
+ * OPALCheckpoint is a snapshot of OPAL state between iterations, enough to
+ * continue the run as if it was never interrupted.
+ */
+
+
+#pragma once
+
+#include "Image.h"
+
+#include <cstdint>
+#include <string>
+
+
+/**
+ * @brief State of an OPAL run after some iteration.
+ *
+ * Binary file layout, all numbers in byte order of the writing host:
+ *   - "OPALCKPT" magic, format version (uint32), byte order mark (uint32);
+ *   - height, width, next iteration, settings hash, number of pairs in the
+ *     database (all uint64);
+ *   - FieldX, FieldY (int32), FieldT (uint64), costs (float64), settled
+ *     (uint8), row by row.
+ */
+struct OPALCheckpoint {
+  /// Index of the first propagation iteration not done yet.
+  uint64_t nextIteration = 0;
+
+  /// OPALSettings::GetHash() of the run. Random numbers are only drawn in
+  /// initialization, the random seed is checked as part of the settings.
+  uint64_t settingsHash = 0;
+
+  /// Number of pairs in the database of the run.
+  uint64_t imageCount = 0;
+
+  Image<int>    fieldX;
+  Image<int>    fieldY;
+  Image<size_t> fieldT;
+  Image<double> costs; ///< SSD of patch matches.
+
+  /// 1 for pixels settled by consensus.
+  Image<uint8_t> settled;
+
+  /**
+   * @brief Write the checkpoint.
+   *
+   * Data is written to a temporary file renamed to @p fileName at the end,
+   * so an existing checkpoint is replaced only by a complete one.
+   *
+   * @throws std::runtime_error if writing fails.
+   */
+  void WriteToFile(const std::string &fileName) const;
+
+  /**
+   * @brief Read a checkpoint written by WriteToFile.
+   *
+   * @throws std::runtime_error if the file can't be read, is damaged or was
+   * written on a host with different byte order.
+   */
+  static OPALCheckpoint ReadFromFile(const std::string &fileName);
+};
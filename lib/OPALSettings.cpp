@@ -1,8 +1,97 @@
 #include "OPALSettings.h"
 #include "util/string/Split.h"
 
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
+
+
+LabelEstimatorType LabelEstimatorFromString(const std::string &name)
+{
+  if (name == "dummy")
+    return LabelEstimatorType::Dummy;
+  if (name == "maxVote")
+    return LabelEstimatorType::MaxVote;
+
+  throw std::invalid_argument("Unknown label estimator '" + name + "'");
+}
+
+
+std::ostream & operator<<(std::ostream &os, LabelEstimatorType type)
+{
+  switch (type) {
+  case LabelEstimatorType::Dummy:   return os << "dummy";
+  case LabelEstimatorType::MaxVote: return os << "maxVote";
+  }
+  return os;
+}
+
+
+InitMode InitModeFromString(const std::string &name)
+{
+  if (name == "random")
+    return InitMode::Random;
+  if (name == "exact")
+    return InitMode::Exact;
+
+  throw std::invalid_argument("Unknown initialization mode '" + name + "'");
+}
+
+
+std::ostream & operator<<(std::ostream &os, InitMode mode)
+{
+  switch (mode) {
+  case InitMode::Random: return os << "random";
+  case InitMode::Exact:  return os << "exact";
+  }
+  return os;
+}
+
+
+RoiMode RoiModeFromString(const std::string &name)
+{
+  if (name == "none")
+    return RoiMode::None;
+  if (name == "threshold")
+    return RoiMode::Threshold;
+  if (name == "labels")
+    return RoiMode::Labels;
+
+  throw std::invalid_argument("Unknown ROI mode '" + name + "'");
+}
+
+
+std::ostream & operator<<(std::ostream &os, RoiMode mode)
+{
+  switch (mode) {
+  case RoiMode::None:      return os << "none";
+  case RoiMode::Threshold: return os << "threshold";
+  case RoiMode::Labels:    return os << "labels";
+  }
+  return os;
+}
+
+
+PropagationMode PropagationModeFromString(const std::string &name)
+{
+  if (name == "serial")
+    return PropagationMode::Serial;
+  if (name == "async")
+    return PropagationMode::Async;
+
+  throw std::invalid_argument("Unknown propagation mode '" + name + "'");
+}
+
+
+std::ostream & operator<<(std::ostream &os, PropagationMode mode)
+{
+  switch (mode) {
+  case PropagationMode::Serial: return os << "serial";
+  case PropagationMode::Async:  return os << "async";
+  }
+  return os;
+}
 
 
 OPALSettings::OPALSettings(size_t _initWindowRadius,
@@ -12,21 +101,40 @@ OPALSettings::OPALSettings(size_t _initWindowRadius,
                            size_t _maxIter)
   : initWindowRadius(_initWindowRadius)
   , initWindowSide(2 * _initWindowRadius + 1)
+  , initMode(InitMode::Random)
+  , randomSeed(0)
   , patchRadius(_patchRadius)
   , patchSide(2 * _patchRadius + 1)
   , intermediateSaving(_intermediateSaving)
   , intermediateSavingPath(_savingPath)
   , maxIterations(_maxIter)
+  , propagationMode(PropagationMode::Serial)
+  , propagationThreads(0)
+  , labelEstimator(LabelEstimatorType::Dummy)
+  , roiMode(RoiMode::None)
+  , roiThreshold(0.0)
+  , consensusIteration(0)
+  , errorReportSamples(0)
 {
 }
 
 
 OPALSettings::OPALSettings(const std::map<std::string, std::string> &sets)
   : initWindowRadius(std::stoul(sets.at("initWindowRadius")))
+  , initMode(InitModeFromString(sets.at("initMode")))
+  , randomSeed(std::stoull(sets.at("randomSeed")))
   , patchRadius(std::stoul(sets.at("patchRadius")))
   , intermediateSaving(sets.at("intermediateSaving") == "true")
   , intermediateSavingPath(sets.at("intermediateSavingPath"))
   , maxIterations(std::stoul(sets.at("maxIterations")))
+  , propagationMode(PropagationModeFromString(sets.at("propagationMode")))
+  , propagationThreads(std::stoul(sets.at("propagationThreads")))
+  , checkpointPath(sets.at("checkpointPath"))
+  , labelEstimator(LabelEstimatorFromString(sets.at("labelEstimator")))
+  , roiMode(RoiModeFromString(sets.at("roiMode")))
+  , roiThreshold(std::stod(sets.at("roiThreshold")))
+  , consensusIteration(std::stoul(sets.at("consensusIteration")))
+  , errorReportSamples(std::stoul(sets.at("errorReportSamples")))
 {
   initWindowSide = 2 * initWindowRadius + 1;
   patchSide = 2 * patchRadius + 1;
@@ -37,10 +145,20 @@ std::map<std::string, std::string> OPALSettings::GetDefaultSetsMap()
 {
   return {
     { "initWindowRadius",       "10"    },
+    { "initMode",               "random"},
+    { "randomSeed",             "0"     },
     { "patchRadius",            "3"     },
     { "intermediateSaving",     "false" },
     { "intermediateSavingPath", ""      },
-    { "maxIterations",          "30"    }
+    { "maxIterations",          "30"    },
+    { "propagationMode",        "serial"},
+    { "propagationThreads",     "0"     },
+    { "checkpointPath",         ""      },
+    { "labelEstimator",         "dummy" },
+    { "roiMode",                "none"  },
+    { "roiThreshold",           "0"     },
+    { "consensusIteration",     "0"     },
+    { "errorReportSamples",     "0"     }
   };
 }
 
@@ -67,14 +185,53 @@ OPALSettings OPALSettings::ReadFromFile(const std::string &fileName)
 }
 
 
+uint64_t OPALSettings::GetHash() const
+{
+  // FNV-1a over the values. Saving and report options and number of
+  // iterations don't change results of the iterations done.
+  uint64_t hash = 14695981039346656037ULL;
+  auto mix = [&hash](uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      hash ^= (value >> (8 * i)) & 0xFF;
+      hash *= 1099511628211ULL;
+    }
+  };
+
+  uint64_t thresholdBits;
+  std::memcpy(&thresholdBits, &roiThreshold, sizeof(thresholdBits));
+
+  mix(initWindowRadius);
+  mix(static_cast<uint64_t>(initMode));
+  mix(randomSeed);
+  mix(patchRadius);
+  mix(static_cast<uint64_t>(roiMode));
+  mix(thresholdBits);
+  mix(consensusIteration);
+  // Number of threads isn't mixed, async runs aren't reproducible anyway.
+  mix(static_cast<uint64_t>(propagationMode));
+
+  return hash;
+}
+
+
 std::ostream & operator<<(std::ostream &os, const OPALSettings &sets)
 {
   os << "OPAL settings:"
      << '\n' << "initWindowRadius       = " << sets.initWindowRadius
+     << '\n' << "initMode               = " << sets.initMode
+     << '\n' << "randomSeed             = " << sets.randomSeed
      << '\n' << "patchRadius            = " << sets.patchRadius
      << '\n' << "intermediateSaving     = " << sets.intermediateSaving
      << '\n' << "intermediateSavingPath = " << sets.intermediateSavingPath
      << '\n' << "maxIterations          = " << sets.maxIterations
+     << '\n' << "propagationMode        = " << sets.propagationMode
+     << '\n' << "propagationThreads     = " << sets.propagationThreads
+     << '\n' << "checkpointPath         = " << sets.checkpointPath
+     << '\n' << "labelEstimator         = " << sets.labelEstimator
+     << '\n' << "roiMode                = " << sets.roiMode
+     << '\n' << "roiThreshold           = " << sets.roiThreshold
+     << '\n' << "consensusIteration     = " << sets.consensusIteration
+     << '\n' << "errorReportSamples     = " << sets.errorReportSamples
      << std::endl;
   return os;
 }
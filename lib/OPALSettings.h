@@ -11,10 +11,93 @@
 
 #pragma once
 
+#include <cstdint>
+#include <iosfwd>
 #include <string>
 #include <map>
 
 
+/**
+ * @brief Estimators of final labels from labels of matched patches.
+ *
+ * Named "dummy" and "maxVote" in settings files.
+ */
+enum class LabelEstimatorType {
+  Dummy,  ///< Label matched to the central pixel of the patch.
+  MaxVote ///< Label with the largest total weight of votes.
+};
+
+/**
+ * @returns Estimator type by its name in settings.
+ *
+ * @throws std::invalid_argument for unknown names.
+ */
+LabelEstimatorType LabelEstimatorFromString(const std::string &name);
+
+std::ostream & operator<<(std::ostream &os, LabelEstimatorType type);
+
+
+/**
+ * @brief Ways to find initial matches of pixels.
+ *
+ * Named "random" and "exact" in settings files.
+ */
+enum class InitMode {
+  Random, ///< Random matches within initialization window.
+  Exact   ///< Best matches within initialization window, see ExhaustiveSearch.
+};
+
+/**
+ * @returns Initialization mode by its name in settings.
+ *
+ * @throws std::invalid_argument for unknown names.
+ */
+InitMode InitModeFromString(const std::string &name);
+
+std::ostream & operator<<(std::ostream &os, InitMode mode);
+
+
+/**
+ * @brief Ways to find the region of interest OPAL works in.
+ *
+ * Named "none", "threshold" and "labels" in settings files.
+ */
+enum class RoiMode {
+  None,      ///< The whole image is processed.
+  Threshold, ///< Pixels of input image brighter than roiThreshold.
+  Labels     ///< Pixels labeled not 0 in any of templates.
+};
+
+/**
+ * @returns ROI mode by its name in settings.
+ *
+ * @throws std::invalid_argument for unknown names.
+ */
+RoiMode RoiModeFromString(const std::string &name);
+
+std::ostream & operator<<(std::ostream &os, RoiMode mode);
+
+
+/**
+ * @brief Ways to run propagation iterations.
+ *
+ * Named "serial" and "async" in settings files.
+ */
+enum class PropagationMode {
+  Serial, ///< One thread sweeps the whole image, results are reproducible.
+  Async   ///< Threads sweep strips of rows without locks, see OPAL.
+};
+
+/**
+ * @returns Propagation mode by its name in settings.
+ *
+ * @throws std::invalid_argument for unknown names.
+ */
+PropagationMode PropagationModeFromString(const std::string &name);
+
+std::ostream & operator<<(std::ostream &os, PropagationMode mode);
+
+
 /**
  * @brief A lightweight class containing various OPAL options.
  */
@@ -64,6 +147,13 @@ public:
    */
   friend std::ostream & operator<<(std::ostream &os, const OPALSettings &sets);
 
+  /**
+   * @returns Hash of settings the result of OPAL iterations depends on.
+   *
+   * Used to check that a checkpoint is resumed with compatible settings.
+   */
+  uint64_t GetHash() const;
+
 public:
   /**
    * @brief Radius of initialization window.
@@ -75,6 +165,22 @@ public:
   /// Side of inittialization window. initWindowSide = 2 * initWindowRadis + 1.
   size_t initWindowSide;
 
+  /**
+   * @brief How initial matches are found.
+   *
+   * InitMode::Exact starts propagation from the exact nearest neighbor field,
+   * which is slow for large images and libraries.
+   */
+  InitMode initMode;
+
+  /**
+   * @brief Seed of random initial matches.
+   *
+   * Matches of each pixel are drawn from its own stream of a counter-based
+   * generator, so they don't depend on order of pixels or number of threads.
+   */
+  uint64_t randomSeed;
+
   /**
    * @brief Radius of patches OPAL operates with.
    *
@@ -93,4 +199,50 @@ public:
 
   /// Maximum number of iterations performed.
   size_t maxIterations;
+
+  /**
+   * @brief How propagation iterations are run.
+   *
+   * Results of PropagationMode::Async depend on timing of threads, so they
+   * differ from run to run.
+   */
+  PropagationMode propagationMode;
+
+  /// Threads of PropagationMode::Async, 0 for all hardware threads.
+  size_t propagationThreads;
+
+  /// File to save a checkpoint to after each iteration, none if empty.
+  std::string checkpointPath;
+
+  /// Estimator of final labels used to build segmentation.
+  LabelEstimatorType labelEstimator;
+
+  /**
+   * @brief Region of interest mode.
+   *
+   * Pixels out of the region get label 0. Only the ones in patches of
+   * region pixels are matched.
+   */
+  RoiMode roiMode;
+
+  /// Intensity threshold of RoiMode::Threshold.
+  double roiThreshold;
+
+  /**
+   * @brief First iteration after which unanimous pixels are settled.
+   *
+   * After this many iterations and each later one, pixels whose whole patch
+   * is matched to a single label stop propagating and get that label
+   * without fusion. 0 disables settling.
+   */
+  size_t consensusIteration;
+
+  /**
+   * @brief Number of pixels to compare with the exact nearest neighbors.
+   *
+   * Mean cost gap and fraction of pixels at the exact optimum are reported
+   * after initialization and each iteration, see ExhaustiveSearch.
+   * 0 disables the report.
+   */
+  size_t errorReportSamples;
 };
@@ -0,0 +1,102 @@
+/**
+ * @file lib/PackedMatch.h
+ *
+ * @brief Header file with definition of PackedMatchCodec class.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+/**
+ * @brief Match of a pixel and its cost packed into a 64-bit word.
+ *
+ * Whole matches fit into one word, so threads can publish them with a single
+ * atomic store or compare-and-swap and never see a torn match.
+ *
+ * High 32 bits are the cost as float. Low 32 bits are template index and
+ * offsets, their widths are the least ones for the images: offsets of
+ * destinations inside the image are in [-(side - 1), side - 1].
+ */
+class PackedMatchCodec {
+public:
+  /// Unpacked word.
+  struct Match {
+    size_t t;
+    int    offsetX;
+    int    offsetY;
+    float  cost;
+  };
+
+  /**
+   * @param [in] imageCount Number of pairs in the database, templates are
+   *                        1 .. imageCount - 1.
+   * @param [in] height, width Size of images.
+   *
+   * @throws std::logic_error if matches don't fit into 32 bits.
+   */
+  PackedMatchCodec(size_t imageCount, size_t height, size_t width)
+    : BiasX(static_cast<int>(width) - 1)
+    , BiasY(static_cast<int>(height) - 1)
+    , BitsX(BitsFor(2 * width - 1))
+    , BitsY(BitsFor(2 * height - 1))
+  {
+    if (BitsFor(imageCount) + BitsX + BitsY > 32)
+      throw std::logic_error("Matches of these images don't fit into 32 bits!");
+  }
+
+  /// Costs above the float range become infinite.
+  uint64_t Pack(size_t t, int offsetX, int offsetY, double cost) const {
+    const float value = cost > std::numeric_limits<float>::max()
+      ? std::numeric_limits<float>::infinity()
+      : static_cast<float>(cost);
+
+    uint32_t costBits;
+    std::memcpy(&costBits, &value, sizeof(costBits));
+
+    const uint64_t match =
+      (uint64_t(t) << (BitsX + BitsY)) |
+      (uint64_t(offsetX + BiasX) << BitsY) |
+      uint64_t(offsetY + BiasY);
+
+    return (uint64_t(costBits) << 32) | match;
+  }
+
+  Match Unpack(uint64_t word) const {
+    const uint64_t match = word & 0xFFFFFFFFULL;
+    const uint64_t maskX = (uint64_t(1) << BitsX) - 1;
+    const uint64_t maskY = (uint64_t(1) << BitsY) - 1;
+
+    Match result;
+    result.t = static_cast<size_t>(match >> (BitsX + BitsY));
+    result.offsetX = static_cast<int>((match >> BitsY) & maskX) - BiasX;
+    result.offsetY = static_cast<int>(match & maskY) - BiasY;
+    result.cost = Cost(word);
+    return result;
+  }
+
+  static float Cost(uint64_t word) {
+    const uint32_t costBits = static_cast<uint32_t>(word >> 32);
+    float cost;
+    std::memcpy(&cost, &costBits, sizeof(cost));
+    return cost;
+  }
+
+private:
+  /// @returns Least number of bits to store @p values different values.
+  static unsigned BitsFor(size_t values) {
+    unsigned bits = 0;
+    while (bits < 64 && (uint64_t(1) << bits) < values)
+      ++bits;
+    return bits;
+  }
+
+  int      BiasX;
+  int      BiasY;
+  unsigned BitsX;
+  unsigned BitsY;
+};
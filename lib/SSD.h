@@ -12,6 +12,46 @@
 #include <cassert>
 #include <cstddef>
 
+
+namespace detail {
+
+/// Calls f(0), ..., f(N-1) without a loop.
+template <size_t N>
+struct StaticFor {
+  template <class F>
+  static void Run(F &f) {
+    StaticFor<N - 1>::Run(f);
+    f(N - 1);
+  }
+};
+
+template <>
+struct StaticFor<0> {
+  template <class F>
+  static void Run(F &) {}
+};
+
+
+/// Loop over side of a patch, unrolled if radius is known at compile time.
+template <size_t Radius>
+struct PatchLoop {
+  template <class F>
+  static void Run(size_t, F &f) { StaticFor<2 * Radius + 1>::Run(f); }
+};
+
+/// Radius 0 stands for radius known at run time only.
+template <>
+struct PatchLoop<0> {
+  template <class F>
+  static void Run(size_t side, F &f) {
+    for (size_t k = 0; k < side; ++k)
+      f(k);
+  }
+};
+
+} // namespace detail
+
+
 /**
  * @brief Class responsible for SSD calculation between patches of images.
  *
@@ -25,6 +65,10 @@
  * Needs only index of a single image in database (>= 1) because the other image
  * is always Database[0] (image to be segmented).
  *
+ * Shifts can be instantiated for a fixed patch radius, which gives fully
+ * unrolled loops over the patch side. The radius must match the one given at
+ * construction, DYNAMIC_RADIUS (default) works with any radius.
+ *
  * @tparam TDb Type of image database. Must be ImageDatabase.
  */
 template <class TDb>
@@ -33,6 +77,9 @@ public:
   using ValueType = typename TDb::ImgPixelType;
   using ImgType   = typename TDb::ImgType;
 
+  /// Radius argument of kernels using the radius given at construction.
+  static constexpr size_t DYNAMIC_RADIUS = 0;
+
 public:
   // Constructors and destructors.
 
@@ -43,7 +90,8 @@ public:
    *
    * Calculates coordinates of top-left corners of patches on images.
    * Patches must lay inside the images, i. e. @p ctrFixedX >= @p radius,
-   * ctrFixedX < imageWidth - @p radius, similarly for Y coordinates.
+   * ctrFixedX < imageWidth - @p radius, similarly for Y coordinates, or
+   * inside ghost pixels of padded images.
    *
    * @param [in] db Database of images
    * @param [in] idx Index of moving image in database, must be >= 1
@@ -57,6 +105,27 @@ public:
       size_t ctrFixedX, size_t ctrFixedY, size_t ctrMovingX, size_t ctrMovingY,
       size_t radius);
 
+  /**
+   * @brief Constructor with a value given instead of calculated.
+   *
+   * Patches are not read, shifts update @p knownValue as usual.
+   */
+  SSD(const TDb &db, size_t idx,
+      size_t ctrFixedX, size_t ctrFixedY, size_t ctrMovingX, size_t ctrMovingY,
+      size_t radius, ValueType knownValue);
+
+  /**
+   * @brief SSD calculated by kernels for patch radius @p Radius, see the
+   * first constructor.
+   *
+   * @p radius must match @p Radius, unless it is DYNAMIC_RADIUS. Results are
+   * the same as the ones of the constructor.
+   */
+  template <size_t Radius>
+  static SSD Calculate(const TDb &db, size_t idx,
+                       size_t ctrFixedX, size_t ctrFixedY,
+                       size_t ctrMovingX, size_t ctrMovingY, size_t radius);
+
   ~SSD() = default;
 
 public:
@@ -77,6 +146,14 @@ public:
    */
   inline bool operator <(const SSD &other) const;
 
+  /**
+   * @brief Replace the cached value without recalculation.
+   *
+   * Used to restore a value saved in a checkpoint, so that following shifts
+   * give exactly the same results as in the original run.
+   */
+  inline void SetValue(ValueType newValue);
+
 public:
   // Methods for efficient update.
 
@@ -85,6 +162,7 @@ public:
    *
    * @returns Calculated flag.
    */
+  template <size_t Radius = DYNAMIC_RADIUS>
   ValueType ShiftRight();
 
   /**
@@ -92,6 +170,7 @@ public:
    *
    * @returns Calculated flag.
    */
+  template <size_t Radius = DYNAMIC_RADIUS>
   ValueType ShiftLeft();
 
   /**
@@ -99,6 +178,7 @@ public:
    *
    * @returns Calculated flag.
    */
+  template <size_t Radius = DYNAMIC_RADIUS>
   ValueType ShiftUp();
 
   /**
@@ -106,6 +186,7 @@ public:
    *
    * @returns Calculated flag.
    */
+  template <size_t Radius = DYNAMIC_RADIUS>
   ValueType ShiftDown();
 
   /**
@@ -113,13 +194,13 @@ public:
    *
    * @returns Calculated flag.
    */
+  template <size_t Radius = DYNAMIC_RADIUS>
   ValueType ShiftImage(const ImgType *img);
 
 private:
 
-  /**
-   * @todo Documentation.
-   */
+  /// Calculate SSD from scratch.
+  template <size_t Radius = DYNAMIC_RADIUS>
   void CalculateValue();
 
   /**
@@ -180,6 +261,39 @@ SSD<TDb>::SSD(const TDb &db, size_t idx,
 }
 
 
+template <class TDb>
+SSD<TDb>::SSD(const TDb &db, size_t idx,
+              size_t ctrFixedX, size_t ctrFixedY,
+              size_t ctrMovingX, size_t ctrMovingY,
+              size_t radius, ValueType knownValue)
+  : fixedImageIt(&db.GetImage(0))
+  , movingImageIt(&db.GetImage(idx))
+  , patchSide(2 * radius + 1)
+  , fixedTopLeftX(ctrFixedX - radius)
+  , fixedTopLeftY(ctrFixedY - radius)
+  , movingTopLeftX(ctrMovingX - radius)
+  , movingTopLeftY(ctrMovingY - radius)
+  , value(knownValue)
+{
+  assert(idx > 0 && "SSD between patches of 0-th image in database!");
+  assert(fixedImageIt && movingImageIt && "One of image pointers is null!");
+}
+
+
+template <class TDb>
+template <size_t Radius>
+SSD<TDb> SSD<TDb>::Calculate(const TDb &db, size_t idx,
+                             size_t ctrFixedX, size_t ctrFixedY,
+                             size_t ctrMovingX, size_t ctrMovingY,
+                             size_t radius)
+{
+  SSD result(db, idx, ctrFixedX, ctrFixedY, ctrMovingX, ctrMovingY, radius,
+             ValueType());
+  result.template CalculateValue<Radius>();
+  return result;
+}
+
+
 template <class TDb>
 typename SSD<TDb>::ValueType SSD<TDb>::GetValue() const
 {
@@ -202,9 +316,20 @@ bool SSD<TDb>::operator <(const SSD &other) const
 
 
 template <class TDb>
+void SSD<TDb>::SetValue(ValueType newValue)
+{
+  value = newValue;
+}
+
+
+template <class TDb>
+template <size_t Radius>
 typename SSD<TDb>::ValueType SSD<TDb>::ShiftRight()
 {
-  for (size_t dy = 0; dy < patchSide; ++dy) {
+  assert((Radius == DYNAMIC_RADIUS || 2 * Radius + 1 == patchSide) &&
+         "Kernel radius doesn't match the patch!");
+
+  auto step = [this](size_t dy) {
     // Step to new place (1 px right the right side), add it.
     ValueType diff1 =
       (*fixedImageIt)(fixedTopLeftY + dy, fixedTopLeftX + patchSide) -
@@ -216,7 +341,9 @@ typename SSD<TDb>::ValueType SSD<TDb>::ShiftRight()
       (*movingImageIt)(movingTopLeftY + dy, movingTopLeftX);
 
     value += (diff1 * diff1 - diff2 * diff2);
-  }
+  };
+  detail::PatchLoop<Radius>::Run(patchSide, step);
+
   ++fixedTopLeftX;
   ++movingTopLeftX;
 
@@ -225,9 +352,13 @@ typename SSD<TDb>::ValueType SSD<TDb>::ShiftRight()
 
 
 template <class TDb>
+template <size_t Radius>
 typename SSD<TDb>::ValueType SSD<TDb>::ShiftLeft()
 {
-  for (size_t dy = 0; dy < patchSide; ++dy) {
+  assert((Radius == DYNAMIC_RADIUS || 2 * Radius + 1 == patchSide) &&
+         "Kernel radius doesn't match the patch!");
+
+  auto step = [this](size_t dy) {
     // Step to new place (1 px left the left side), add it.
     ValueType diff1 =
       (*fixedImageIt)(fixedTopLeftY + dy, fixedTopLeftX - 1) -
@@ -239,7 +370,9 @@ typename SSD<TDb>::ValueType SSD<TDb>::ShiftLeft()
       (*movingImageIt)(movingTopLeftY + dy, movingTopLeftX + patchSide - 1);
 
     value += (diff1 * diff1 - diff2 * diff2);
-  }
+  };
+  detail::PatchLoop<Radius>::Run(patchSide, step);
+
   --fixedTopLeftX;
   --movingTopLeftX;
 
@@ -248,21 +381,31 @@ typename SSD<TDb>::ValueType SSD<TDb>::ShiftLeft()
 
 
 template <class TDb>
+template <size_t Radius>
 typename SSD<TDb>::ValueType SSD<TDb>::ShiftUp()
 {
-  for (size_t dx = 0; dx < patchSide; ++dx) {
+  assert((Radius == DYNAMIC_RADIUS || 2 * Radius + 1 == patchSide) &&
+         "Kernel radius doesn't match the patch!");
+
+  // Rows don't change along the side, take them once.
+  const auto *fixedNew  = &(*fixedImageIt)(fixedTopLeftY - 1, fixedTopLeftX);
+  const auto *movingNew = &(*movingImageIt)(movingTopLeftY - 1, movingTopLeftX);
+  const auto *fixedOld  =
+    &(*fixedImageIt)(fixedTopLeftY + patchSide - 1, fixedTopLeftX);
+  const auto *movingOld =
+    &(*movingImageIt)(movingTopLeftY + patchSide - 1, movingTopLeftX);
+
+  auto step = [&](size_t dx) {
     // Step to new place (1 px up the upper side), add it.
-    ValueType diff1 =
-      (*fixedImageIt)(fixedTopLeftY - 1, fixedTopLeftX + dx) -
-      (*movingImageIt)(movingTopLeftY - 1, movingTopLeftX + dx);
+    ValueType diff1 = fixedNew[dx] - movingNew[dx];
 
     // Step from old place (the lower side), subtract it.
-    ValueType diff2 =
-      (*fixedImageIt)(fixedTopLeftY + patchSide - 1, fixedTopLeftX + dx) -
-      (*movingImageIt)(movingTopLeftY + patchSide - 1, movingTopLeftX + dx);
+    ValueType diff2 = fixedOld[dx] - movingOld[dx];
 
     value += (diff1 * diff1 - diff2 * diff2);
-  }
+  };
+  detail::PatchLoop<Radius>::Run(patchSide, step);
+
   --fixedTopLeftY;
   --movingTopLeftY;
 
@@ -271,21 +414,31 @@ typename SSD<TDb>::ValueType SSD<TDb>::ShiftUp()
 
 
 template <class TDb>
+template <size_t Radius>
 typename SSD<TDb>::ValueType SSD<TDb>::ShiftDown()
 {
-  for (size_t dx = 0; dx < patchSide; ++dx) {
+  assert((Radius == DYNAMIC_RADIUS || 2 * Radius + 1 == patchSide) &&
+         "Kernel radius doesn't match the patch!");
+
+  // Rows don't change along the side, take them once.
+  const auto *fixedNew =
+    &(*fixedImageIt)(fixedTopLeftY + patchSide, fixedTopLeftX);
+  const auto *movingNew =
+    &(*movingImageIt)(movingTopLeftY + patchSide, movingTopLeftX);
+  const auto *fixedOld  = &(*fixedImageIt)(fixedTopLeftY, fixedTopLeftX);
+  const auto *movingOld = &(*movingImageIt)(movingTopLeftY, movingTopLeftX);
+
+  auto step = [&](size_t dx) {
     // Step to new place (1 px down the lower side), add it.
-    ValueType diff1 =
-      (*fixedImageIt)(fixedTopLeftY + patchSide, fixedTopLeftX + dx) -
-      (*movingImageIt)(movingTopLeftY + patchSide, movingTopLeftX + dx);
+    ValueType diff1 = fixedNew[dx] - movingNew[dx];
 
     // Step from old place (upper side), subtract it.
-    ValueType diff2 =
-      (*fixedImageIt)(fixedTopLeftY, fixedTopLeftX + dx) -
-      (*movingImageIt)(movingTopLeftY, movingTopLeftX + dx);
+    ValueType diff2 = fixedOld[dx] - movingOld[dx];
 
     value += (diff1 * diff1 - diff2 * diff2);
-  }
+  };
+  detail::PatchLoop<Radius>::Run(patchSide, step);
+
   ++fixedTopLeftY;
   ++movingTopLeftY;
 
@@ -294,26 +447,44 @@ typename SSD<TDb>::ValueType SSD<TDb>::ShiftDown()
 
 
 template <class TDb>
+template <size_t Radius>
 typename SSD<TDb>::ValueType SSD<TDb>::ShiftImage(const typename SSD<TDb>::ImgType *img)
 {
   assert(img && "New image pointer is null!");
 
   movingImageIt = img;
-  CalculateValue();
+  CalculateValue<Radius>();
 
   return value;
 }
 
 
 template <class TDb>
+template <size_t Radius>
 void SSD<TDb>::CalculateValue()
 {
+  assert((Radius == DYNAMIC_RADIUS || 2 * Radius + 1 == patchSide) &&
+         "Kernel radius doesn't match the patch!");
+
   value = 0;
-  for (size_t dy = 0; dy < patchSide; ++dy)
-    for (size_t dx = 0; dx < patchSide; ++dx) {
-      ValueType diff = (*fixedImageIt)(fixedTopLeftY + dy, fixedTopLeftX + dx) -
-                       (*movingImageIt)(movingTopLeftY + dy, movingTopLeftX + dx);
+
+  auto addRow = [this](size_t dy) {
+    // Patch may cover ghost pixels of padded images, so rows are addressed
+    // from the pixel rather than through row().
+    const auto *fixedRow =
+      &(*fixedImageIt)(fixedTopLeftY + dy, fixedTopLeftX);
+    const auto *movingRow =
+      &(*movingImageIt)(movingTopLeftY + dy, movingTopLeftX);
+
+    auto addPixel = [&](size_t dx) {
+      ValueType diff = fixedRow[dx] - movingRow[dx];
       value += diff * diff;
-    }
+    };
+    detail::PatchLoop<Radius>::Run(patchSide, addPixel);
+  };
+  detail::PatchLoop<Radius>::Run(patchSide, addRow);
 }
 
+
+template <class TDb>
+constexpr size_t SSD<TDb>::DYNAMIC_RADIUS;
@@ -1,57 +1,238 @@
 #pragma once
 
 #include "Image.h"
+#include "LabelTable.h"
 
+#include "util/thread/ParallelFor.h"
+
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 #include <map>
+#include <vector>
+
+
+/// Overlap measures of a single label.
+struct LabelAccuracy {
+  size_t truthCount  = 0; ///< Pixels of the label in ground truth.
+  size_t resultCount = 0; ///< Pixels of the label in result.
+  size_t overlap     = 0; ///< Pixels of the label in both.
+
+  double dice        = 0.0; ///< 2|A&B| / (|A| + |B|).
+  double jaccard     = 0.0; ///< |A&B| / |A or B|.
+  double sensitivity = 0.0; ///< |A&B| / |A|, 0 if the label is not in A.
+  double precision   = 0.0; ///< |A&B| / |B|, 0 if the label is not in B.
+
+  /// (|B| - |A|) / |A|, infinity if the label is not in A.
+  double volumeDifference = 0.0;
+};
 
 
 template <class T, class Enable = void>
 class SegmentationAccuracyEstimator;
 
+/**
+ * @brief Accuracy of segmentations against ground truth.
+ *
+ * Labels of both images get dense indices and pixels are counted into
+ * a confusion matrix in one pass, bands of rows are counted by threads
+ * into their own matrices. All measures are derived from the matrix.
+ */
 template <class T>
 class SegmentationAccuracyEstimator<
         T, typename std::enable_if<std::is_integral<T>::value>::type>
 {
 public:
+  using AccuracyMap = std::map<T, LabelAccuracy>;
+
   SegmentationAccuracyEstimator() = default;
   ~SegmentationAccuracyEstimator() = default;
-  
-  void Estimate(const Image<T> &src, const Image<T> &dst) {
-    if (src.getWidth() != dst.getWidth() || src.getHeight() != dst.getHeight())
-      throw std::invalid_argument("Image dimensions mismatch!");
-    
-    Clear();
-    
-    for (size_t i = 0; i < src.getSize(); ++i) {
-      auto srcLabel = src[i];
-      auto dstLabel = dst[i];
-      DiceScoresPerLabel[srcLabel] = DiceScoresPerLabel[dstLabel] = 0;
-      ++SrcPixelPerLabelCount[srcLabel];
-      ++DstPixelPerLabelCount[dstLabel];
-      if (srcLabel == dstLabel)
-        ++BothPixelPerLabelCount[srcLabel];
-    }
-    
-    for (const auto &l : BothPixelPerLabelCount) {
-      auto A = SrcPixelPerLabelCount.at(l.first);
-      auto B = DstPixelPerLabelCount.at(l.first);
-      DiceScoresPerLabel.at(l.first) = double(2 * l.second) / double(A + B);
-    }
+
+  /**
+   * @param [in] src Ground truth.
+   * @param [in] dst Segmentation to be estimated.
+   *
+   * @throws std::invalid_argument if sizes of images differ.
+   */
+  void Estimate(const Image<T> &src, const Image<T> &dst,
+                size_t threadCount = util::HardwareConcurrency());
+
+  /**
+   * @brief Estimate many cases, each case is estimated by a single thread.
+   *
+   * @returns Measures of every case, in order of @p truths.
+   *
+   * @throws std::invalid_argument if counts of images or sizes of images of
+   * a case differ.
+   */
+  static std::vector<AccuracyMap>
+  EstimateBatch(const std::vector<Image<T>> &truths,
+                const std::vector<Image<T>> &results,
+                size_t threadCount = util::HardwareConcurrency());
+
+  /// @returns Dice scores of labels found in any of the images.
+  std::map<T, double> GetDiceScoreMap() const;
+
+  /// @returns All measures of labels found in any of the images.
+  AccuracyMap GetAccuracyMap() const;
+
+  /// Labels of the last estimation, indices of the confusion matrix.
+  const LabelTable<T>& GetLabels() const { return Labels; }
+
+  /// @returns Count of pixels labeled @p truth in src and @p result in dst.
+  size_t GetConfusion(const T &truth, const T &result) const {
+    return Confusion[Labels.IndexOf(truth) * Labels.GetSize() +
+                     Labels.IndexOf(result)];
   }
-  
-  std::map<T, double> GetDiceScoreMap() const { return DiceScoresPerLabel; }
 
 private:
+  /// Add pixels of rows [firstRow, lastRow) to @p confusion.
+  void CountRows(const Image<T> &src, const Image<T> &dst,
+                 size_t firstRow, size_t lastRow,
+                 std::vector<size_t> &confusion) const;
+
   void Clear() {
-    SrcPixelPerLabelCount.clear();
-    DstPixelPerLabelCount.clear();
-    BothPixelPerLabelCount.clear();
-    DiceScoresPerLabel.clear();
+    Labels.Clear();
+    Confusion.clear();
   }
 
-  std::map<T, size_t> SrcPixelPerLabelCount;
-  std::map<T, size_t> DstPixelPerLabelCount;
-  std::map<T, size_t> BothPixelPerLabelCount;
-  std::map<T, double> DiceScoresPerLabel;
+  LabelTable<T> Labels;
+
+  /// Confusion[truth * L + result], indices of Labels.
+  std::vector<size_t> Confusion;
 };
+
+
+// ===== Implementation below =====
+
+template <class T>
+void SegmentationAccuracyEstimator<
+       T, typename std::enable_if<std::is_integral<T>::value>::type>
+::Estimate(const Image<T> &src, const Image<T> &dst, size_t threadCount)
+{
+  if (src.getWidth() != dst.getWidth() || src.getHeight() != dst.getHeight())
+    throw std::invalid_argument("Image dimensions mismatch!");
+
+  Clear();
+  Labels.Insert(src);
+  Labels.Insert(dst);
+
+  const size_t L = Labels.GetSize();
+  const size_t height = src.getHeight();
+  Confusion.assign(L * L, 0);
+
+  // Each band counts into its own matrix, so there are as few as possible.
+  const size_t bands = std::max<size_t>(1, std::min(threadCount, height));
+  std::vector<std::vector<size_t>> partial(bands - 1);
+  util::ParallelFor(0, bands, [&](size_t band) {
+    auto &confusion = band ? partial[band - 1] : Confusion;
+    confusion.resize(L * L, 0);
+    CountRows(src, dst, height * band / bands, height * (band + 1) / bands,
+              confusion);
+  }, bands);
+
+  for (const auto &confusion : partial)
+    for (size_t k = 0; k < Confusion.size(); ++k)
+      Confusion[k] += confusion[k];
+}
+
+
+template <class T>
+void SegmentationAccuracyEstimator<
+       T, typename std::enable_if<std::is_integral<T>::value>::type>
+::CountRows(const Image<T> &src, const Image<T> &dst,
+            size_t firstRow, size_t lastRow,
+            std::vector<size_t> &confusion) const
+{
+  const size_t L = Labels.GetSize();
+
+  for (size_t i = firstRow; i < lastRow; ++i) {
+    auto srcRow = src.row(i);
+    auto dstRow = dst.row(i);
+    size_t truth = 0, result = 0;
+    for (size_t j = 0; j < srcRow.size(); ++j) {
+      // Labels come in runs, skip repeated lookups.
+      if (j == 0 || srcRow[j] != srcRow[j - 1])
+        truth = Labels.IndexOf(srcRow[j]);
+      if (j == 0 || dstRow[j] != dstRow[j - 1])
+        result = Labels.IndexOf(dstRow[j]);
+      ++confusion[truth * L + result];
+    }
+  }
+}
+
+
+template <class T>
+std::vector<typename SegmentationAccuracyEstimator<
+  T, typename std::enable_if<std::is_integral<T>::value>::type>::AccuracyMap>
+SegmentationAccuracyEstimator<
+  T, typename std::enable_if<std::is_integral<T>::value>::type>
+::EstimateBatch(const std::vector<Image<T>> &truths,
+                const std::vector<Image<T>> &results, size_t threadCount)
+{
+  if (truths.size() != results.size())
+    throw std::invalid_argument("Counts of images mismatch!");
+
+  std::vector<AccuracyMap> accuracies(truths.size());
+  util::ParallelFor(0, truths.size(), [&](size_t k) {
+    SegmentationAccuracyEstimator estimator;
+    estimator.Estimate(truths[k], results[k], 1);
+    accuracies[k] = estimator.GetAccuracyMap();
+  }, threadCount);
+  return accuracies;
+}
+
+
+template <class T>
+std::map<T, double> SegmentationAccuracyEstimator<
+  T, typename std::enable_if<std::is_integral<T>::value>::type>
+::GetDiceScoreMap() const
+{
+  std::map<T, double> scores;
+  for (const auto &l : GetAccuracyMap())
+    scores.emplace(l.first, l.second.dice);
+  return scores;
+}
+
+
+template <class T>
+typename SegmentationAccuracyEstimator<
+  T, typename std::enable_if<std::is_integral<T>::value>::type>::AccuracyMap
+SegmentationAccuracyEstimator<
+  T, typename std::enable_if<std::is_integral<T>::value>::type>
+::GetAccuracyMap() const
+{
+  const size_t L = Labels.GetSize();
+
+  // Margins of the matrix are pixel counts of labels.
+  std::vector<size_t> truthCounts(L, 0), resultCounts(L, 0);
+  for (size_t a = 0; a < L; ++a)
+    for (size_t b = 0; b < L; ++b) {
+      truthCounts[a] += Confusion[a * L + b];
+      resultCounts[b] += Confusion[a * L + b];
+    }
+
+  AccuracyMap accuracies;
+  for (size_t k = 0; k < L; ++k) {
+    LabelAccuracy acc;
+    acc.truthCount = truthCounts[k];
+    acc.resultCount = resultCounts[k];
+    acc.overlap = Confusion[k * L + k];
+
+    const double A = static_cast<double>(acc.truthCount);
+    const double B = static_cast<double>(acc.resultCount);
+    const double AB = static_cast<double>(acc.overlap);
+
+    // Labels are in the table only if they have pixels, so A + B > 0.
+    acc.dice = 2.0 * AB / (A + B);
+    acc.jaccard = AB / (A + B - AB);
+    acc.sensitivity = acc.truthCount ? AB / A : 0.0;
+    acc.precision = acc.resultCount ? AB / B : 0.0;
+    acc.volumeDifference = acc.truthCount
+      ? (B - A) / A
+      : std::numeric_limits<double>::infinity();
+
+    accuracies.emplace(Labels[k], acc);
+  }
+  return accuracies;
+}
@@ -0,0 +1,244 @@
+/**
+ * @file lib/SurfaceDistanceEstimator.h
+ *
+ * @brief Header file with definition of SurfaceDistanceEstimator class.
+ */
+
+
+#pragma once
+
+#include "DistanceTransform.h"
+#include "Image.h"
+#include "LabelTable.h"
+
+#include "util/thread/ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+
+/// Distances between surfaces of a label in two segmentations, in pixels.
+struct SurfaceDistance {
+  size_t truthSurface  = 0; ///< Surface pixels of the label in ground truth.
+  size_t resultSurface = 0; ///< Surface pixels of the label in result.
+
+  double hausdorff   = 0.0; ///< Largest distance.
+  double hausdorff95 = 0.0; ///< 95th percentile of distances.
+  double averageSymmetric = 0.0; ///< Mean of distances, ASSD.
+};
+
+
+/**
+ * @brief Surface distances of labels of a segmentation to ground truth.
+ *
+ * Surface of a label is its pixels which have a 4-neighbor with another
+ * label, pixels outside the image count as label T(). Distances from
+ * surface pixels of each image to the surface of the other one are read
+ * from Euclidean distance transforms, and both sets of distances are pooled
+ * for the measures. If only one image has surface of a label, distances are
+ * infinite.
+ *
+ * Transforms are computed in the bounding box of the label in both images,
+ * which gives exact distances, and labels are shared between threads.
+ *
+ * @tparam T Type of labels.
+ */
+template <class T>
+class SurfaceDistanceEstimator {
+public:
+  using DistanceMap = std::map<T, SurfaceDistance>;
+
+  SurfaceDistanceEstimator() = default;
+
+  /**
+   * @param [in] src Ground truth.
+   * @param [in] dst Segmentation to be estimated.
+   *
+   * @throws std::invalid_argument if sizes of images differ.
+   */
+  void Estimate(const Image<T> &src, const Image<T> &dst,
+                size_t threadCount = util::HardwareConcurrency());
+
+  /// @returns Distances of labels found in any of the images.
+  const DistanceMap& GetDistanceMap() const { return Distances; }
+
+private:
+  /// Bounding box of a label, [Top, Bottom) x [Left, Right).
+  struct Box {
+    size_t Top;
+    size_t Bottom;
+    size_t Left;
+    size_t Right;
+  };
+
+  /// @returns True if pixel (i,j) of @p seg is on the surface of its label.
+  static bool IsSurface(const Image<T> &seg, size_t i, size_t j);
+
+  /// Mark surface pixels of @p label of @p seg in @p box.
+  static size_t FindSurface(const Image<T> &seg, const T &label,
+                            const Box &box, Image<uint8_t> &surface);
+
+  /// Append distances from @p from surface to the one of @p distances.
+  static void CollectDistances(const Image<uint8_t> &from,
+                               const Image<double> &distances,
+                               std::vector<double> &result);
+
+  static SurfaceDistance EstimateLabel(const Image<T> &src,
+                                       const Image<T> &dst,
+                                       const T &label, const Box &box);
+
+private:
+  DistanceMap Distances;
+};
+
+
+// ===== Implementation below =====
+
+template <class T>
+void SurfaceDistanceEstimator<T>::Estimate(const Image<T> &src,
+                                           const Image<T> &dst,
+                                           size_t threadCount)
+{
+  if (src.getWidth() != dst.getWidth() || src.getHeight() != dst.getHeight())
+    throw std::invalid_argument("Image dimensions mismatch!");
+
+  Distances.clear();
+
+  // Bounding boxes of labels in both images, one lookup per run of a label.
+  LabelTable<T> labels;
+  std::vector<Box> boxes;
+  for (const auto *seg : { &src, &dst }) {
+    for (size_t i = 0; i < seg->getHeight(); ++i) {
+      auto segRow = seg->row(i);
+      for (size_t j = 0; j < segRow.size(); ) {
+        size_t end = j + 1;
+        while (end < segRow.size() && segRow[end] == segRow[j])
+          ++end;
+
+        size_t index = labels.Insert(segRow[j]);
+        if (index == boxes.size())
+          boxes.push_back(Box{ i, i + 1, j, end });
+
+        Box &box = boxes[index];
+        box.Top = std::min(box.Top, i);
+        box.Bottom = std::max(box.Bottom, i + 1);
+        box.Left = std::min(box.Left, j);
+        box.Right = std::max(box.Right, end);
+        j = end;
+      }
+    }
+  }
+
+  std::vector<SurfaceDistance> distances(labels.GetSize());
+  util::ParallelFor(0, labels.GetSize(), [&](size_t k) {
+    distances[k] = EstimateLabel(src, dst, labels[k], boxes[k]);
+  }, threadCount);
+
+  for (size_t k = 0; k < labels.GetSize(); ++k)
+    Distances.emplace(labels[k], distances[k]);
+}
+
+
+template <class T>
+bool SurfaceDistanceEstimator<T>::IsSurface(const Image<T> &seg,
+                                            size_t i, size_t j)
+{
+  const T &label = seg(i, j);
+  auto neighbor = [&](size_t y, size_t x) {
+    bool inside = y < seg.getHeight() && x < seg.getWidth();
+    return inside ? seg(y, x) : T();
+  };
+
+  // Coordinates of -1 wrap around and are outside the image.
+  return neighbor(i - 1, j) != label || neighbor(i + 1, j) != label ||
+         neighbor(i, j - 1) != label || neighbor(i, j + 1) != label;
+}
+
+
+template <class T>
+size_t SurfaceDistanceEstimator<T>::FindSurface(const Image<T> &seg,
+                                                const T &label,
+                                                const Box &box,
+                                                Image<uint8_t> &surface)
+{
+  surface = Image<uint8_t>(box.Bottom - box.Top, box.Right - box.Left, 0);
+
+  size_t count = 0;
+  for (size_t i = box.Top; i < box.Bottom; ++i) {
+    auto segRow = seg.row(i);
+    for (size_t j = box.Left; j < box.Right; ++j)
+      if (segRow[j] == label && IsSurface(seg, i, j)) {
+        surface(i - box.Top, j - box.Left) = 1;
+        ++count;
+      }
+  }
+  return count;
+}
+
+
+template <class T>
+void SurfaceDistanceEstimator<T>::CollectDistances(
+  const Image<uint8_t> &from, const Image<double> &distances,
+  std::vector<double> &result)
+{
+  for (size_t i = 0; i < from.getHeight(); ++i) {
+    auto fromRow = from.row(i);
+    auto distanceRow = distances.row(i);
+    for (size_t j = 0; j < fromRow.size(); ++j)
+      if (fromRow[j])
+        result.push_back(std::sqrt(distanceRow[j]));
+  }
+}
+
+
+template <class T>
+SurfaceDistance SurfaceDistanceEstimator<T>::EstimateLabel(
+  const Image<T> &src, const Image<T> &dst, const T &label, const Box &box)
+{
+  SurfaceDistance result;
+
+  Image<uint8_t> srcSurface, dstSurface;
+  result.truthSurface = FindSurface(src, label, box, srcSurface);
+  result.resultSurface = FindSurface(dst, label, box, dstSurface);
+
+  if (!result.truthSurface && !result.resultSurface)
+    return result;
+
+  if (!result.truthSurface || !result.resultSurface) {
+    const double INF = std::numeric_limits<double>::infinity();
+    result.hausdorff = result.hausdorff95 = result.averageSymmetric = INF;
+    return result;
+  }
+
+  Image<double> srcDistances, dstDistances;
+  SquaredDistanceTransform(srcSurface, srcDistances);
+  SquaredDistanceTransform(dstSurface, dstDistances);
+
+  std::vector<double> distances;
+  distances.reserve(result.truthSurface + result.resultSurface);
+  CollectDistances(dstSurface, srcDistances, distances);
+  CollectDistances(srcSurface, dstDistances, distances);
+
+  double sum = 0.0;
+  for (double d : distances)
+    sum += d;
+  result.averageSymmetric = sum / distances.size();
+
+  // Percentile interpolated between neighboring ranks.
+  const double rank = 0.95 * (distances.size() - 1);
+  const size_t lower = static_cast<size_t>(rank);
+  std::nth_element(distances.begin(), distances.begin() + lower,
+                   distances.end());
+  const double lowerValue = distances[lower];
+  const double upperValue = lower + 1 < distances.size()
+    ? *std::min_element(distances.begin() + lower + 1, distances.end())
+    : lowerValue;
+  result.hausdorff95 = lowerValue + (rank - lower) * (upperValue - lowerValue);
+  result.hausdorff = *std::max_element(distances.begin() + lower,
+                                       distances.end());
+  return result;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+
+namespace util {
+
+// Standard allocator returning memory aligned to Alignment bytes.
+//
+// Alignment must be a power of two. The pointer returned by the underlying
+// operator new is stored right before the aligned block.
+template <class T, size_t Alignment>
+class AlignedAllocator {
+  static_assert(Alignment && !(Alignment & (Alignment - 1)),
+                "Alignment must be a power of two!");
+  static_assert(Alignment >= alignof(void*),
+                "Alignment must be at least alignment of a pointer!");
+
+public:
+  using value_type      = T;
+  using pointer         = T*;
+  using const_pointer   = const T*;
+  using reference       = T&;
+  using const_reference = const T&;
+  using size_type       = size_t;
+  using difference_type = std::ptrdiff_t;
+
+  template <class U>
+  struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+  static constexpr size_t ALIGNMENT = Alignment;
+
+  AlignedAllocator() = default;
+
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    if (n > max_size())
+      throw std::bad_alloc();
+
+    size_t bytes = n * sizeof(T) + Alignment + sizeof(void*);
+    auto raw = static_cast<unsigned char*>(::operator new(bytes));
+
+    auto address = reinterpret_cast<uintptr_t>(raw + sizeof(void*));
+    address = (address + Alignment - 1) & ~static_cast<uintptr_t>(Alignment - 1);
+
+    auto aligned = reinterpret_cast<void**>(address);
+    aligned[-1] = raw;
+    return reinterpret_cast<T*>(aligned);
+  }
+
+  void deallocate(T *p, size_t) {
+    if (p)
+      ::operator delete(reinterpret_cast<void**>(p)[-1]);
+  }
+
+  size_t max_size() const {
+    return (std::numeric_limits<size_t>::max() - Alignment - sizeof(void*)) /
+           sizeof(T);
+  }
+
+  template <class U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+
+  template <class U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+
+template <class T, size_t Alignment>
+constexpr size_t AlignedAllocator<T, Alignment>::ALIGNMENT;
+
+} // namespace util
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+
+namespace util {
+
+// Non-owning view of a contiguous sequence of count objects.
+template <class T>
+class Span {
+public:
+  using element_type = T;
+  using iterator     = T*;
+
+  Span() : ptr(nullptr), count(0) {}
+  Span(T *first, size_t n) : ptr(first), count(n) {}
+
+  // Span<const T> from Span<T>.
+  template <class U>
+  Span(const Span<U> &other) : ptr(other.data()), count(other.size()) {}
+
+  T *data() const { return ptr; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T &operator[](size_t i) const {
+    assert(i < count && "Span index is out of range!");
+    return ptr[i];
+  }
+
+  iterator begin() const { return ptr; }
+  iterator end()   const { return ptr + count; }
+
+private:
+  T *ptr;
+  size_t count;
+};
+
+} // namespace util
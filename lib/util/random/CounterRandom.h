@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+
+namespace util {
+
+// Output function of SplitMix64, a bijection of 64-bit words with good
+// avalanche.
+inline uint64_t SplitMix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+
+// Counter-based pseudo-random generator.
+//
+// n-th number of a stream is a hash of (seed, stream, substream, n), so it
+// doesn't depend on numbers drawn from other streams: streams keyed by pixel
+// index can be drawn by any thread in any order with the same results.
+//
+// Satisfies UniformRandomBitGenerator, but std distributions differ between
+// standard libraries, UniformInt gives the same numbers everywhere.
+class CounterRandom {
+public:
+  using result_type = uint64_t;
+
+  CounterRandom(uint64_t seed, uint64_t stream, uint64_t substream = 0)
+    : key(SplitMix64(SplitMix64(SplitMix64(seed) ^ stream) ^ substream))
+    , counter(0)
+  {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    return SplitMix64(key + counter++ * 0xD1B54A32D192ED03ULL);
+  }
+
+  void discard(uint64_t count) { counter += count; }
+
+  // Uniformly distributed integer of [lower, upper], the range must fit into
+  // 32 bits. Lemire's multiply-shift with rejection, so there's no bias.
+  int64_t UniformInt(int64_t lower, int64_t upper) {
+    const uint64_t range = static_cast<uint64_t>(upper - lower) + 1;
+    uint64_t product = Next32() * range;
+    uint32_t low = static_cast<uint32_t>(product);
+    if (low < range) {
+      const uint32_t threshold =
+        static_cast<uint32_t>((0x100000000ULL - range) % range);
+      while (low < threshold) {
+        product = Next32() * range;
+        low = static_cast<uint32_t>(product);
+      }
+    }
+    return lower + static_cast<int64_t>(product >> 32);
+  }
+
+private:
+  uint64_t Next32() { return (*this)() >> 32; }
+
+  uint64_t key;
+  uint64_t counter;
+};
+
+} // namespace util
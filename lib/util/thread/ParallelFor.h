@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <vector>
+
+
+namespace util {
+
+// Calls f(i) for each i in [begin, end) on up to threadCount threads. The
+// range is split into contiguous blocks, the calling thread runs the first
+// one and the others are run by SharedThreadPool(). Returns when all calls
+// are done.
+//
+// Rethrows the exception of the first block which threw one.
+template <class F>
+void ParallelFor(size_t begin, size_t end, F f,
+                 size_t threadCount = HardwareConcurrency())
+{
+  if (begin >= end)
+    return;
+
+  const size_t count = end - begin;
+  const size_t blocks = std::max<size_t>(1, std::min(threadCount, count));
+
+  std::vector<std::exception_ptr> errors(blocks);
+  auto runBlock = [&](size_t block) {
+    size_t first = begin + count * block / blocks;
+    size_t last = begin + count * (block + 1) / blocks;
+    try {
+      for (size_t i = first; i < last; ++i)
+        f(i);
+    } catch (...) {
+      errors[block] = std::current_exception();
+    }
+  };
+
+  auto &pool = SharedThreadPool();
+  std::vector<std::future<void>> pending;
+  pending.reserve(blocks - 1);
+  for (size_t block = 1; block < blocks; ++block)
+    pending.push_back(pool.Submit([&runBlock, block]() { runBlock(block); }));
+
+  runBlock(0);
+
+  // Queued tasks are run here too, so calls made from pool workers never
+  // wait for blocks no one can take.
+  for (auto &block : pending) {
+    while (block.wait_for(std::chrono::seconds(0)) !=
+           std::future_status::ready && pool.RunPendingTask()) {}
+    block.wait();
+  }
+
+  for (auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+}
+
+} // namespace util
@@ -0,0 +1,76 @@
+#include "ThreadPool.h"
+
+
+namespace util {
+
+size_t HardwareConcurrency()
+{
+  auto n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+
+ThreadPool::ThreadPool(size_t threadCount)
+  : stopping(false)
+{
+  if (threadCount == 0)
+    threadCount = 1;
+
+  workers.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i)
+    workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  condition.notify_all();
+
+  for (auto &w : workers)
+    w.join();
+}
+
+
+bool ThreadPool::RunPendingTask()
+{
+  std::function<void()> task;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty())
+      return false;
+    task = std::move(tasks.front());
+    tasks.pop();
+  }
+  task();
+  return true;
+}
+
+
+void ThreadPool::WorkerLoop()
+{
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
+
+
+ThreadPool & SharedThreadPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+} // namespace util
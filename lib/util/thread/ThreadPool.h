@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace util {
+
+// Number of threads the hardware can run concurrently, at least 1.
+size_t HardwareConcurrency();
+
+
+// Fixed-size pool of worker threads executing tasks in FIFO order.
+//
+// Tasks already submitted are finished before the destructor returns.
+class ThreadPool {
+public:
+  // Starts threadCount workers, at least one.
+  explicit ThreadPool(size_t threadCount = HardwareConcurrency());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  size_t GetThreadCount() const { return workers.size(); }
+
+  // Schedules f() for execution. Result (or exception thrown by f) is
+  // delivered through the returned future.
+  template <class F>
+  std::future<typename std::result_of<F()>::type> Submit(F f);
+
+  // Runs the oldest queued task on the calling thread. Returns false if
+  // there was none.
+  bool RunPendingTask();
+
+private:
+  void WorkerLoop();
+
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping;
+};
+
+
+// Pool with HardwareConcurrency() workers shared by the whole process,
+// started on first use.
+ThreadPool & SharedThreadPool();
+
+
+template <class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::Submit(F f)
+{
+  using ResultType = typename std::result_of<F()>::type;
+
+  // std::function requires copyable callables, so the task is shared.
+  auto task = std::make_shared<std::packaged_task<ResultType()>>(std::move(f));
+  auto result = task->get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push([task]() { (*task)(); });
+  }
+  condition.notify_one();
+
+  return result;
+}
+
+} // namespace util
@@ -24,9 +24,12 @@
 #include "ImageIO.h"
 #include "SegmentationColorsConverter.h"
 #include "SegmentationAccuracyEstimator.h"
+#include "SurfaceDistanceEstimator.h"
 
+#include <chrono>
 #include <iostream>
-#include <ctime>
+#include <string>
+#include <vector>
 
 
 int main(int argc, char **argv) {
@@ -37,10 +40,16 @@ int main(int argc, char **argv) {
   std::cout << "Database:" << std::endl;
 
   OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  std::vector<std::string> imgFiles, segFiles;
   for (int i = 2; i < argc - 2; i += 2) {
-    db.Add(argv[i], argv[i+1]);
-    std::cout << argv[i] << "   " << argv[i+1] << std::endl;
+    imgFiles.push_back(argv[i]);
+    segFiles.push_back(argv[i+1]);
   }
+  db.AddFiles(imgFiles, segFiles);
+  for (size_t i = 0; i < db.GetImageCount(); ++i)
+    std::cout << imgFiles[i] << "   " << segFiles[i] << "   ("
+              << db.GetLoadTime(i) << " s)" << std::endl;
 
   std::string resultDir(argv[argc-1]);
 
@@ -49,14 +58,27 @@ int main(int argc, char **argv) {
 
   OPAL opal(settings, db);
 
-  auto clocksBefore = clock();
+  // Wall time: CPU time of all threads would overstate a parallel run.
+  auto start = std::chrono::steady_clock::now();
 
   opal.Run();
 
-  auto clocksAfter = clock();
-  double timeConsumed = double(clocksAfter - clocksBefore) / double(CLOCKS_PER_SEC);
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  double timeConsumed = elapsed.count();
+
+  for (const auto &error : opal.getApproximationErrors())
+    std::cout << "Iteration " << error.iteration
+              << ": mean cost gap " << error.meanCostGap
+              << ", at optimum " << 100 * error.optimalFraction << "%"
+              << std::endl;
 
   auto seg = opal.GetOutput();
+
+  const auto &fusion = opal.getFusionStats();
+  std::cout << "Mismatch times: " << fusion.mismatches << " of "
+            << fusion.fused << " fused pixels, " << fusion.settled
+            << " settled" << std::endl;
   auto groundTruth = ImageIO::ReadImage<OPAL::SegPixelType>(argv[3]);
 
   ImageIO::SegmentationColorsConverter converter;
@@ -78,6 +100,16 @@ int main(int argc, char **argv) {
     std::cout << l.first << '\t' << l.second << std::endl;
   }
 
+  SurfaceDistanceEstimator<OPAL::SegPixelType> surfaceEstimator;
+  surfaceEstimator.Estimate(groundTruth, seg);
+
+  std::cout << "\nSurface distances (HD95, ASSD):" << std::endl;
+  for (const auto &l : surfaceEstimator.GetDistanceMap()) {
+    std::cout.width(3);
+    std::cout << l.first << '\t' << l.second.hausdorff95 << '\t'
+              << l.second.averageSymmetric << std::endl;
+  }
+
   std::cout << "\nOPAL running time: " << timeConsumed << std::endl;
 
   return 0;
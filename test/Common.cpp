@@ -1,5 +1,9 @@
 #include "Common.h"
 
+#include <experimental/filesystem>
+
+namespace fs = std::experimental::filesystem;
+
 RandGen *RandGen::instance = nullptr;
 
 int RandGen::Random(int lowerLimit, int upperLimit) {
@@ -9,3 +13,21 @@ int RandGen::Random(int lowerLimit, int upperLimit) {
   return dist(generator);
 }
 
+
+TempDirectory::TempDirectory() {
+  std::random_device device;
+  fs::path dir;
+  do {
+    dir = fs::temp_directory_path() / ("opal_test_" + std::to_string(device()));
+  } while (!fs::create_directory(dir));
+  path = dir.string();
+}
+
+TempDirectory::~TempDirectory() {
+  std::error_code error;
+  fs::remove_all(path, error);
+}
+
+std::string TempDirectory::File(const std::string &name) const {
+  return (fs::path(path) / name).string();
+}
@@ -4,6 +4,7 @@
 #include "Image.h"
 
 #include <fstream>
+#include <string>
 #include <type_traits> // std::enable_if
 #include <random>
 
@@ -30,6 +31,36 @@ private:
 
 #define RandomWithLimits(a, b) RandGen::GetInstance()->Random(a, b)
 
+
+// Directory created for a test, removed with its contents on destruction.
+class TempDirectory {
+public:
+  TempDirectory();
+  ~TempDirectory();
+
+  TempDirectory(const TempDirectory &) = delete;
+  TempDirectory& operator=(const TempDirectory &) = delete;
+
+  // Path of the directory itself.
+  const std::string& GetPath() const { return path; }
+
+  // Path of the file with given name in the directory.
+  std::string File(const std::string &name) const;
+
+private:
+  std::string path;
+};
+
+
+// Adds first count test_data images with their segmentations to db.
+template<class TDb>
+void FillDatabase(TDb &db, size_t count = 3) {
+  static const char *names[] = { "01.img", "02.img", "03.img" };
+  for (size_t k = 0; k < count; ++k)
+    db.Add(std::string("test_data/Images/") + names[k],
+           std::string("test_data/Segmentations/") + names[k]);
+}
+
 constexpr double EPS = 1.0e-5;
 
 template<class T>
@@ -0,0 +1,54 @@
+#include "Common.h"
+#include "DistanceTransform.h"
+
+#include <cmath>
+#include <limits>
+
+
+TEST(DistanceTransformTests, OneDimensional) {
+  const double INF = std::numeric_limits<double>::infinity();
+  const double f[] = { INF, 0.0, INF, INF, INF, 2.0, INF };
+  double d[7];
+
+  std::vector<size_t> v;
+  std::vector<double> z;
+  DistanceTransform1D(f, 7, d, v, z);
+
+  const double expected[] = { 1.0, 0.0, 1.0, 4.0, 3.0, 2.0, 3.0 };
+  for (size_t q = 0; q < 7; ++q)
+    EXPECT_DOUBLE_EQ(expected[q], d[q]);
+}
+
+
+TEST(DistanceTransformTests, NoFeatures) {
+  Image<uint8_t> features(4, 5, 0);
+  Image<double> result;
+  SquaredDistanceTransform(features, result);
+
+  ASSERT_EQ(4, result.getHeight());
+  ASSERT_EQ(5, result.getWidth());
+  for (size_t i = 0; i < result.getSize(); ++i)
+    EXPECT_TRUE(std::isinf(result[i]));
+}
+
+
+TEST(DistanceTransformTests, MatchesBruteForce) {
+  Image<uint8_t> features(23, 31, 0);
+  for (size_t i = 0; i < features.getSize(); ++i)
+    features[i] = RandGen::GetInstance()->Random(0, 29) == 0;
+
+  Image<double> result;
+  SquaredDistanceTransform(features, result);
+
+  for (size_t i = 0; i < features.getHeight(); ++i)
+    for (size_t j = 0; j < features.getWidth(); ++j) {
+      double best = std::numeric_limits<double>::infinity();
+      for (size_t y = 0; y < features.getHeight(); ++y)
+        for (size_t x = 0; x < features.getWidth(); ++x)
+          if (features(y, x)) {
+            double dy = double(y) - double(i), dx = double(x) - double(j);
+            best = std::min(best, dy * dy + dx * dx);
+          }
+      EXPECT_DOUBLE_EQ(best, result(i, j)) << i << ", " << j;
+    }
+}
@@ -0,0 +1,134 @@
+#include "../Common.h"
+
+#include <cstdint>
+
+
+namespace {
+
+// 3x4 image with pixel (i, j) = 10 * i + j.
+Image<int> MakeImage() {
+  Image<int> img(3, 4);
+  for (size_t i = 0; i < img.getHeight(); ++i)
+    for (size_t j = 0; j < img.getWidth(); ++j)
+      img(i, j) = static_cast<int>(10 * i + j);
+  return img;
+}
+
+} // namespace
+
+
+TEST(ImagePaddingTest, DefaultIsContiguous) {
+  auto img = MakeImage();
+  ASSERT_TRUE(img.isContiguous());
+  ASSERT_EQ(0, img.getBorder());
+  ASSERT_EQ(4, img.getStride());
+  ASSERT_EQ(12, img[1 * 4 + 2]);
+  ASSERT_EQ(0, reinterpret_cast<uintptr_t>(&img[0]) % Image<int>::ALIGNMENT);
+}
+
+
+TEST(ImagePaddingTest, AlignedRows) {
+  auto img = MakeImage();
+  auto original = img;
+  img.SetBorder(2);
+
+  ASSERT_FALSE(img.isContiguous());
+  ASSERT_EQ(2, img.getBorder());
+  ASSERT_TRUE(ImageHasSize(img, 3, 4));
+  ASSERT_EQ(0, img.getStride() * sizeof(int) % Image<int>::ALIGNMENT);
+
+  for (size_t i = 0; i < img.getHeight(); ++i) {
+    auto r = img.row(i);
+    ASSERT_EQ(4, r.size());
+    ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r.data()) % Image<int>::ALIGNMENT);
+    for (size_t j = 0; j < r.size(); ++j)
+      ASSERT_EQ(static_cast<int>(10 * i + j), r[j]);
+  }
+
+  // Layout doesn't matter for comparison and casts.
+  ASSERT_EQ(original, img);
+  ASSERT_EQ(original.castTo<double>(), img.castTo<double>());
+  ASSERT_TRUE(img.castTo<int>().isContiguous());
+}
+
+
+TEST(ImagePaddingTest, BorderModes) {
+  auto img = MakeImage();
+  img.SetBorder(2);
+  const size_t minus1 = static_cast<size_t>(-1);
+  const size_t minus2 = static_cast<size_t>(-2);
+
+  img.UpdateBorder(BorderMode::Constant, -7);
+  ASSERT_EQ(-7, img(minus1, minus1));
+  ASSERT_EQ(-7, img(minus2, 3));
+  ASSERT_EQ(-7, img(1, 5));
+  ASSERT_EQ(-7, img(4, 0));
+  ASSERT_EQ(12, img(1, 2));
+
+  img.UpdateBorder(BorderMode::Replicate);
+  ASSERT_EQ(0, img(minus2, minus2));
+  ASSERT_EQ(10, img(1, minus1));
+  ASSERT_EQ(13, img(1, 5));
+  ASSERT_EQ(23, img(4, 5));
+  ASSERT_EQ(2, img(minus1, 2));
+
+  img.UpdateBorder(BorderMode::Mirror);
+  ASSERT_EQ(11, img(1, minus1));
+  ASSERT_EQ(12, img(1, minus2));
+  ASSERT_EQ(12, img(1, 4));
+  ASSERT_EQ(11, img(1, 5));
+  ASSERT_EQ(12, img(minus1, 2));
+  ASSERT_EQ(12, img(3, 2));
+  ASSERT_EQ(2, img(4, 2));
+  ASSERT_EQ(11, img(minus1, minus1));
+}
+
+
+TEST(ImagePaddingTest, FillBorderRing) {
+  auto img = MakeImage();
+  img.SetBorder(2);
+  img.UpdateBorder(BorderMode::Replicate);
+  img.FillBorderRing(2, -1);
+
+  const size_t minus1 = -1, minus2 = -2;
+  ASSERT_EQ(-1, img(minus2, minus2));
+  ASSERT_EQ(-1, img(minus2, 2));
+  ASSERT_EQ(-1, img(4, 5));
+  ASSERT_EQ(-1, img(1, minus2));
+  ASSERT_EQ(-1, img(1, 5));
+
+  // Inner ring and pixels are kept.
+  ASSERT_EQ(0, img(minus1, minus1));
+  ASSERT_EQ(23, img(3, 4));
+  ASSERT_EQ(MakeImage(), img);
+}
+
+
+TEST(ImagePaddingTest, ResizeKeepsLayout) {
+  auto img = MakeImage();
+  img.SetBorder(1);
+
+  img.Resize(5, 2, 9);
+  ASSERT_TRUE(ImageHasSize(img, 5, 2));
+  ASSERT_EQ(1, img.getBorder());
+  ASSERT_EQ(11, img(1, 1));
+  ASSERT_EQ(9, img(4, 0));
+
+  img.Fill(3);
+  ASSERT_TRUE(ImageIsFilledWith(img, 3));
+
+  img.Resize(0, 0);
+  ASSERT_TRUE(ImageIsEmpty(img));
+}
+
+
+TEST(ImagePaddingTest, Arithmetic) {
+  auto padded = MakeImage();
+  padded.SetBorder(3);
+  auto contiguous = MakeImage();
+
+  padded += contiguous;
+  ASSERT_EQ(44, padded(2, 2));
+  padded -= contiguous;
+  ASSERT_EQ(contiguous, padded);
+}
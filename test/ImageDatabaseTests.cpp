@@ -103,3 +103,247 @@ TEST(ImageDatabaseTests, TestIterators3) {
   ASSERT_EQ(++imgIt, db.img_cend());
   ASSERT_EQ(++segIt, db.seg_cend());
 }
+
+
+TEST(ImageDatabaseTests, TestParallelLoadKeepsOrder) {
+  ImageDatabase<double, int> sequential;
+  sequential.SetLoaderThreads(1);
+  sequential.ReadFromConfig("test_data/IBSR.json");
+
+  ImageDatabase<double, int> parallel;
+  parallel.SetLoaderThreads(4);
+  parallel.SetMaxPairsInFlight(3);
+  parallel.ReadFromConfig("test_data/IBSR.json");
+
+  ASSERT_EQ(sequential.GetImageCount(), parallel.GetImageCount());
+  for (size_t i = 0; i < parallel.GetImageCount(); ++i) {
+    ASSERT_EQ(sequential.GetImageName(i), parallel.GetImageName(i));
+    ASSERT_EQ(sequential.GetSegmentationName(i),
+              parallel.GetSegmentationName(i));
+    ASSERT_EQ(sequential.GetImage(i), parallel.GetImage(i));
+    ASSERT_EQ(sequential.GetSegmentation(i), parallel.GetSegmentation(i));
+    ASSERT_GT(parallel.GetLoadTime(i), 0.0);
+  }
+}
+
+
+TEST(ImageDatabaseTests, TestParallelLoadError) {
+  TempDirectory dir;
+
+  std::ofstream ofs(dir.File("BadDatabaseFiles.txt"));
+  ofs << "test_data/pictures/small_4x5_color.png "
+         "test_data/pictures/small_4x5_color.png\n"
+         "test_data/pictures/alley_1_frame_0001.png "
+         "test_data/pictures/alley_1_frame_0002.png\n"
+         "test_data/pictures/small_4x5_color.png "
+         "test_data/pictures/small_4x5_color.png\n";
+  ofs.close();
+
+  ImageDatabase<double, int> db;
+  db.SetLoaderThreads(2);
+  ASSERT_THROW(db.ReadFilesFromList(dir.File("BadDatabaseFiles.txt")),
+               std::runtime_error);
+  // Pairs preceding the failed one are added.
+  ASSERT_EQ(1, db.GetImageCount());
+}
+
+
+TEST(ImageDatabaseTests, TestLoadTimeOfInMemoryPair) {
+  ImageDatabase<int, int> db;
+  db.Add(ImageDatabase<int, int>::ImgType(5, 2, 10),
+         ImageDatabase<int, int>::SegType(5, 2, 18));
+
+  ASSERT_DOUBLE_EQ(0.0, db.GetLoadTime(0));
+}
+
+
+TEST(ImageDatabaseTests, TestLazyLoadingBudget) {
+  ImageDatabase<double, int> eager;
+  eager.ReadFromConfig("test_data/IBSR.json");
+
+  // IBSR pairs are 256x256, room for 3 of them.
+  const size_t pairBytes = 256 * 256 * (sizeof(double) + sizeof(uint8_t));
+
+  ImageDatabase<double, int> lazy;
+  lazy.SetCacheBudget(3 * pairBytes);
+  lazy.ReadFromConfig("test_data/IBSR.json");
+
+  ASSERT_EQ(eager.GetImageCount(), lazy.GetImageCount());
+  ASSERT_EQ(256, lazy.GetImageHeight());
+  ASSERT_EQ(256, lazy.GetImageWidth());
+
+  // Only the first pair is decoded up front.
+  ASSERT_TRUE(lazy.IsLoaded(0));
+  for (size_t i = 1; i < lazy.GetImageCount(); ++i)
+    ASSERT_FALSE(lazy.IsLoaded(i));
+
+  // Two passes, the second one re-reads dropped pairs.
+  for (int pass = 0; pass < 2; ++pass)
+    for (size_t i = 0; i < lazy.GetImageCount(); ++i) {
+      ASSERT_EQ(eager.GetImage(i), lazy.GetImage(i));
+      ASSERT_EQ(eager.GetSegmentation(i), lazy.GetSegmentation(i));
+      ASSERT_LE(lazy.GetCachedBytes(), 3 * pairBytes);
+    }
+
+  // The most recently used pairs are kept.
+  size_t last = lazy.GetImageCount() - 1;
+  ASSERT_TRUE(lazy.IsLoaded(last));
+  ASSERT_TRUE(lazy.IsLoaded(last - 1));
+  ASSERT_FALSE(lazy.IsLoaded(0));
+}
+
+
+TEST(ImageDatabaseTests, TestLazyLoadingPinning) {
+  const size_t pairBytes = 256 * 256 * (sizeof(double) + sizeof(uint8_t));
+
+  ImageDatabase<double, int> db;
+  db.SetCacheBudget(pairBytes);
+  db.ReadFromConfig("test_data/IBSR.json");
+
+  {
+    ImageDatabase<double, int>::PinGuard pin1(db, 1);
+    ImageDatabase<double, int>::PinGuard pin2(db, 2);
+    ASSERT_FALSE(db.IsLoaded(0));
+
+    // Pinned pairs stay even though the budget is exceeded.
+    for (size_t i = 3; i < db.GetImageCount(); ++i)
+      db.GetImage(i);
+    ASSERT_TRUE(db.IsLoaded(1));
+    ASSERT_TRUE(db.IsLoaded(2));
+    ASSERT_EQ(3 * pairBytes, db.GetCachedBytes());
+  }
+
+  // Unpinning returns to the budget.
+  ASSERT_EQ(pairBytes, db.GetCachedBytes());
+
+  ASSERT_THROW(db.SetCacheBudget(0), std::logic_error);
+}
+
+
+TEST(ImageDatabaseTests, TestLazyLoadingBadFile) {
+  ImageDatabase<double, int> db;
+  db.SetCacheBudget(1);
+  db.Add("test_data/pictures/small_4x5_color.png",
+         "test_data/pictures/small_4x5_color.png");
+  db.Add("test_data/pictures/alley_1_frame_0001.png",
+         "test_data/pictures/alley_1_frame_0002.png");
+
+  // Size mismatch is found on access.
+  ASSERT_EQ(2, db.GetImageCount());
+  ASSERT_THROW(db.GetImage(1), std::runtime_error);
+}
+
+
+TEST(ImageDatabaseTests, TestBorder) {
+  ImageDatabase<double, int> plain;
+  plain.Add("test_data/Images/01.img", "test_data/Segmentations/01.img");
+
+  ImageDatabase<double, int> padded;
+  padded.SetBorder(2, BorderMode::Replicate);
+  padded.Add("test_data/Images/01.img", "test_data/Segmentations/01.img");
+  padded.Add(plain.GetImage(0), plain.GetSegmentation(0));
+  ASSERT_EQ(2, padded.GetBorder());
+
+  for (size_t i = 0; i < padded.GetImageCount(); ++i) {
+    const auto &img = padded.GetImage(i);
+    const auto &seg = padded.GetSegmentation(i);
+    ASSERT_EQ(2, img.getBorder());
+    ASSERT_EQ(2, seg.getBorder());
+    ASSERT_EQ(plain.GetImage(0), img);
+    ASSERT_EQ(plain.GetSegmentation(0), seg);
+    ASSERT_EQ(img(0, 0), img(-2, -2));
+    ASSERT_EQ(seg(255, 100), seg(256, 100));
+  }
+
+  // Ghost pixels count towards the cache.
+  ASSERT_GT(padded.GetCachedBytes(), 2 * plain.GetCachedBytes());
+
+  ASSERT_THROW(padded.SetBorder(0), std::logic_error);
+}
+
+
+TEST(ImageDatabaseTests, TestFence) {
+  ImageDatabase<double, int> db;
+  ASSERT_THROW(db.SetFence(-1.0), std::logic_error);
+  db.SetBorder(2);
+  db.SetFence(-1.0);
+  ASSERT_TRUE(db.HasFence());
+
+  Image<double> img(3, 4, 5.0);
+  Image<int> seg(3, 4, 1);
+  db.Add(img, seg);
+
+  const size_t minus1 = -1, minus2 = -2;
+  const auto &padded = db.GetImage(0);
+  ASSERT_EQ(img, padded);
+  ASSERT_DOUBLE_EQ(5.0, padded(minus1, minus1));
+  ASSERT_DOUBLE_EQ(-1.0, padded(minus2, 1));
+  ASSERT_DOUBLE_EQ(-1.0, padded(2, 5));
+  ASSERT_EQ(1, db.GetSegmentation(0)(minus2, 1));
+
+  ASSERT_THROW(db.SetFence(0.0), std::logic_error);
+}
+
+
+TEST(ImageDatabaseTests, TestCompactLabels) {
+  ImageDatabase<double, int> db;
+  db.SetBorder(1);
+
+  Image<double> img(4, 100, 1.0);
+  Image<int> seg1(4, 100);
+  Image<int> seg2(4, 100);
+  for (size_t i = 0; i < 4; ++i)
+    for (size_t j = 0; j < 100; ++j) {
+      seg1(i, j) = -1000 + static_cast<int>(i * 100 + j);
+      seg2(i, j) = 7;
+    }
+
+  // Two labels, indices are bytes.
+  db.Add(img, seg2);
+  ASSERT_FALSE(db.HasWideLabels());
+  ASSERT_EQ(1, db.GetLabelTable().GetSize());
+  ASSERT_EQ(0, db.GetLabelIndices<uint8_t>(0)(2, 50));
+  ASSERT_EQ(seg2, db.GetSegmentation(0));
+
+  // 401 labels, all pairs are converted.
+  db.Add(img, seg1);
+  ASSERT_TRUE(db.HasWideLabels());
+  ASSERT_EQ(401, db.GetLabelTable().GetSize());
+  ASSERT_EQ(0, db.GetLabelIndices<uint16_t>(0)(2, 50));
+  ASSERT_EQ(seg2, db.GetSegmentation(0));
+  ASSERT_EQ(seg1, db.GetSegmentation(1));
+  ASSERT_EQ(1, db.GetSegmentation(1).getBorder());
+
+  const auto &indices = db.GetLabelIndices<uint16_t>(1);
+  ASSERT_EQ(seg1(3, 99), db.GetLabelTable()[indices(3, 99)]);
+  ASSERT_EQ(indices(2, 99), indices(4, 99)); // mirrored
+}
+
+
+TEST(ImageDatabaseTests, TestLazyLoadingLabels) {
+  TempDirectory dir;
+
+  Image<double> img(4, 100, 1.0);
+  Image<int> seg(4, 100);
+  for (size_t i = 0; i < seg.getSize(); ++i)
+    seg[i] = static_cast<int>(i);
+  ImageIO::WriteImage(img, dir.File("img.nii"));
+  ImageIO::WriteImage(seg, dir.File("seg.nii"));
+
+  ImageDatabase<double, int> db;
+  db.SetCacheBudget(1);
+  db.Add(img, Image<int>(4, 100, 7));
+  db.Add(dir.File("img.nii"), dir.File("seg.nii"));
+
+  // Labels of the registered pair are known before it is loaded.
+  ASSERT_FALSE(db.IsLoaded(1));
+  ASSERT_TRUE(db.HasWideLabels());
+  ASSERT_EQ(400, db.GetLabelTable().GetSize());
+
+  {
+    ImageDatabase<double, int>::PinGuard pin(db, 0);
+    const auto &indices = db.GetLabelIndices<uint16_t>(0);
+    ASSERT_EQ(seg, db.GetSegmentation(1));
+    ASSERT_EQ(0, indices(2, 50));
+  }
+}
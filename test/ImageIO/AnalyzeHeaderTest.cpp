@@ -44,3 +44,24 @@ TEST(AnalyzeHeader, PrintToStream) {
   ss << hdr;
 }
 
+
+
+TEST(AnalyzeHeader, ByteOrder) {
+  FILE *little = fopen("test_data/02.hdr", "rb");
+  AnalyzeFileHeader littleHdr(little);
+  fclose(little);
+
+  ASSERT_FALSE(littleHdr.IsByteSwapped());
+  ASSERT_EQ(256, littleHdr.GetData().dims.Dimensions[1]);
+
+  FILE *big = fopen("test_data/analyze/be_int16.hdr", "rb");
+  AnalyzeFileHeader bigHdr(big);
+  fclose(big);
+
+  ASSERT_TRUE(bigHdr.IsByteSwapped());
+  ASSERT_EQ(348, bigHdr.GetData().key.SizeOfHeader);
+  ASSERT_EQ(4, bigHdr.GetData().dims.Dimensions[1]);
+  ASSERT_EQ(3, bigHdr.GetData().dims.Dimensions[2]);
+  ASSERT_EQ(4, bigHdr.GetData().dims.DataType);
+  ASSERT_EQ(16, bigHdr.GetData().dims.BitsPerPixel);
+}
@@ -2,6 +2,9 @@
 
 #include "ImageIO/AnalyzeImageReader.h"
 
+#include <fstream>
+#include <vector>
+
 using namespace ImageIO;
 
 TEST(AnalyzeImageReader, ReadGood) {
@@ -30,3 +33,85 @@ TEST(AnalyzeImageReader, ReadBadNoImg) {
   AnalyzeImageReader<int> reader("test_data/02.hdr");
   ASSERT_THROW(reader.Read(), std::runtime_error);
 }
+
+
+TEST(AnalyzeImageReader, ReadPixelsAsStored) {
+  AnalyzeImageReader<double> reader("test_data/Images/01.img");
+  reader.Read();
+  const auto &image = reader.GetImage();
+
+  // Doubles in host byte order, compare with raw file contents.
+  std::ifstream ifs("test_data/Images/01.img", std::ios::binary);
+  std::vector<double> raw(image.getSize());
+  ifs.read(reinterpret_cast<char*>(raw.data()), raw.size() * sizeof(double));
+  ASSERT_TRUE(ifs.good());
+
+  for (size_t i = 0; i < image.getSize(); ++i)
+    ASSERT_DOUBLE_EQ(raw[i], image[i]);
+}
+
+
+TEST(AnalyzeImageReader, ReadBigEndianShort) {
+  AnalyzeImageReader<int> reader("test_data/analyze/be_int16.img");
+  reader.Read();
+
+  const std::vector<int> expected = { -300, -1,   0,     1,
+                                         2, 100, 1000, 32767,
+                                    -32768,   7,    8,     9 };
+  const auto &image = reader.GetImage();
+  ASSERT_EQ(3, image.getHeight());
+  ASSERT_EQ(4, image.getWidth());
+  for (size_t i = 0; i < expected.size(); ++i)
+    ASSERT_EQ(expected[i], image[i]);
+}
+
+
+TEST(AnalyzeImageReader, ReadBigEndianFloat) {
+  AnalyzeImageReader<double> reader("test_data/analyze/be_float.img");
+  reader.Read();
+
+  const auto &image = reader.GetImage();
+  ASSERT_EQ(12, image.getSize());
+  for (size_t i = 0; i < image.getSize(); ++i)
+    ASSERT_DOUBLE_EQ(0.5 * i - 2.0, image[i]);
+}
+
+
+TEST(AnalyzeImageReader, ReadUnsignedShort) {
+  AnalyzeImageReader<int> reader("test_data/analyze/le_uint16.img");
+  reader.Read();
+
+  const std::vector<int> expected = {    0,     1,   255, 256,
+                                      1000, 40000, 65535,  12,
+                                        13,    14,    15,  16 };
+  const auto &image = reader.GetImage();
+  for (size_t i = 0; i < expected.size(); ++i)
+    ASSERT_EQ(expected[i], image[i]);
+
+  // Same type as stored, read directly into the image.
+  AnalyzeImageReader<uint16_t> nativeReader("test_data/analyze/le_uint16.img");
+  nativeReader.Read();
+  for (size_t i = 0; i < expected.size(); ++i)
+    ASSERT_EQ(expected[i], nativeReader.GetImage()[i]);
+}
+
+
+TEST(AnalyzeImageReader, ReadRGB) {
+  AnalyzeImageReader<int> grayReader("test_data/analyze/rgb.img");
+  grayReader.Read();
+
+  const auto &gray = grayReader.GetImage();
+  ASSERT_EQ(0,   gray(0, 0));
+  ASSERT_EQ(54,  gray(0, 1));
+  ASSERT_EQ(184, gray(1, 0));
+  ASSERT_EQ(255, gray(1, 1));
+
+  AnalyzeImageReader<RGBAPixel> rgbReader("test_data/analyze/rgb.img");
+  rgbReader.Read();
+
+  const auto &rgb = rgbReader.GetImage();
+  ASSERT_EQ(RGBAPixel::PureBlack, rgb(0, 0));
+  ASSERT_EQ(RGBAPixel::PureRed,   rgb(0, 1));
+  ASSERT_EQ(RGBAPixel::PureGreen, rgb(1, 0));
+  ASSERT_EQ(RGBAPixel::PureWhite, rgb(1, 1));
+}
@@ -0,0 +1,110 @@
+#include "../Common.h"
+#include "ImageIO/GzipStream.h"
+#include "ImageIO/Common.h"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace ImageIO;
+
+
+namespace {
+
+std::vector<unsigned char> ReadRaw(const std::string &fileName) {
+  std::ifstream ifs(fileName, std::ios::binary);
+  return std::vector<unsigned char>(std::istreambuf_iterator<char>(ifs),
+                                    std::istreambuf_iterator<char>());
+}
+
+
+// Decodes the whole file reading chunkSize bytes at a time.
+std::vector<unsigned char> Inflate(const std::string &fileName,
+                                   size_t chunkSize) {
+  auto f = OpenFile(fileName, "rb");
+  GzipInputStream is(f.get());
+
+  std::vector<unsigned char> result;
+  std::vector<unsigned char> chunk(chunkSize);
+  while (size_t n = is.Read(chunk.data(), chunk.size()))
+    result.insert(result.end(), chunk.begin(), chunk.begin() + n);
+  return result;
+}
+
+} // namespace
+
+
+TEST(GzipInputStream, InflateCompressed) {
+  auto expected = ReadRaw("test_data/nifti/text.txt");
+  ASSERT_FALSE(expected.empty());
+
+  ASSERT_EQ(expected, Inflate("test_data/nifti/text_9.txt.gz", 1 << 20));
+  ASSERT_EQ(expected, Inflate("test_data/nifti/text_9.txt.gz", 1000));
+  ASSERT_EQ(expected, Inflate("test_data/nifti/text_9.txt.gz", 1));
+}
+
+
+TEST(GzipInputStream, InflateStored) {
+  auto expected = ReadRaw("test_data/nifti/text.txt");
+  ASSERT_EQ(expected, Inflate("test_data/nifti/text_0.txt.gz", 777));
+}
+
+
+TEST(GzipInputStream, BadData) {
+  ASSERT_THROW(Inflate("test_data/nifti/text_badcrc.txt.gz", 4096),
+               std::runtime_error);
+  // Not a gzip file.
+  ASSERT_THROW(Inflate("test_data/nifti/text.txt", 4096), std::runtime_error);
+}
+
+
+TEST(GzipInputStream, CompressRoundTrip) {
+  TempDirectory dir;
+  auto expected = ReadRaw("test_data/nifti/text.txt");
+
+  std::vector<unsigned char> compressed;
+  GzipCompress(expected.data(), expected.size(), compressed);
+  ASSERT_LT(compressed.size(), expected.size());
+
+  {
+    std::ofstream ofs(dir.File("roundtrip.gz"), std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(compressed.data()),
+              compressed.size());
+  }
+  ASSERT_EQ(expected, Inflate(dir.File("roundtrip.gz"), 4096));
+}
+
+
+TEST(GzipInputStream, FindDeflateEnd) {
+  auto text = ReadRaw("test_data/nifti/text.txt");
+
+  // Deflate stream of GzipCompress is between 10-byte header and trailer.
+  std::vector<unsigned char> compressed;
+  GzipCompress(text.data(), text.size(), compressed);
+  std::vector<unsigned char> raw(compressed.begin() + 10,
+                                 compressed.end() - 8);
+
+  size_t finalBlockBit = 0;
+  size_t endBit =
+    GzipInputStream::FindDeflateEnd(raw.data(), raw.size(), finalBlockBit);
+  ASSERT_EQ(raw.size(), (endBit + 7) / 8);
+  ASSERT_LT(finalBlockBit, endBit);
+  ASSERT_TRUE((raw[finalBlockBit / 8] >> (finalBlockBit % 8)) & 1);
+
+  raw.resize(raw.size() / 2);
+  ASSERT_THROW(GzipInputStream::FindDeflateEnd(raw.data(), raw.size(),
+                                               finalBlockBit),
+               std::runtime_error);
+}
+
+
+// Dynamic block header with 288 literal and 32 distance codes, followed by
+// 320 zero code lengths, more than the lengths of the tables can hold.
+TEST(GzipInputStream, BadDynamicHeader) {
+  const unsigned char raw[] = { 0xFD, 0x1F, 0x80, 0xE4, 0xFF, 0x7F, 0x08,
+                                0, 0, 0, 0, 0, 0, 0, 0 };
+  size_t finalBlockBit = 0;
+  ASSERT_THROW(GzipInputStream::FindDeflateEnd(raw, sizeof(raw),
+                                               finalBlockBit),
+               std::runtime_error);
+}
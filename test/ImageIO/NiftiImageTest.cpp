@@ -0,0 +1,176 @@
+#include "../Common.h"
+#include "ImageIO/ImageIO.h"
+#include "ImageIO/NiftiImageReader.h"
+#include "ImageIO/NiftiImageWriter.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace ImageIO;
+
+
+namespace {
+
+template <class T>
+Image<T> MakeImage(size_t h, size_t w) {
+  Image<T> image(h, w);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = static_cast<T>(i * 3 + 1);
+  return image;
+}
+
+
+template <class T>
+void CheckRoundTrip(const std::string &fileName) {
+  auto image = MakeImage<T>(7, 5);
+  NiftiImageWriter<T>().Write(image, fileName);
+
+  NiftiImageReader<T> reader(fileName);
+  reader.Read();
+  ASSERT_EQ(image, reader.GetImage());
+  ASSERT_EQ(StoredDataType<T>::value, reader.GetHeader().GetData().DataType);
+}
+
+} // namespace
+
+
+TEST(NiftiImage, RoundTrip) {
+  TempDirectory dir;
+  CheckRoundTrip<int>(dir.File("int.nii"));
+  CheckRoundTrip<int>(dir.File("int.nii.gz"));
+  CheckRoundTrip<double>(dir.File("double.nii"));
+  CheckRoundTrip<double>(dir.File("double.nii.gz"));
+  CheckRoundTrip<unsigned char>(dir.File("uchar.nii.gz"));
+}
+
+
+TEST(NiftiImage, RoundTripPadded) {
+  TempDirectory dir;
+  auto image = MakeImage<int>(7, 5);
+  image.SetBorder(2);
+  image.UpdateBorder(BorderMode::Constant, -1);
+  NiftiImageWriter<int>().Write(image, dir.File("padded.nii.gz"));
+
+  NiftiImageReader<int> reader(dir.File("padded.nii.gz"));
+  reader.Read();
+  ASSERT_EQ(image, reader.GetImage());
+}
+
+
+TEST(NiftiImage, RoundTripRGB) {
+  TempDirectory dir;
+  Image<RGBAPixel> image(2, 3);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = RGBAPixel(i * 10, i * 20 + 1, 255 - i);
+
+  WriteImage(image, dir.File("rgb.nii.gz"));
+  auto result = ReadImage<RGBAPixel>(dir.File("rgb.nii.gz"));
+  ASSERT_EQ(image, result);
+}
+
+
+TEST(NiftiImage, ReadConverted) {
+  TempDirectory dir;
+  auto image = MakeImage<int>(4, 4);
+  WriteImage(image, dir.File("converted.nii"));
+
+  auto result = ReadImage<double>(dir.File("converted.nii"));
+  ASSERT_EQ(4, result.getHeight());
+  ASSERT_EQ(4, result.getWidth());
+  for (size_t i = 0; i < image.getSize(); ++i)
+    ASSERT_DOUBLE_EQ(image[i], result[i]);
+}
+
+
+TEST(NiftiImage, ReadBigEndianScaled) {
+  NiftiImageReader<double> reader("test_data/nifti/be_int16_scaled.nii.gz");
+  reader.Read();
+
+  ASSERT_TRUE(reader.GetHeader().IsByteSwapped());
+  ASSERT_TRUE(reader.GetHeader().HasScaling());
+
+  const std::vector<double> stored = { -300, -1,   0,     1,
+                                          2, 100, 1000, 32767,
+                                     -32768,   7,    8,     9 };
+  const auto &image = reader.GetImage();
+  ASSERT_EQ(3, image.getHeight());
+  ASSERT_EQ(4, image.getWidth());
+  for (size_t i = 0; i < stored.size(); ++i)
+    ASSERT_DOUBLE_EQ(stored[i] * 2.0 + 10.0, image[i]);
+}
+
+
+TEST(NiftiImage, ReadBad) {
+  NiftiImageReader<int> noFile("some_weird_name.nii");
+  ASSERT_THROW(noFile.Read(), std::runtime_error);
+
+  // Analyze header has no NIfTI magic.
+  NiftiImageReader<int> analyze("test_data/02.hdr");
+  ASSERT_THROW(analyze.Read(), std::runtime_error);
+}
+
+
+// Voxels end before the gzip trailer, which is still verified.
+TEST(NiftiImage, ReadBadGzipTrailer) {
+  TempDirectory dir;
+  NiftiImageWriter<int>().Write(MakeImage<int>(7, 5),
+                                dir.File("trailer.nii.gz"));
+
+  std::vector<char> bytes;
+  {
+    std::ifstream ifs(dir.File("trailer.nii.gz"), std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(ifs),
+                 std::istreambuf_iterator<char>());
+  }
+  ASSERT_GT(bytes.size(), 8u);
+
+  // Last 8 bytes are CRC-32 and size of the data.
+  bytes[bytes.size() - 8] ^= 0x5A;
+  {
+    std::ofstream ofs(dir.File("bad_trailer.nii.gz"), std::ios::binary);
+    ofs.write(bytes.data(), bytes.size());
+  }
+
+  NiftiImageReader<int> good(dir.File("trailer.nii.gz"));
+  ASSERT_NO_THROW(good.Read());
+  NiftiImageReader<int> bad(dir.File("bad_trailer.nii.gz"));
+  ASSERT_THROW(bad.Read(), std::runtime_error);
+}
+
+
+// Two-file headers and voxels overlapping the header are rejected.
+TEST(NiftiImage, ReadBadHeaderFields) {
+  TempDirectory dir;
+  NiftiImageWriter<int>().Write(MakeImage<int>(3, 2),
+                                dir.File("fields.nii"));
+
+  std::vector<char> bytes;
+  {
+    std::ifstream ifs(dir.File("fields.nii"), std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(ifs),
+                 std::istreambuf_iterator<char>());
+  }
+  ASSERT_GT(bytes.size(), 352u);
+
+  auto patched = bytes;
+  std::memcpy(&patched[344], "ni1", 4);
+  {
+    std::ofstream ofs(dir.File("two_file.nii"), std::ios::binary);
+    ofs.write(patched.data(), patched.size());
+  }
+
+  patched = bytes;
+  const float offset = 100.0f;
+  std::memcpy(&patched[108], &offset, sizeof(offset));
+  {
+    std::ofstream ofs(dir.File("bad_offset.nii"), std::ios::binary);
+    ofs.write(patched.data(), patched.size());
+  }
+
+  NiftiImageReader<int> twoFile(dir.File("two_file.nii"));
+  ASSERT_THROW(twoFile.Read(), std::runtime_error);
+  NiftiImageReader<int> badOffset(dir.File("bad_offset.nii"));
+  ASSERT_THROW(badOffset.Read(), std::runtime_error);
+}
@@ -0,0 +1,93 @@
+#include "../Common.h"
+#include "ImageIO/ParallelDeflate.h"
+#include "ImageIO/PngImageReader.h"
+#include "ImageIO/PngImageWriter.h"
+
+#include <cstdlib>
+
+using namespace ImageIO;
+
+
+namespace {
+
+// Compressible data: runs and repeated ramps with some noise.
+std::vector<unsigned char> MakeData(size_t size) {
+  std::vector<unsigned char> data(size);
+  for (size_t i = 0; i < size; ++i)
+    data[i] = (i / 1000) % 3 ? static_cast<unsigned char>(i % 251)
+                             : static_cast<unsigned char>(std::rand());
+  return data;
+}
+
+
+std::vector<unsigned char> Inflate(const unsigned char *data, size_t size) {
+  unsigned char *out = nullptr;
+  size_t outSize = 0;
+  auto error = lodepng_zlib_decompress(&out, &outSize, data, size,
+                                       &lodepng_default_decompress_settings);
+  std::vector<unsigned char> result(out, out + outSize);
+  std::free(out);
+  EXPECT_EQ(0u, error);
+  return result;
+}
+
+} // namespace
+
+
+TEST(ParallelDeflate, RoundTrip) {
+  const size_t chunk = PARALLEL_DEFLATE_CHUNK_SIZE;
+  for (size_t size : { size_t(0), size_t(1), chunk - 1, chunk, chunk + 1,
+                       3 * chunk + 17 }) {
+    auto data = MakeData(size);
+
+    for (unsigned btype : { 0u, 1u, 2u }) {
+      LodePNGCompressSettings settings = lodepng_default_compress_settings;
+      settings.btype = btype;
+
+      unsigned char *out = nullptr;
+      size_t outSize = 0;
+      ASSERT_EQ(0u, ParallelZlibCompress(&out, &outSize, data.data(),
+                                         data.size(), &settings));
+      auto inflated = Inflate(out, outSize);
+      std::free(out);
+
+      ASSERT_EQ(data, inflated) << "size " << size << ", btype " << btype;
+    }
+  }
+}
+
+
+// Output is appended to data already in the buffer.
+TEST(ParallelDeflate, Append) {
+  auto data = MakeData(2 * PARALLEL_DEFLATE_CHUNK_SIZE + 5);
+
+  auto *out = static_cast<unsigned char *>(std::malloc(3));
+  out[0] = 'a', out[1] = 'b', out[2] = 'c';
+  size_t outSize = 3;
+  ASSERT_EQ(0u, ParallelZlibCompress(&out, &outSize, data.data(), data.size(),
+                                     &lodepng_default_compress_settings));
+
+  ASSERT_EQ('a', out[0]);
+  ASSERT_EQ('c', out[2]);
+  ASSERT_EQ(data, Inflate(out + 3, outSize - 3));
+  std::free(out);
+}
+
+
+// Large images are written with parallel deflate.
+TEST(ParallelDeflate, LargePng) {
+  TempDirectory dir;
+  Image<uint8_t> image(1024, 700);
+  auto data = MakeData(image.getSize());
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = data[i];
+
+  for (auto profile : { PngProfile::Archival, PngProfile::Fast }) {
+    PngImageWriter<uint8_t> writer(profile);
+    writer.Write(image, dir.File("large.png"));
+
+    PngImageReader<uint8_t> reader(dir.File("large.png"));
+    reader.Read();
+    ASSERT_EQ(image, reader.GetImage());
+  }
+}
@@ -1,6 +1,6 @@
-#include <gtest/gtest.h>
-
+#include "../Common.h"
 #include "ImageIO/PngImageReader.h"
+#include "ImageIO/Luminance.h"
 
 using namespace ImageIO;
 
@@ -40,3 +40,83 @@ TEST(PngImageReader, ReRead) {
   ASSERT_EQ(5, reader.GetImage().getWidth());
 
 }
+
+
+TEST(PngImageReader, Gray8) {
+  TempDirectory dir;
+  std::vector<unsigned char> pixels = { 0, 17, 128, 255, 3, 200 };
+  ASSERT_EQ(0u, lodepng::encode(dir.File("gray8.png"), pixels, 3, 2,
+                                LCT_GREY, 8));
+
+  PngImageReader<double> reader(dir.File("gray8.png"));
+  reader.Read();
+
+  const auto &image = reader.GetImage();
+  ASSERT_EQ(2, image.getHeight());
+  ASSERT_EQ(3, image.getWidth());
+  for (size_t i = 0; i < 2; ++i)
+    for (size_t j = 0; j < 3; ++j)
+      ASSERT_EQ(pixels[i * 3 + j], image(i, j));
+}
+
+
+// 16-bit gray keeps full precision.
+TEST(PngImageReader, Gray16) {
+  TempDirectory dir;
+  std::vector<unsigned char> pixels = { 0x12, 0x34, 0xFF, 0xFF,
+                                        0x00, 0x01, 0x80, 0x00 };
+  ASSERT_EQ(0u, lodepng::encode(dir.File("gray16.png"), pixels, 2, 2,
+                                LCT_GREY, 16));
+
+  PngImageReader<int> reader(dir.File("gray16.png"));
+  reader.Read();
+
+  const auto &image = reader.GetImage();
+  ASSERT_EQ(0x1234, image(0, 0));
+  ASSERT_EQ(0xFFFF, image(0, 1));
+  ASSERT_EQ(0x0001, image(1, 0));
+  ASSERT_EQ(0x8000, image(1, 1));
+}
+
+
+// 16-bit gray read to narrow pixels keeps the high byte.
+TEST(PngImageReader, Gray16Narrow) {
+  TempDirectory dir;
+  std::vector<unsigned char> pixels = { 0x12, 0x34, 0xFF, 0xFF,
+                                        0x00, 0x01, 0x80, 0x00 };
+  ASSERT_EQ(0u, lodepng::encode(dir.File("gray16_narrow.png"), pixels, 2, 2,
+                                LCT_GREY, 16));
+
+  PngImageReader<uint8_t> reader(dir.File("gray16_narrow.png"));
+  reader.Read();
+
+  const auto &image = reader.GetImage();
+  ASSERT_EQ(0x12, image(0, 0));
+  ASSERT_EQ(0xFF, image(0, 1));
+  ASSERT_EQ(0x00, image(1, 0));
+  ASSERT_EQ(0x80, image(1, 1));
+}
+
+
+TEST(PngImageReader, ColorToLuminance) {
+  std::vector<unsigned char> png;
+  ASSERT_EQ(0u, lodepng::load_file(png,
+                                   "test_data/pictures/small_4x5_color.png"));
+  std::vector<unsigned char> rgba;
+  unsigned width = 0, height = 0;
+  ASSERT_EQ(0u, lodepng::decode(rgba, width, height, png));
+
+  PngImageReader<int> grayReader("test_data/pictures/small_4x5_color.png");
+  grayReader.Read();
+  PngImageReader<RGBAPixel> rgbaReader(
+    "test_data/pictures/small_4x5_color.png");
+  rgbaReader.Read();
+
+  const auto &gray = grayReader.GetImage();
+  const auto &color = rgbaReader.GetImage();
+  for (size_t k = 0; k < width * height; ++k) {
+    const auto *p = &rgba[4 * k];
+    ASSERT_EQ(Luminance(p[0], p[1], p[2]), gray[k]);
+    ASSERT_EQ(RGBAPixel(p[0], p[1], p[2], p[3]), color[k]);
+  }
+}
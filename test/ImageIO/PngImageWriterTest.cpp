@@ -0,0 +1,106 @@
+#include "../Common.h"
+#include "ImageIO/PngImageReader.h"
+#include "ImageIO/PngImageWriter.h"
+
+using namespace ImageIO;
+
+
+namespace {
+
+// Color mode stored in a PNG file.
+LodePNGColorMode StoredColor(const std::string &fileName) {
+  std::vector<unsigned char> png;
+  lodepng::load_file(png, fileName);
+
+  lodepng::State state;
+  unsigned width = 0, height = 0;
+  lodepng_inspect(&width, &height, &state, png.data(), png.size());
+  return state.info_png.color;
+}
+
+
+template <class T>
+Image<T> ReadPng(const std::string &fileName) {
+  PngImageReader<T> reader(fileName);
+  reader.Read();
+  return reader.GetImage();
+}
+
+} // namespace
+
+
+TEST(PngImageWriter, Gray8) {
+  TempDirectory dir;
+  Image<uint8_t> image(13, 17);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = (i * 37) % 256;
+
+  for (auto profile : { PngProfile::Archival, PngProfile::Fast }) {
+    PngImageWriter<uint8_t> writer;
+    writer.Write(image, dir.File("gray8.png"), profile);
+
+    ASSERT_EQ(LCT_GREY, StoredColor(dir.File("gray8.png")).colortype);
+    ASSERT_EQ(image, ReadPng<uint8_t>(dir.File("gray8.png")));
+  }
+}
+
+
+TEST(PngImageWriter, Gray16) {
+  TempDirectory dir;
+  Image<uint16_t> image(5, 7);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = static_cast<uint16_t>(i * 1999);
+
+  PngImageWriter<uint16_t> writer(PngProfile::Fast);
+  writer.Write(image, dir.File("gray16.png"));
+
+  auto color = StoredColor(dir.File("gray16.png"));
+  ASSERT_EQ(LCT_GREY, color.colortype);
+  ASSERT_EQ(16u, color.bitdepth);
+  ASSERT_EQ(image, ReadPng<uint16_t>(dir.File("gray16.png")));
+}
+
+
+// Label maps drawn in few colors become palette images.
+TEST(PngImageWriter, Palette) {
+  TempDirectory dir;
+  const RGBAPixel colors[] = { RGBAPixel(0, 0, 0), RGBAPixel(255, 0, 0),
+                               RGBAPixel(0, 128, 255, 100) };
+  Image<RGBAPixel> image(20, 30);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = colors[(i / 7) % 3];
+
+  PngImageWriter<RGBAPixel> writer(PngProfile::Fast);
+  writer.Write(image, dir.File("palette.png"));
+
+  ASSERT_EQ(LCT_PALETTE, StoredColor(dir.File("palette.png")).colortype);
+  ASSERT_EQ(image, ReadPng<RGBAPixel>(dir.File("palette.png")));
+}
+
+
+TEST(PngImageWriter, TrueColor) {
+  TempDirectory dir;
+  Image<RGBAPixel> image(20, 30);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = RGBAPixel(i % 256, i / 256, 7);
+
+  PngImageWriter<RGBAPixel> writer;
+  writer.Write(image, dir.File("rgb.png"), PngProfile::Fast);
+  ASSERT_EQ(LCT_RGB, StoredColor(dir.File("rgb.png")).colortype);
+  ASSERT_EQ(image, ReadPng<RGBAPixel>(dir.File("rgb.png")));
+
+  image[5].a = 10;
+  writer.Write(image, dir.File("rgba.png"), PngProfile::Fast);
+  ASSERT_EQ(LCT_RGBA, StoredColor(dir.File("rgba.png")).colortype);
+  ASSERT_EQ(image, ReadPng<RGBAPixel>(dir.File("rgba.png")));
+
+  writer.Write(image, dir.File("rgba.png"), PngProfile::Archival);
+  ASSERT_EQ(image, ReadPng<RGBAPixel>(dir.File("rgba.png")));
+}
+
+
+TEST(PngImageWriter, WriteBad) {
+  PngImageWriter<uint8_t> writer;
+  ASSERT_THROW(writer.Write(Image<uint8_t>(3, 3, 0), "no_such_dir/a.png"),
+               std::runtime_error);
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "ImageIO/SegmentationColorsConverter.h"
+
+using namespace ImageIO;
+
+
+namespace {
+
+// Square of label 2 in the middle and a column of label 5 at the left edge.
+Image<int> MakeSegmentation() {
+  Image<int> seg(7, 9, 0);
+  for (size_t i = 2; i < 5; ++i)
+    for (size_t j = 3; j < 7; ++j)
+      seg(i, j) = 2;
+  for (size_t i = 0; i < seg.getHeight(); ++i)
+    seg(i, 0) = 5;
+  return seg;
+}
+
+
+Image<double> MakeImage(size_t h, size_t w) {
+  Image<double> image(h, w);
+  for (size_t i = 0; i < image.getSize(); ++i)
+    image[i] = static_cast<double>((i * 29) % 256);
+  return image;
+}
+
+} // namespace
+
+
+TEST(SegmentationColorsConverter, DefaultColors) {
+  SegmentationColorsConverter converter;
+  EXPECT_EQ(RGBAPixel(0, 0, 0), converter.GetColor(0));
+  EXPECT_EQ(RGBAPixel(0, 238, 0), converter.GetColor(2));
+  EXPECT_EQ(RGBAPixel(74, 155, 60), converter.GetColor(119));
+  EXPECT_EQ(RGBAPixel(1, 1, 1), converter.GetColor(120));
+}
+
+
+TEST(SegmentationColorsConverter, GeneratedColors) {
+  SegmentationColorsConverter converter;
+  RGBAPixel first = converter.GetColor(121);
+  EXPECT_NE(first, converter.GetColor(122));
+  EXPECT_EQ(first, SegmentationColorsConverter().GetColor(121));
+
+  EXPECT_NO_THROW(converter.GetColor(SegmentationColorsConverter::MAX_LABEL));
+  EXPECT_THROW(converter.GetColor(SegmentationColorsConverter::MAX_LABEL + 1),
+               std::out_of_range);
+}
+
+
+TEST(SegmentationColorsConverter, LabelsOnly) {
+  auto seg = MakeSegmentation();
+  seg(6, 8) = 300;
+
+  SegmentationColorsConverter converter;
+  auto rgb = converter.ConvertToRGB(seg, 3);
+
+  ASSERT_EQ(seg.getHeight(), rgb.getHeight());
+  ASSERT_EQ(seg.getWidth(), rgb.getWidth());
+  for (size_t i = 0; i < seg.getHeight(); ++i)
+    for (size_t j = 0; j < seg.getWidth(); ++j)
+      EXPECT_EQ(converter.GetColor(seg(i, j)), rgb(i, j));
+
+  seg(0, 0) = -1;
+  EXPECT_THROW(converter.ConvertToRGB(seg), std::out_of_range);
+}
+
+
+TEST(SegmentationColorsConverter, Contours) {
+  auto seg = MakeSegmentation();
+  auto image = MakeImage(seg.getHeight(), seg.getWidth());
+
+  SegmentationColorsConverter converter;
+  auto rgb = converter.ConvertToRGB(image, seg, true, 4);
+
+  auto gray = [&](size_t i, size_t j) {
+    return RGBAPixel(static_cast<RGBAPixel::PixelType>(image(i, j)));
+  };
+
+  // Outline of the square, its inside keeps the image.
+  EXPECT_EQ(converter.GetColor(2), rgb(2, 3));
+  EXPECT_EQ(converter.GetColor(2), rgb(4, 6));
+  EXPECT_EQ(converter.GetColor(2), rgb(2, 4));
+  EXPECT_EQ(gray(3, 4), rgb(3, 4));
+  EXPECT_EQ(gray(3, 5), rgb(3, 5));
+  EXPECT_EQ(gray(1, 4), rgb(1, 4));
+
+  // Structures touching the edges are closed there, corners are written.
+  for (size_t i = 0; i < seg.getHeight(); ++i)
+    EXPECT_EQ(converter.GetColor(5), rgb(i, 0));
+  EXPECT_EQ(gray(0, 8), rgb(0, 8));
+  EXPECT_EQ(gray(6, 8), rgb(6, 8));
+}
+
+
+TEST(SegmentationColorsConverter, FilledStructures) {
+  auto seg = MakeSegmentation();
+  auto image = MakeImage(seg.getHeight(), seg.getWidth());
+
+  SegmentationColorsConverter converter;
+  auto rgb = converter.ConvertToRGB(image, seg, false);
+
+  for (size_t i = 0; i < seg.getHeight(); ++i)
+    for (size_t j = 0; j < seg.getWidth(); ++j) {
+      auto expected = seg(i, j)
+        ? converter.GetColor(seg(i, j))
+        : RGBAPixel(static_cast<RGBAPixel::PixelType>(image(i, j)));
+      EXPECT_EQ(expected, rgb(i, j));
+    }
+}
+
+
+TEST(SegmentationColorsConverter, Opacity) {
+  auto seg = MakeSegmentation();
+  Image<double> image(seg.getHeight(), seg.getWidth(), 100.0);
+
+  SegmentationColorsConverter converter;
+  EXPECT_THROW(converter.SetOpacity(1.5), std::invalid_argument);
+  EXPECT_THROW(converter.SetOpacity(-0.1), std::invalid_argument);
+
+  converter.SetOpacity(0.5);
+  auto rgb = converter.ConvertToRGB(image, seg, false);
+
+  // Label 2 is (0, 238, 0), half of it over gray 100.
+  EXPECT_EQ(RGBAPixel(50, 169, 50), rgb(3, 4));
+  EXPECT_EQ(RGBAPixel(100), rgb(0, 5));
+
+  converter.SetOpacity(0.0);
+  rgb = converter.ConvertToRGB(image, seg, false);
+  EXPECT_EQ(RGBAPixel(100), rgb(3, 4));
+}
+
+
+TEST(SegmentationColorsConverter, ThreadCountDoesNotMatter) {
+  Image<int> seg(41, 37);
+  for (size_t i = 0; i < seg.getSize(); ++i)
+    seg[i] = static_cast<int>((i / 5 + i % 7) % 4);
+  auto image = MakeImage(seg.getHeight(), seg.getWidth());
+
+  SegmentationColorsConverter converter;
+  auto single = converter.ConvertToRGB(image, seg, true, 1);
+  EXPECT_EQ(single, converter.ConvertToRGB(image, seg, true, 8));
+}
+
+
+TEST(SegmentationColorsConverter, SizeMismatch) {
+  SegmentationColorsConverter converter;
+  EXPECT_THROW(converter.ConvertToRGB(Image<double>(3, 4), Image<int>(4, 3)),
+               std::invalid_argument);
+}
@@ -0,0 +1,49 @@
+#include "Common.h"
+#include "LabelTable.h"
+
+#include <cstdint>
+
+
+TEST(LabelTableTests, DenseIndices) {
+  LabelTable<int> table;
+  ASSERT_TRUE(table.IsEmpty());
+
+  ASSERT_EQ(0, table.Insert(42));
+  ASSERT_EQ(1, table.Insert(-3));
+  ASSERT_EQ(0, table.Insert(42));
+  ASSERT_EQ(2, table.GetSize());
+
+  ASSERT_EQ(1, table.IndexOf(-3));
+  ASSERT_EQ(42, table[0]);
+  ASSERT_THROW(table.IndexOf(5), std::out_of_range);
+
+  table.Clear();
+  ASSERT_TRUE(table.IsEmpty());
+}
+
+
+TEST(LabelTableTests, EncodeDecode) {
+  Image<int> seg(3, 4);
+  seg(0, 0) = 10; seg(0, 1) = 10; seg(0, 2) = 20; seg(0, 3) = 10;
+  seg(1, 0) = 30; seg(1, 1) = 30; seg(1, 2) = 30; seg(1, 3) = 30;
+  seg(2, 0) = 0;  seg(2, 1) = 20; seg(2, 2) = 20; seg(2, 3) = 0;
+
+  LabelTable<int> table;
+  table.Insert(seg);
+  ASSERT_EQ(4, table.GetSize());
+
+  Image<uint8_t> encoded;
+  table.Encode(seg, encoded);
+  ASSERT_TRUE(ImageHasSize(encoded, 3, 4));
+  ASSERT_EQ(0, encoded(0, 0));
+  ASSERT_EQ(1, encoded(0, 2));
+  ASSERT_EQ(2, encoded(1, 3));
+  ASSERT_EQ(3, encoded(2, 3));
+
+  Image<int> decoded;
+  table.Decode(encoded, decoded);
+  ASSERT_EQ(seg, decoded);
+
+  Image<int> unknown(1, 1, 99);
+  ASSERT_THROW(table.Encode(unknown, encoded), std::out_of_range);
+}
@@ -0,0 +1,109 @@
+#include "OPAL.h"
+#include "PackedMatch.h"
+#include "../Common.h"
+
+
+namespace {
+
+double MeanCost(const OPAL &opal) {
+  const auto &ssdMap = opal.getSSDMap();
+  double sum = 0.0;
+  for (size_t i = 0; i < ssdMap.getHeight(); ++i)
+    for (size_t j = 0; j < ssdMap.getWidth(); ++j)
+      sum += ssdMap(i, j).GetValue();
+  return sum / (ssdMap.getHeight() * ssdMap.getWidth());
+}
+
+} // namespace
+
+
+TEST(OPAL, PropagationModeFromString) {
+  ASSERT_EQ(PropagationMode::Serial, PropagationModeFromString("serial"));
+  ASSERT_EQ(PropagationMode::Async, PropagationModeFromString("async"));
+  ASSERT_THROW(PropagationModeFromString("parallel"), std::invalid_argument);
+}
+
+
+TEST(OPAL, PackedMatchCodec) {
+  PackedMatchCodec codec(5, 31, 40);
+
+  for (int dy : { -30, -1, 0, 17, 30 })
+    for (int dx : { -39, 0, 3, 39 })
+      for (size_t t : { 1, 4 }) {
+        auto match = codec.Unpack(codec.Pack(t, dx, dy, 1234.0));
+        ASSERT_EQ(t, match.t);
+        ASSERT_EQ(dx, match.offsetX);
+        ASSERT_EQ(dy, match.offsetY);
+        ASSERT_FLOAT_EQ(1234.0f, match.cost);
+      }
+
+  // Costs order words of the same pixel.
+  ASSERT_LT(PackedMatchCodec::Cost(codec.Pack(1, 0, 0, 2.5)),
+            PackedMatchCodec::Cost(codec.Pack(1, 0, 0, 3.0)));
+  ASSERT_TRUE(std::isinf(PackedMatchCodec::Cost(
+    codec.Pack(1, 0, 0, std::numeric_limits<double>::infinity()))));
+
+  // 2^12 templates and 2^10 x 2^10 images need 12 + 11 + 11 bits.
+  ASSERT_THROW(PackedMatchCodec(4096, 1024, 1024), std::logic_error);
+}
+
+
+// With a single thread, sweeps are the serial ones.
+TEST(OPAL, AsyncSingleThreadIsSerial) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 5;
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPAL serial(settings, db);
+  serial.Run();
+
+  settings.propagationMode = PropagationMode::Async;
+  settings.propagationThreads = 1;
+  OPAL async(settings, db);
+  async.Run();
+
+  ASSERT_TRUE(serial.getFieldX() == async.getFieldX());
+  ASSERT_TRUE(serial.getFieldY() == async.getFieldY());
+  ASSERT_TRUE(serial.getFieldT() == async.getFieldT());
+  ASSERT_TRUE(serial.GetOutput() == async.GetOutput());
+}
+
+
+TEST(OPAL, AsyncManyThreads) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 6;
+  settings.propagationMode = PropagationMode::Async;
+  settings.propagationThreads = 4;
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPAL initial(settings, db);
+  initial.ConstrainedInitialization();
+  const double initialCost = MeanCost(initial);
+
+  // Iterations run at once, or one by one for consensus.
+  for (size_t consensus : { 0, 3 }) {
+    settings.consensusIteration = consensus;
+    OPAL opal(settings, db);
+    opal.Run();
+
+    // Matches stay inside the image and costs are exact.
+    const auto &ssdMap = opal.getSSDMap();
+    const auto &fieldX = opal.getFieldX();
+    const auto &fieldY = opal.getFieldY();
+    const auto &fieldT = opal.getFieldT();
+    for (size_t i = 0; i < fieldX.getHeight(); ++i)
+      for (size_t j = 0; j < fieldX.getWidth(); ++j) {
+        ASSERT_LT(i + fieldY(i, j), fieldX.getHeight());
+        ASSERT_LT(j + fieldX(i, j), fieldX.getWidth());
+        OPAL::SSDType ssd(db, fieldT(i, j), j, i, j + fieldX(i, j),
+                          i + fieldY(i, j), settings.patchRadius);
+        ASSERT_EQ(ssd.GetValue(), ssdMap(i, j).GetValue()) << i << ", " << j;
+      }
+
+    ASSERT_LE(MeanCost(opal), initialCost);
+  }
+}
@@ -0,0 +1,45 @@
+#include "OPAL.h"
+#include "../Common.h"
+
+
+// Pixels near the border are matched and segmented like inner ones.
+TEST(OPAL, BorderPixels) {
+  // Fields of 1x1 patches are padded too.
+  for (size_t radius : { 0, 3 }) {
+    OPALSettings settings = OPALSettings::GetDefaults();
+    settings.patchRadius = radius;
+    settings.maxIterations = 4;
+
+    Image<double> img(20, 30);
+    FillRandomizedWithLimits(img, 0, 255);
+    Image<int> seg(20, 30, 5);
+
+    OPAL::DatabaseType db;
+    OPAL::PrepareDatabase(db, settings);
+    db.Add(img, seg);
+    db.Add(img, seg);
+    db.Add(img, seg);
+
+    OPAL opal(settings, db);
+    opal.Run();
+
+    ASSERT_TRUE(ImageIsFilledWith(opal.GetOutput(), 5));
+
+    const auto &fieldX = opal.getFieldX();
+    const auto &fieldY = opal.getFieldY();
+    const auto &fieldT = opal.getFieldT();
+    const auto &ssdMap = opal.getSSDMap();
+    for (int i = 0; i < 20; ++i)
+      for (int j = 0; j < 30; ++j) {
+        ASSERT_GE(i + fieldY(i, j), 0);
+        ASSERT_LT(i + fieldY(i, j), 20);
+        ASSERT_GE(j + fieldX(i, j), 0);
+        ASSERT_LT(j + fieldX(i, j), 30);
+
+        // Costs are finite SSDs of the matches.
+        OPAL::SSDType ssd(db, fieldT(i, j), j, i, j + fieldX(i, j),
+                          i + fieldY(i, j), radius);
+        ASSERT_DOUBLE_EQ(ssd.GetValue(), ssdMap(i, j).GetValue());
+      }
+  }
+}
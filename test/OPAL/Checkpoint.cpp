@@ -0,0 +1,162 @@
+#include "OPAL.h"
+#include "../Common.h"
+
+#include <fstream>
+#include <iterator>
+
+
+TEST(OPAL, CheckpointResumeIsExact) {
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, OPALSettings::GetDefaults());
+  FillDatabase(db);
+  TempDirectory dir;
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 5;
+
+  OPAL reference(settings, db);
+  reference.Run();
+
+  // "Interrupted" run: stops after 2 iterations, leaving a checkpoint.
+  OPALSettings interrupted = settings;
+  interrupted.maxIterations = 2;
+  interrupted.checkpointPath = dir.File("opal.ckpt");
+  {
+    OPAL opal(interrupted, db);
+    opal.Run();
+  }
+
+  auto checkpoint = OPALCheckpoint::ReadFromFile(dir.File("opal.ckpt"));
+  ASSERT_EQ(2, checkpoint.nextIteration);
+  ASSERT_EQ(3, checkpoint.imageCount);
+
+  OPAL resumed(settings, db);
+  resumed.ResumeFrom(dir.File("opal.ckpt"));
+
+  ASSERT_EQ(reference.getFieldX(), resumed.getFieldX());
+  ASSERT_EQ(reference.getFieldY(), resumed.getFieldY());
+  ASSERT_EQ(reference.getFieldT(), resumed.getFieldT());
+  ASSERT_EQ(reference.GetOutput(), resumed.GetOutput());
+
+  const auto &refSSD = reference.getSSDMap();
+  const auto &resSSD = resumed.getSSDMap();
+  for (size_t i = settings.patchRadius;
+       i + settings.patchRadius < refSSD.getHeight(); ++i)
+    for (size_t j = settings.patchRadius;
+         j + settings.patchRadius < refSSD.getWidth(); ++j)
+      ASSERT_EQ(refSSD(i, j).GetValue(), resSSD(i, j).GetValue());
+}
+
+
+TEST(OPAL, CheckpointMismatch) {
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, OPALSettings::GetDefaults());
+  FillDatabase(db);
+  TempDirectory dir;
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 0;
+  settings.checkpointPath = dir.File("mismatch.ckpt");
+  {
+    OPAL opal(settings, db);
+    opal.Run();
+  }
+
+  // Different patch size, database is padded for it.
+  OPALSettings other = OPALSettings::GetDefaults();
+  other.patchRadius = 2;
+  OPAL::DatabaseType otherDb;
+  OPAL::PrepareDatabase(otherDb, other);
+  FillDatabase(otherDb);
+  OPAL opal1(other, otherDb);
+  ASSERT_THROW(opal1.ResumeFrom(dir.File("mismatch.ckpt")),
+               std::runtime_error);
+
+  // Different database.
+  OPAL::DatabaseType smallDb;
+  OPAL::PrepareDatabase(smallDb, OPALSettings::GetDefaults());
+  FillDatabase(smallDb, 2);
+  OPAL opal2(OPALSettings::GetDefaults(), smallDb);
+  ASSERT_THROW(opal2.ResumeFrom(dir.File("mismatch.ckpt")),
+               std::runtime_error);
+}
+
+
+TEST(OPAL, CheckpointDamaged) {
+  ASSERT_THROW(OPALCheckpoint::ReadFromFile("no_such.ckpt"),
+               std::runtime_error);
+  ASSERT_THROW(OPALCheckpoint::ReadFromFile("test_data/OneLine.txt"),
+               std::runtime_error);
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, OPALSettings::GetDefaults());
+  FillDatabase(db);
+  TempDirectory dir;
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 0;
+  settings.checkpointPath = dir.File("truncated.ckpt");
+  {
+    OPAL opal(settings, db);
+    opal.Run();
+  }
+
+  std::ifstream ifs(dir.File("truncated.ckpt"), std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(ifs)),
+                       std::istreambuf_iterator<char>());
+  ifs.close();
+
+  std::ofstream ofs(dir.File("truncated.ckpt"), std::ios::binary);
+  ofs.write(contents.data(), contents.size() / 2);
+  ofs.close();
+
+  ASSERT_THROW(OPALCheckpoint::ReadFromFile(dir.File("truncated.ckpt")),
+               std::runtime_error);
+
+  // Huge image in the header is caught before pixels are allocated.
+  const uint64_t huge = 1 << 20;
+  contents.replace(16, sizeof(huge), reinterpret_cast<const char*>(&huge),
+                   sizeof(huge));
+  contents.replace(24, sizeof(huge), reinterpret_cast<const char*>(&huge),
+                   sizeof(huge));
+  ofs.open(dir.File("huge.ckpt"), std::ios::binary);
+  ofs.write(contents.data(), contents.size());
+  ofs.close();
+
+  ASSERT_THROW(OPALCheckpoint::ReadFromFile(dir.File("huge.ckpt")),
+               std::runtime_error);
+}
+
+
+TEST(OPAL, CheckpointMatchOutOfImage) {
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, OPALSettings::GetDefaults());
+  FillDatabase(db);
+  TempDirectory dir;
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 0;
+  settings.checkpointPath = dir.File("outside.ckpt");
+  {
+    OPAL opal(settings, db);
+    opal.Run();
+  }
+
+  // Destinations past each side of the image.
+  for (int side = 0; side < 4; ++side) {
+    auto checkpoint = OPALCheckpoint::ReadFromFile(dir.File("outside.ckpt"));
+    const int height = static_cast<int>(checkpoint.fieldX.getHeight());
+    const int width = static_cast<int>(checkpoint.fieldX.getWidth());
+    switch (side) {
+    case 0: checkpoint.fieldX(0, 0) = -1; break;
+    case 1: checkpoint.fieldY(0, 0) = -1; break;
+    case 2: checkpoint.fieldX(height - 1, width - 1) = 1; break;
+    case 3: checkpoint.fieldY(height - 1, width - 1) = 1; break;
+    }
+    checkpoint.WriteToFile(dir.File("outside_edited.ckpt"));
+
+    OPAL opal(settings, db);
+    ASSERT_THROW(opal.ResumeFrom(dir.File("outside_edited.ckpt")),
+                 std::runtime_error) << side;
+  }
+}
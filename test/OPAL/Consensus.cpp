@@ -0,0 +1,118 @@
+#include "OPAL.h"
+#include "../Common.h"
+
+#include <algorithm>
+
+
+// Pixels are settled exactly when labels matched to their whole patch agree.
+TEST(OPAL, ConsensusSettlesUnanimousPixels) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 2;
+  settings.consensusIteration = 2;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  // Fields don't change after the only settling.
+  const auto &fieldX = opal.getFieldX();
+  const auto &fieldY = opal.getFieldY();
+  const auto &fieldT = opal.getFieldT();
+  const auto &states = opal.getRoiMask();
+  const auto output = opal.GetOutput();
+
+  std::vector<OPAL::SegType> segs;
+  for (size_t t = 0; t < db.GetImageCount(); ++t)
+    segs.push_back(db.GetSegmentation(t));
+
+  const int height = output.getHeight();
+  const int width = output.getWidth();
+  const int r = settings.patchRadius;
+
+  auto matchedLabel = [&](int y, int x) {
+    // Ghost pixels repeat offsets of the nearest pixel.
+    int cy = std::min(std::max(y, 0), height - 1);
+    int cx = std::min(std::max(x, 0), width - 1);
+    return segs[fieldT(cy, cx)](y + fieldY(cy, cx), x + fieldX(cy, cx));
+  };
+
+  size_t settled = 0;
+  for (int i = 0; i < height; ++i)
+    for (int j = 0; j < width; ++j) {
+      bool unanimous = true;
+      for (int y = i - r; y <= i + r; ++y)
+        for (int x = j - r; x <= j + r; ++x)
+          unanimous &= matchedLabel(y, x) == matchedLabel(i, j);
+
+      ASSERT_EQ(states(i, j) == OPAL::SETTLED, unanimous);
+      if (unanimous) {
+        ASSERT_EQ(output(i, j), matchedLabel(i, j));
+        ++settled;
+      }
+    }
+
+  ASSERT_EQ(settled, opal.getSettledCount());
+  ASSERT_GT(settled, 0u);
+}
+
+
+// Settled pixels don't change the result of uniform regions.
+TEST(OPAL, ConsensusUniformImage) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 4;
+  settings.consensusIteration = 1;
+
+  Image<double> img(20, 30);
+  FillRandomizedWithLimits(img, 0, 255);
+  Image<int> seg(20, 30, 5);
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add(img, seg);
+  db.Add(img, seg);
+  db.Add(img, seg);
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  ASSERT_EQ(opal.getSettledCount(), 20u * 30u);
+  ASSERT_TRUE(ImageIsFilledWith(opal.GetOutput(), 5));
+}
+
+
+TEST(OPAL, ConsensusCheckpointResumeIsExact) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 5;
+  settings.consensusIteration = 1;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPAL reference(settings, db);
+  reference.Run();
+
+  OPALSettings interrupted = settings;
+  interrupted.maxIterations = 2;
+  TempDirectory dir;
+  interrupted.checkpointPath = dir.File("consensus.ckpt");
+  {
+    OPAL opal(interrupted, db);
+    opal.Run();
+  }
+
+  auto checkpoint = OPALCheckpoint::ReadFromFile(interrupted.checkpointPath);
+  ASSERT_EQ(checkpoint.settled.getSize(), checkpoint.fieldX.getSize());
+
+  OPAL resumed(settings, db);
+  resumed.ResumeFrom(interrupted.checkpointPath);
+
+  ASSERT_EQ(reference.getFieldX(), resumed.getFieldX());
+  ASSERT_EQ(reference.getFieldY(), resumed.getFieldY());
+  ASSERT_EQ(reference.getFieldT(), resumed.getFieldT());
+  ASSERT_EQ(reference.GetOutput(), resumed.GetOutput());
+  ASSERT_EQ(reference.getSettledCount(), resumed.getSettledCount());
+}
@@ -20,6 +20,7 @@ TEST(OPAL, ConstructorFromDBWithOnePair) {
 TEST(OPAL, ConstructorFromGoodDB) {
   OPALSettings settings = OPALSettings::GetDefaults();
   OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
   db.Add("test_data/pictures/alley_1_frame_0001.png",
          "test_data/pictures/alley_1_frame_0002.png");
   db.Add("test_data/pictures/alley_1_frame_0001.png",
@@ -27,3 +28,28 @@ TEST(OPAL, ConstructorFromGoodDB) {
 
   OPAL opal(settings, db);
 }
+
+TEST(OPAL, ConstructorFromNotPaddedDB) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  OPAL::DatabaseType db;
+  db.SetBorder(settings.patchRadius);
+  db.Add("test_data/pictures/alley_1_frame_0001.png",
+         "test_data/pictures/alley_1_frame_0002.png");
+  db.Add("test_data/pictures/alley_1_frame_0001.png",
+         "test_data/pictures/alley_1_frame_0002.png");
+
+  ASSERT_THROW(OPAL opal(settings, db), std::logic_error);
+}
+
+
+TEST(OPAL, ConstructorFromNotFencedDB) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  OPAL::DatabaseType db;
+  db.SetBorder(OPAL::GetRequiredBorder(settings));
+  db.Add("test_data/pictures/alley_1_frame_0001.png",
+         "test_data/pictures/alley_1_frame_0002.png");
+  db.Add("test_data/pictures/alley_1_frame_0001.png",
+         "test_data/pictures/alley_1_frame_0002.png");
+
+  ASSERT_THROW(OPAL opal(settings, db), std::logic_error);
+}
@@ -0,0 +1,163 @@
+#include "OPAL.h"
+#include "../Common.h"
+
+
+// Template is the input image shifted, inner pixels find the shift exactly.
+TEST(ExhaustiveSearch, FindsShift) {
+  Image<double> tmpl(30, 40);
+  FillRandomizedWithLimits(tmpl, 0, 255);
+  Image<double> input(30, 40, 0.0);
+  for (size_t i = 0; i + 2 < 30; ++i)
+    for (size_t j = 1; j < 40; ++j)
+      input(i, j) = tmpl(i + 2, j - 1);
+
+  Image<int> seg(30, 40, 1);
+  OPAL::DatabaseType db;
+  db.SetBorder(1);
+  db.Add(input, seg);
+  db.Add(tmpl, seg);
+  db.Add(tmpl, seg);
+
+  ExhaustiveSearch<OPAL::DatabaseType> search(db, 1, 3);
+  search.Run(4);
+
+  for (size_t i = 1; i + 3 < 30; ++i)
+    for (size_t j = 2; j + 1 < 40; ++j) {
+      ASSERT_EQ(2, search.getFieldY()(i, j));
+      ASSERT_EQ(-1, search.getFieldX()(i, j));
+      ASSERT_EQ(1u, search.getFieldT()(i, j)); // first of equal matches
+      ASSERT_EQ(0.0, search.getCosts()(i, j));
+    }
+
+  // Matches never leave the image.
+  for (int i = 0; i < 30; ++i)
+    for (int j = 0; j < 40; ++j) {
+      ASSERT_GE(i + search.getFieldY()(i, j), 0);
+      ASSERT_LT(i + search.getFieldY()(i, j), 30);
+      ASSERT_GE(j + search.getFieldX()(i, j), 0);
+      ASSERT_LT(j + search.getFieldX()(i, j), 40);
+    }
+
+  ASSERT_THROW(ExhaustiveSearch<OPAL::DatabaseType>(db, 2, 3),
+               std::logic_error);
+}
+
+
+// OPAL never finds a match better than the exact one, the exact field is
+// the same for any number of threads.
+TEST(ExhaustiveSearch, BoundsOPAL) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.initWindowRadius = 2;
+  settings.maxIterations = 3;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  ExhaustiveSearch<OPAL::DatabaseType> search(db, settings.patchRadius,
+                                              settings.initWindowRadius);
+  search.Run(1);
+  auto costs = search.getCosts();
+  search.Run(3);
+  ASSERT_EQ(costs, search.getCosts());
+
+  const auto &fieldX = opal.getFieldX();
+  const auto &fieldY = opal.getFieldY();
+  const auto &fieldT = opal.getFieldT();
+  for (size_t i = 0; i < costs.getHeight(); ++i)
+    for (size_t j = 0; j < costs.getWidth(); ++j) {
+      OPAL::SSDType ssd(db, fieldT(i, j), j, i, j + fieldX(i, j),
+                        i + fieldY(i, j), settings.patchRadius);
+      ASSERT_LE(costs(i, j), ssd.GetValue());
+    }
+}
+
+
+TEST(OPAL, ApproximationErrorReport) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 4;
+  settings.errorReportSamples = 200;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPALSettings noReport = settings;
+  noReport.errorReportSamples = 0;
+  OPAL reference(noReport, db);
+  reference.Run();
+  ASSERT_TRUE(reference.getApproximationErrors().empty());
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  // Reports don't change the run.
+  ASSERT_EQ(reference.getFieldX(), opal.getFieldX());
+  ASSERT_EQ(reference.GetOutput(), opal.GetOutput());
+
+  const auto &errors = opal.getApproximationErrors();
+  ASSERT_EQ(5u, errors.size());
+  for (size_t k = 0; k < errors.size(); ++k) {
+    ASSERT_EQ(k, errors[k].iteration);
+    ASSERT_GE(errors[k].meanCostGap, 0.0);
+    ASSERT_GE(errors[k].optimalFraction, 0.0);
+    ASSERT_LE(errors[k].optimalFraction, 1.0);
+  }
+  ASSERT_LT(errors.back().meanCostGap, errors.front().meanCostGap);
+}
+
+
+// Sums of integer pixels are exact, so both engines give the same field.
+TEST(ExhaustiveSearch, SummedAreasMatchRun) {
+  OPAL::DatabaseType db;
+  db.SetBorder(2);
+  for (int t = 0; t < 4; ++t) {
+    Image<double> img(23, 31);
+    for (size_t i = 0; i < img.getSize(); ++i)
+      img[i] = std::rand() % 256;
+    db.Add(img, Image<int>(23, 31, 1));
+  }
+
+  ExhaustiveSearch<OPAL::DatabaseType> reference(db, 2, 4);
+  reference.Run();
+
+  for (size_t threads : {1, 3, 64}) {
+    ExhaustiveSearch<OPAL::DatabaseType> search(db, 2, 4);
+    search.RunSummedAreas(threads);
+
+    ASSERT_EQ(reference.getFieldX(), search.getFieldX());
+    ASSERT_EQ(reference.getFieldY(), search.getFieldY());
+    ASSERT_EQ(reference.getFieldT(), search.getFieldT());
+    ASSERT_EQ(reference.getCosts(), search.getCosts());
+  }
+}
+
+
+TEST(OPAL, ExactInitialization) {
+  ASSERT_EQ(InitMode::Random, InitModeFromString("random"));
+  ASSERT_EQ(InitMode::Exact, InitModeFromString("exact"));
+  ASSERT_THROW(InitModeFromString("best"), std::invalid_argument);
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.initWindowRadius = 3;
+  settings.initMode = InitMode::Exact;
+  ASSERT_NE(settings.GetHash(), OPALSettings::GetDefaults().GetHash());
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  FillDatabase(db);
+
+  OPAL opal(settings, db);
+  opal.ConstrainedInitialization();
+
+  ExhaustiveSearch<OPAL::DatabaseType> search(db, settings.patchRadius,
+                                              settings.initWindowRadius);
+  search.Run();
+
+  ASSERT_EQ(search.getFieldX(), opal.getFieldX());
+  ASSERT_EQ(search.getFieldY(), opal.getFieldY());
+  ASSERT_EQ(search.getFieldT(), opal.getFieldT());
+}
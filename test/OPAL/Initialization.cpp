@@ -1,9 +1,11 @@
 #include "OPAL.h"
 #include "../Common.h"
+#include "util/random/CounterRandom.h"
 
 TEST(OPAL, Initialization) {
   OPALSettings settings = OPALSettings::GetDefaults();
   OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
   db.Add("test_data/pictures/alley_1_frame_0001.png",
          "test_data/pictures/alley_1_frame_0001.png");
   db.Add("test_data/pictures/alley_1_frame_0002.png",
@@ -26,15 +28,16 @@ TEST(OPAL, Initialization) {
     for (size_t j = 0; j < fieldX.getWidth(); ++j) {
       // Check that
       //   1. Both offsets lie within initialization window.
-      //   2. Each pixel is mapped so that we can take a patch around it.
+      //   2. Each pixel is mapped inside the image, the patch around it
+      //      may cover ghost pixels.
       auto offsetX = fieldX(i, j);
       auto offsetY = fieldY(i, j);
 
       ASSERT_LE(std::abs(offsetX), settings.initWindowRadius);
       ASSERT_LE(std::abs(offsetY), settings.initWindowRadius);
 
-      ASSERT_GE(i + offsetY, settings.patchRadius);
-      ASSERT_GE(j + offsetX, settings.patchRadius);
+      ASSERT_GE(static_cast<int>(i) + offsetY, 0);
+      ASSERT_GE(static_cast<int>(j) + offsetX, 0);
 
       ASSERT_LT(i + offsetY, fieldX.getHeight());
       ASSERT_LT(j + offsetX, fieldX.getWidth());
@@ -60,3 +63,67 @@ TEST(OPAL, Initialization) {
   # endif
       
 } // test body
+
+
+TEST(OPAL, InitializationSeed) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add("test_data/pictures/alley_1_frame_0001.png",
+         "test_data/pictures/alley_1_frame_0001.png");
+  db.Add("test_data/pictures/alley_1_frame_0002.png",
+         "test_data/pictures/alley_1_frame_0002.png");
+
+  auto initialFieldX = [&](uint64_t seed) {
+    settings.randomSeed = seed;
+    OPAL opal(settings, db);
+    opal.ConstrainedInitialization();
+    return opal.getFieldX().castTo<int>();
+  };
+
+  auto first = initialFieldX(7);
+  EXPECT_EQ(first, initialFieldX(7));
+  EXPECT_NE(first, initialFieldX(8));
+
+  // Pixel draws template, then x and y offsets from its own stream.
+  const size_t i = 100, j = 200;
+  util::CounterRandom random(7, i * first.getWidth() + j);
+  random.UniformInt(1, 1);
+  EXPECT_EQ(random.UniformInt(-10, 10), first(i, j));
+
+  EXPECT_NE(settings.GetHash(),
+            OPALSettings::GetDefaults().GetHash());
+}
+
+
+// Shifted SSDs of runs of equal matches are exact for integer pixels.
+TEST(OPAL, InitialSSDMap) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.initWindowRadius = 3;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  for (int t = 0; t < 3; ++t) {
+    Image<double> img(29, 37);
+    for (size_t i = 0; i < img.getSize(); ++i)
+      img[i] = (i * (t + 3) + i / 37) % 256;
+    db.Add(img, Image<int>(29, 37, 1));
+  }
+
+  for (auto mode : { InitMode::Random, InitMode::Exact }) {
+    settings.initMode = mode;
+    OPAL opal(settings, db);
+    opal.ConstrainedInitialization();
+
+    const auto &ssdMap = opal.getSSDMap();
+    const auto &fieldX = opal.getFieldX();
+    const auto &fieldY = opal.getFieldY();
+    const auto &fieldT = opal.getFieldT();
+    for (size_t i = 0; i < fieldX.getHeight(); ++i)
+      for (size_t j = 0; j < fieldX.getWidth(); ++j) {
+        OPAL::SSDType ssd(db, fieldT(i, j), j, i, j + fieldX(i, j),
+                          i + fieldY(i, j), settings.patchRadius);
+        ASSERT_EQ(ssd.GetValue(), ssdMap(i, j).GetValue()) << i << ", " << j;
+      }
+  }
+}
@@ -0,0 +1,49 @@
+#include "OPAL.h"
+#include "../Common.h"
+#include "../../tools/FloFileIO.h"
+
+TEST(OPAL, IntermediateSaving) {
+  TempDirectory dir;
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.intermediateSaving = true;
+  settings.intermediateSavingPath = dir.GetPath();
+  settings.maxIterations = 4;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add("test_data/Images/01.img", "test_data/Segmentations/01.img");
+  db.Add("test_data/Images/02.img", "test_data/Segmentations/02.img");
+  db.Add("test_data/Images/03.img", "test_data/Segmentations/03.img");
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  // All writes are finished when Run returns, the last file holds the
+  // final fields.
+  Image<int> flowX, flowY;
+  FlowIO::ReadFlowFile(dir.File("0_Initialization.flo"), flowX, flowY);
+  ASSERT_TRUE(ImageHasSize(flowX, 256, 256));
+
+  FlowIO::ReadFlowFile(dir.File("Iteration_3"), flowX, flowY);
+  ASSERT_EQ(opal.getFieldX(), flowX);
+  ASSERT_EQ(opal.getFieldY(), flowY);
+}
+
+
+TEST(OPAL, IntermediateSavingError) {
+  TempDirectory dir;
+
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.intermediateSaving = true;
+  settings.intermediateSavingPath = dir.File("no_such_dir");
+  settings.maxIterations = 1;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add("test_data/Images/01.img", "test_data/Segmentations/01.img");
+  db.Add("test_data/Images/02.img", "test_data/Segmentations/02.img");
+
+  OPAL opal(settings, db);
+  ASSERT_ANY_THROW(opal.Run());
+}
@@ -0,0 +1,107 @@
+#include "OPAL.h"
+#include "../Common.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <vector>
+
+
+TEST(LabelEstimators, FromString) {
+  ASSERT_EQ(LabelEstimatorType::Dummy, LabelEstimatorFromString("dummy"));
+  ASSERT_EQ(LabelEstimatorType::MaxVote, LabelEstimatorFromString("maxVote"));
+  ASSERT_THROW(LabelEstimatorFromString("median"), std::invalid_argument);
+
+  std::ostringstream os;
+  os << LabelEstimatorType::MaxVote;
+  ASSERT_EQ("maxVote", os.str());
+
+  ASSERT_EQ(LabelEstimatorType::Dummy,
+            OPALSettings::GetDefaults().labelEstimator);
+}
+
+
+TEST(OPAL, LabelFusionByMaxVote) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 2;
+  settings.labelEstimator = LabelEstimatorType::MaxVote;
+  const int r = static_cast<int>(settings.patchRadius);
+
+  // Templates are unrelated to the input, so neighbours are matched to
+  // different places and vote for different labels.
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  std::vector<Image<int>> segs;
+  for (int t = 0; t < 3; ++t) {
+    Image<double> img(16, 16);
+    FillRandomizedWithLimits(img, 0, 255);
+    Image<int> seg(16, 16);
+    for (size_t i = 0; i < 16; ++i)
+      for (size_t j = 0; j < 16; ++j)
+        seg(i, j) = 1 + (t ? (i / 3 + j / (2 + t)) % 3 : 0);
+    db.Add(img, seg);
+    segs.push_back(seg);
+  }
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  // Votes of inner pixels are counted from the fields, the output has the
+  // most of them.
+  const auto output = opal.GetOutput();
+  const auto &fieldX = opal.getFieldX();
+  const auto &fieldY = opal.getFieldY();
+  const auto &fieldT = opal.getFieldT();
+  for (int i = r; i + r < 16; ++i)
+    for (int j = r; j + r < 16; ++j) {
+      std::map<int, int> votes;
+      for (int y = i - r; y <= i + r; ++y)
+        for (int x = j - r; x <= j + r; ++x)
+          ++votes[segs[fieldT(y, x)](y + fieldY(y, x), x + fieldX(y, x))];
+
+      int most = 0;
+      for (const auto &vote : votes)
+        most = std::max(most, vote.second);
+      ASSERT_EQ(most, votes[output(i, j)]) << i << ", " << j;
+    }
+}
+
+
+TEST(OPAL, FusionStats) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 2;
+
+  Image<double> img(20, 24);
+  FillRandomizedWithLimits(img, 0, 255);
+  Image<int> seg(20, 24);
+  for (size_t i = 0; i < seg.getHeight(); ++i)
+    for (size_t j = 0; j < seg.getWidth(); ++j)
+      seg(i, j) = 1 + (i / 5 + j / 6) % 3;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add(img, seg);
+  db.Add(img, seg);
+
+  for (auto estimator : { LabelEstimatorType::Dummy,
+                          LabelEstimatorType::MaxVote }) {
+    settings.labelEstimator = estimator;
+    OPAL opal(settings, db);
+    opal.Run();
+
+    const auto &stats = opal.getFusionStats();
+    ASSERT_EQ(img.getSize(), stats.fused + stats.settled);
+
+    // Count pixels whose label isn't the one of their own match.
+    const auto output = opal.GetOutput();
+    size_t mismatches = 0;
+    for (size_t i = 0; i < img.getHeight(); ++i)
+      for (size_t j = 0; j < img.getWidth(); ++j) {
+        int own = seg(i + opal.getFieldY()(i, j), j + opal.getFieldX()(i, j));
+        if (estimator == LabelEstimatorType::Dummy)
+          ASSERT_EQ(own, output(i, j));
+        mismatches += output(i, j) != own;
+      }
+    ASSERT_EQ(mismatches, stats.mismatches);
+  }
+}
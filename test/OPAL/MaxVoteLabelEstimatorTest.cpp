@@ -52,3 +52,15 @@ TEST(LabelEstimators, Test2) {
 
   ASSERT_EQ(0, estimator.EstimateLabel(candidates));
 }
+
+TEST(LabelEstimators, MaxVoteTies) {
+  using EstimatorType = MaxVoteLabelEstimator<int>;
+  EstimatorType estimator(4);
+
+  // Votes of one call don't leak into the next one.
+  ASSERT_EQ(2, estimator.EstimateLabel({ { 3, 1.0 }, { 2, 1.0 } }));
+  ASSERT_EQ(2, estimator.EstimateLabel({ { 2, 1.0 }, { 3, 1.0 } }));
+  ASSERT_EQ(1, estimator.EstimateLabel({ { 3, 1.0 }, { 1, 2.0 },
+                                         { 7, 1.0 }, { 7, 1.0 } }));
+  ASSERT_EQ(3, estimator.EstimateLabel({ { 3, 1.0 } }));
+}
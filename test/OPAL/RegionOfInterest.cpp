@@ -0,0 +1,166 @@
+#include "OPAL.h"
+#include "../Common.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+
+TEST(OPAL, RoiModeFromString) {
+  ASSERT_EQ(RoiModeFromString("none"), RoiMode::None);
+  ASSERT_EQ(RoiModeFromString("threshold"), RoiMode::Threshold);
+  ASSERT_EQ(RoiModeFromString("labels"), RoiMode::Labels);
+  ASSERT_THROW(RoiModeFromString("box"), std::invalid_argument);
+}
+
+
+// Dark background is not segmented, pixels of the bright square are.
+TEST(OPAL, ThresholdRoi) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 4;
+  settings.roiMode = RoiMode::Threshold;
+  settings.roiThreshold = 0;
+
+  // Atlases are labeled everywhere, so label 0 can only come from ROI.
+  Image<double> img(30, 30, 0.0);
+  Image<int> seg(30, 30, 3);
+  for (size_t i = 10; i < 20; ++i)
+    for (size_t j = 12; j < 25; ++j)
+      img(i, j) = 100 + (i * 7 + j * 13) % 50;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add(img, seg);
+  db.Add(img, seg);
+  db.Add(img, seg);
+
+  OPAL opal(settings, db);
+  opal.Run();
+
+  // Pixels in patches of the square are matched, but not segmented.
+  const size_t r = settings.patchRadius;
+  const auto &mask = opal.getRoiMask();
+  const auto &output = opal.GetOutput();
+  const auto &ssdMap = opal.getSSDMap();
+  for (size_t i = 0; i < 30; ++i)
+    for (size_t j = 0; j < 30; ++j) {
+      bool inside = i >= 10 && i < 20 && j >= 12 && j < 25;
+      bool margin = !inside && i + r >= 10 && i < 20 + r && j + r >= 12 &&
+                    j < 25 + r;
+      ASSERT_EQ(mask(i, j), inside ? OPAL::ACTIVE
+                                   : margin ? OPAL::MARGIN : OPAL::OUT_OF_ROI);
+      ASSERT_EQ(output(i, j), inside ? 3 : 0);
+      ASSERT_EQ(std::isfinite(ssdMap(i, j).GetValue()), inside || margin);
+    }
+}
+
+
+// Pixels around the square vote for its edge with propagated matches.
+TEST(OPAL, RoiEdgeVotes) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 4;
+  settings.roiMode = RoiMode::Threshold;
+  settings.roiThreshold = 100;
+  settings.labelEstimator = LabelEstimatorType::MaxVote;
+  const int r = static_cast<int>(settings.patchRadius);
+
+  // Atlases are labeled by stripes across the edge of the square.
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  std::vector<Image<int>> segs;
+  for (int t = 0; t < 3; ++t) {
+    Image<double> img(30, 30);
+    FillRandomizedWithLimits(img, 0, 100);
+    for (size_t i = 10; i < 20; ++i)
+      for (size_t j = 12; j < 25; ++j)
+        img(i, j) += 101;
+    Image<int> seg(30, 30);
+    for (size_t i = 0; i < 30; ++i)
+      for (size_t j = 0; j < 30; ++j)
+        seg(i, j) = 1 + (j / (3 + t) + i / 4) % 3;
+    db.Add(img, seg);
+    segs.push_back(seg);
+  }
+
+  OPAL initial(settings, db);
+  initial.ConstrainedInitialization();
+  OPAL opal(settings, db);
+  opal.Run();
+
+  const auto &mask = opal.getRoiMask();
+  const auto &ssdMap = opal.getSSDMap();
+  const auto &fieldX = opal.getFieldX();
+  const auto &fieldY = opal.getFieldY();
+  const auto &fieldT = opal.getFieldT();
+  const auto output = opal.GetOutput();
+
+  // Margin is propagated, not left with initial matches.
+  double initialCost = 0, cost = 0;
+  for (size_t i = 0; i < 30; ++i)
+    for (size_t j = 0; j < 30; ++j)
+      if (mask(i, j) == OPAL::MARGIN) {
+        initialCost += initial.getSSDMap()(i, j).GetValue();
+        cost += ssdMap(i, j).GetValue();
+      }
+  ASSERT_LT(cost, initialCost);
+
+  // Votes come from matched pixels only, output has the most of them.
+  for (int i = 10; i < 20; ++i)
+    for (int j = 12; j < 25; ++j) {
+      std::map<int, int> votes;
+      for (int y = i - r; y <= i + r; ++y)
+        for (int x = j - r; x <= j + r; ++x) {
+          ASSERT_NE(OPAL::OUT_OF_ROI, mask(y, x)) << y << ", " << x;
+          ASSERT_TRUE(std::isfinite(ssdMap(y, x).GetValue()));
+          ++votes[segs[fieldT(y, x)](y + fieldY(y, x), x + fieldX(y, x))];
+        }
+
+      int most = 0;
+      for (const auto &vote : votes)
+        most = std::max(most, vote.second);
+      ASSERT_EQ(most, votes[output(i, j)]) << i << ", " << j;
+    }
+}
+
+
+// Union of atlas labels is the region of interest.
+TEST(OPAL, LabelsRoi) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  settings.maxIterations = 2;
+  settings.roiMode = RoiMode::Labels;
+
+  Image<double> img(20, 20);
+  FillRandomizedWithLimits(img, 0, 255);
+  Image<int> seg1(20, 20, 0), seg2(20, 20, 0);
+  seg1(3, 4) = 1;
+  seg2(15, 9) = 2;
+
+  OPAL::DatabaseType db;
+  OPAL::PrepareDatabase(db, settings);
+  db.Add(img, seg1);
+  db.Add(img, seg1);
+  db.Add(img, seg2);
+
+  OPAL opal(settings, db);
+
+  const auto &mask = opal.getRoiMask();
+  size_t count = 0;
+  for (size_t i = 0; i < 20; ++i)
+    for (size_t j = 0; j < 20; ++j)
+      count += mask(i, j) == OPAL::ACTIVE;
+  ASSERT_EQ(count, 2u);
+  ASSERT_EQ(mask(3, 4), 1);
+  ASSERT_EQ(mask(15, 9), 1);
+}
+
+
+// Settings with ROI differ from ones without it.
+TEST(OPAL, RoiChangesHash) {
+  OPALSettings settings = OPALSettings::GetDefaults();
+  auto noRoi = settings.GetHash();
+  settings.roiMode = RoiMode::Threshold;
+  auto threshold = settings.GetHash();
+  ASSERT_NE(threshold, noRoi);
+  settings.roiThreshold = 5;
+  ASSERT_NE(settings.GetHash(), threshold);
+}
@@ -216,3 +216,34 @@ TEST_F(IBSRTest, ShiftDown) {
     }
   }
 }
+
+
+namespace {
+
+// Shifts and recalculation with kernels for radius R give the same values
+// as the generic ones.
+template <size_t R, class TDb>
+void CheckKernelsForRadius(const TDb &db) {
+  for (size_t fix = R + 20; fix < 200; fix += 37) {
+    SSD<TDb> generic(db, 2, fix, fix + 3, fix + 7, fix - 5, R);
+    SSD<TDb> unrolled(generic);
+
+    ASSERT_EQ(generic.ShiftRight(), unrolled.template ShiftRight<R>());
+    ASSERT_EQ(generic.ShiftDown(), unrolled.template ShiftDown<R>());
+    ASSERT_EQ(generic.ShiftLeft(), unrolled.template ShiftLeft<R>());
+    ASSERT_EQ(generic.ShiftUp(), unrolled.template ShiftUp<R>());
+    ASSERT_EQ(generic.ShiftImage(&db.GetImage(3)),
+              unrolled.template ShiftImage<R>(&db.GetImage(3)));
+  }
+}
+
+} // namespace
+
+
+TEST_F(IBSRTest, UnrolledKernels) {
+  CheckKernelsForRadius<1>(ibsr);
+  CheckKernelsForRadius<2>(ibsr);
+  CheckKernelsForRadius<3>(ibsr);
+  CheckKernelsForRadius<4>(ibsr);
+  CheckKernelsForRadius<5>(ibsr);
+}
@@ -0,0 +1,124 @@
+#include "Common.h"
+#include "SegmentationAccuracyEstimator.h"
+
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+// Reference Dice scores, counted label by label.
+std::map<int, double> NaiveDice(const Image<int> &truth,
+                                const Image<int> &result) {
+  std::map<int, size_t> a, b, ab;
+  for (size_t i = 0; i < truth.getSize(); ++i) {
+    ++a[truth[i]];
+    ++b[result[i]];
+    if (truth[i] == result[i])
+      ++ab[truth[i]];
+  }
+
+  std::map<int, double> dice;
+  for (const auto &l : a)
+    dice[l.first] = 0.0;
+  for (const auto &l : b)
+    dice[l.first] = 0.0;
+  for (const auto &l : ab)
+    dice[l.first] = 2.0 * l.second / double(a[l.first] + b[l.first]);
+  return dice;
+}
+
+
+Image<int> RandomSegmentation(size_t h, size_t w, int labels) {
+  Image<int> seg(h, w);
+  for (size_t i = 0; i < seg.getSize(); ++i)
+    seg[i] = RandGen::GetInstance()->Random(0, labels - 1);
+  return seg;
+}
+
+} // namespace
+
+
+TEST(SegmentationAccuracyEstimatorTests, Measures) {
+  // Label 1: 4 pixels in truth, 3 in result, 2 of them overlap.
+  // Label 2: 0 pixels in truth, 1 in result.
+  Image<int> truth(2, 4, 0);
+  Image<int> result(2, 4, 0);
+  truth(0, 0) = truth(0, 1) = truth(1, 0) = truth(1, 1) = 1;
+  result(0, 0) = result(0, 1) = result(0, 2) = 1;
+  result(1, 3) = 2;
+
+  SegmentationAccuracyEstimator<int> estimator;
+  estimator.Estimate(truth, result);
+  auto acc = estimator.GetAccuracyMap();
+
+  ASSERT_EQ(3, acc.size());
+  const auto &one = acc.at(1);
+  EXPECT_EQ(4, one.truthCount);
+  EXPECT_EQ(3, one.resultCount);
+  EXPECT_EQ(2, one.overlap);
+  EXPECT_DOUBLE_EQ(4.0 / 7.0, one.dice);
+  EXPECT_DOUBLE_EQ(2.0 / 5.0, one.jaccard);
+  EXPECT_DOUBLE_EQ(0.5, one.sensitivity);
+  EXPECT_DOUBLE_EQ(2.0 / 3.0, one.precision);
+  EXPECT_DOUBLE_EQ(-0.25, one.volumeDifference);
+
+  const auto &two = acc.at(2);
+  EXPECT_DOUBLE_EQ(0.0, two.dice);
+  EXPECT_DOUBLE_EQ(0.0, two.sensitivity);
+  EXPECT_DOUBLE_EQ(0.0, two.precision);
+  EXPECT_TRUE(std::isinf(two.volumeDifference));
+
+  EXPECT_EQ(2, estimator.GetConfusion(1, 0));
+  EXPECT_EQ(1, estimator.GetConfusion(0, 2));
+  EXPECT_EQ(0, estimator.GetConfusion(2, 2));
+}
+
+
+TEST(SegmentationAccuracyEstimatorTests, DiceMatchesNaiveCount) {
+  auto truth = RandomSegmentation(37, 53, 6);
+  auto result = RandomSegmentation(37, 53, 7);
+
+  auto expected = NaiveDice(truth, result);
+
+  for (size_t threads : { 1, 3, 16 }) {
+    SegmentationAccuracyEstimator<int> estimator;
+    estimator.Estimate(truth, result, threads);
+    auto dice = estimator.GetDiceScoreMap();
+
+    ASSERT_EQ(expected.size(), dice.size());
+    for (const auto &l : expected)
+      EXPECT_DOUBLE_EQ(l.second, dice.at(l.first));
+  }
+}
+
+
+TEST(SegmentationAccuracyEstimatorTests, Batch) {
+  std::vector<Image<int>> truths, results;
+  for (size_t k = 0; k < 5; ++k) {
+    truths.push_back(RandomSegmentation(11, 13, 3));
+    results.push_back(RandomSegmentation(11, 13, 4));
+  }
+
+  auto batch = SegmentationAccuracyEstimator<int>::EstimateBatch(truths,
+                                                                results, 2);
+  ASSERT_EQ(truths.size(), batch.size());
+  for (size_t k = 0; k < truths.size(); ++k) {
+    auto expected = NaiveDice(truths[k], results[k]);
+    ASSERT_EQ(expected.size(), batch[k].size());
+    for (const auto &l : expected)
+      EXPECT_DOUBLE_EQ(l.second, batch[k].at(l.first).dice);
+  }
+
+  results.pop_back();
+  EXPECT_THROW(SegmentationAccuracyEstimator<int>::EstimateBatch(truths,
+                                                                 results),
+               std::invalid_argument);
+}
+
+
+TEST(SegmentationAccuracyEstimatorTests, SizeMismatch) {
+  SegmentationAccuracyEstimator<int> estimator;
+  EXPECT_THROW(estimator.Estimate(Image<int>(3, 4), Image<int>(4, 3)),
+               std::invalid_argument);
+}
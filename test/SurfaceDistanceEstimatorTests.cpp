@@ -0,0 +1,140 @@
+#include "Common.h"
+#include "SurfaceDistanceEstimator.h"
+
+#include <cmath>
+
+
+namespace {
+
+Image<int> Rectangle(size_t h, size_t w, size_t top, size_t left,
+                     size_t bottom, size_t right, int label) {
+  Image<int> seg(h, w, 0);
+  for (size_t i = top; i < bottom; ++i)
+    for (size_t j = left; j < right; ++j)
+      seg(i, j) = label;
+  return seg;
+}
+
+} // namespace
+
+
+TEST(SurfaceDistanceEstimatorTests, Identical) {
+  auto seg = Rectangle(10, 12, 2, 3, 7, 9, 4);
+
+  SurfaceDistanceEstimator<int> estimator;
+  estimator.Estimate(seg, seg);
+  const auto &distances = estimator.GetDistanceMap();
+
+  ASSERT_EQ(2, distances.size());
+  const auto &four = distances.at(4);
+  EXPECT_EQ(18, four.truthSurface);
+  EXPECT_EQ(18, four.resultSurface);
+  EXPECT_DOUBLE_EQ(0.0, four.hausdorff);
+  EXPECT_DOUBLE_EQ(0.0, four.hausdorff95);
+  EXPECT_DOUBLE_EQ(0.0, four.averageSymmetric);
+}
+
+
+TEST(SurfaceDistanceEstimatorTests, ShiftedRectangle) {
+  auto truth = Rectangle(20, 20, 5, 5, 10, 10, 1);
+  auto result = Rectangle(20, 20, 5, 8, 10, 13, 1);
+
+  SurfaceDistanceEstimator<int> estimator;
+  estimator.Estimate(truth, result, 3);
+  const auto &one = estimator.GetDistanceMap().at(1);
+
+  // Surfaces of 5x5 squares shifted by 3 columns.
+  EXPECT_EQ(16, one.truthSurface);
+  EXPECT_EQ(16, one.resultSurface);
+  EXPECT_DOUBLE_EQ(3.0, one.hausdorff);
+  EXPECT_LE(one.hausdorff95, one.hausdorff);
+  EXPECT_GT(one.averageSymmetric, 0.0);
+  EXPECT_LT(one.averageSymmetric, 3.0);
+}
+
+
+TEST(SurfaceDistanceEstimatorTests, MatchesBruteForce) {
+  Image<int> truth(17, 19), result(17, 19);
+  for (size_t i = 0; i < truth.getSize(); ++i) {
+    truth[i] = RandGen::GetInstance()->Random(0, 2);
+    result[i] = RandGen::GetInstance()->Random(0, 3);
+  }
+
+  SurfaceDistanceEstimator<int> estimator;
+  estimator.Estimate(truth, result);
+
+  auto isSurface = [](const Image<int> &seg, size_t i, size_t j) {
+    int l = seg(i, j);
+    auto at = [&](int y, int x) {
+      bool inside = y >= 0 && x >= 0 && y < int(seg.getHeight()) &&
+                    x < int(seg.getWidth());
+      return inside ? seg(y, x) : 0;
+    };
+    int y = int(i), x = int(j);
+    return at(y - 1, x) != l || at(y + 1, x) != l ||
+           at(y, x - 1) != l || at(y, x + 1) != l;
+  };
+
+  for (const auto &entry : estimator.GetDistanceMap()) {
+    const int label = entry.first;
+    std::vector<std::pair<size_t, size_t>> a, b;
+    for (size_t i = 0; i < truth.getHeight(); ++i)
+      for (size_t j = 0; j < truth.getWidth(); ++j) {
+        if (truth(i, j) == label && isSurface(truth, i, j))
+          a.emplace_back(i, j);
+        if (result(i, j) == label && isSurface(result, i, j))
+          b.emplace_back(i, j);
+      }
+    if (a.empty() || b.empty()) {
+      // Label 3 is only in result.
+      EXPECT_TRUE(std::isinf(entry.second.averageSymmetric));
+      continue;
+    }
+
+    auto nearest = [](std::pair<size_t, size_t> p,
+                      const std::vector<std::pair<size_t, size_t>> &set) {
+      double best = 1e30;
+      for (const auto &q : set) {
+        double dy = double(p.first) - double(q.first);
+        double dx = double(p.second) - double(q.second);
+        best = std::min(best, std::sqrt(dy * dy + dx * dx));
+      }
+      return best;
+    };
+
+    double sum = 0.0, largest = 0.0;
+    for (const auto &p : a) {
+      double d = nearest(p, b);
+      sum += d;
+      largest = std::max(largest, d);
+    }
+    for (const auto &p : b) {
+      double d = nearest(p, a);
+      sum += d;
+      largest = std::max(largest, d);
+    }
+
+    EXPECT_EQ(a.size(), entry.second.truthSurface);
+    EXPECT_EQ(b.size(), entry.second.resultSurface);
+    EXPECT_DOUBLE_EQ(largest, entry.second.hausdorff);
+    EXPECT_NEAR(sum / (a.size() + b.size()), entry.second.averageSymmetric,
+                1e-9);
+  }
+}
+
+
+TEST(SurfaceDistanceEstimatorTests, MissingLabel) {
+  auto truth = Rectangle(8, 8, 2, 2, 5, 5, 1);
+  auto result = Rectangle(8, 8, 2, 2, 5, 5, 2);
+
+  SurfaceDistanceEstimator<int> estimator;
+  estimator.Estimate(truth, result);
+
+  const auto &one = estimator.GetDistanceMap().at(1);
+  EXPECT_EQ(0, one.resultSurface);
+  EXPECT_TRUE(std::isinf(one.hausdorff95));
+  EXPECT_TRUE(std::isinf(one.averageSymmetric));
+
+  EXPECT_THROW(estimator.Estimate(Image<int>(3, 4), Image<int>(4, 3)),
+               std::invalid_argument);
+}
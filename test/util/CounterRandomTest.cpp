@@ -0,0 +1,50 @@
+#include "gtest/gtest.h"
+#include "util/random/CounterRandom.h"
+
+#include <vector>
+
+
+using namespace util;
+
+
+TEST(util, CounterRandomStreamsAreIndependent) {
+  // Numbers of a stream don't depend on draws from other streams.
+  std::vector<uint64_t> expected;
+  CounterRandom stream(42, 5);
+  for (int k = 0; k < 4; ++k)
+    expected.push_back(stream());
+
+  CounterRandom other(42, 6);
+  other();
+  CounterRandom again(42, 5);
+  for (int k = 0; k < 4; ++k)
+    ASSERT_EQ(expected[k], again());
+
+  EXPECT_NE(expected[0], CounterRandom(42, 6)());
+  EXPECT_NE(expected[0], CounterRandom(43, 5)());
+  EXPECT_NE(expected[0], CounterRandom(42, 5, 1)());
+
+  CounterRandom skipped(42, 5);
+  skipped.discard(3);
+  EXPECT_EQ(expected[3], skipped());
+}
+
+
+TEST(util, CounterRandomUniformInt) {
+  std::vector<int> counts(7, 0);
+  for (uint64_t s = 0; s < 7000; ++s) {
+    CounterRandom random(1, s);
+    auto value = random.UniformInt(-3, 3);
+    ASSERT_GE(value, -3);
+    ASSERT_LE(value, 3);
+    ++counts[value + 3];
+  }
+
+  for (int count : counts) {
+    EXPECT_GT(count, 850);
+    EXPECT_LT(count, 1150);
+  }
+
+  CounterRandom random(1, 0);
+  EXPECT_EQ(5, random.UniformInt(5, 5));
+}
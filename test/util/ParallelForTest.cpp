@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+#include "util/thread/ParallelFor.h"
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+using namespace util;
+
+
+TEST(util, ParallelForCoversRange) {
+  for (size_t threads : {1, 3, 8, 100}) {
+    std::vector<int> visits(37, 0);
+    ParallelFor(5, 37, [&visits](size_t i) { ++visits[i]; }, threads);
+
+    for (size_t i = 0; i < visits.size(); ++i)
+      ASSERT_EQ(i < 5 ? 0 : 1, visits[i]);
+  }
+}
+
+
+TEST(util, ParallelForEmptyRange) {
+  std::atomic<int> calls(0);
+  ParallelFor(10, 10, [&calls](size_t) { ++calls; });
+  ParallelFor(10, 3, [&calls](size_t) { ++calls; });
+  ParallelFor(0, 5, [&calls](size_t) { ++calls; }, 0);
+  ASSERT_EQ(5, calls);
+}
+
+
+TEST(util, ParallelForException) {
+  std::atomic<int> calls(0);
+  auto f = [&calls](size_t i) {
+    ++calls;
+    if (i == 42)
+      throw std::runtime_error("failed");
+  };
+  ASSERT_THROW(ParallelFor(0, 100, f, 4), std::runtime_error);
+  // Other blocks are finished anyway.
+  ASSERT_GE(calls, 75);
+}
+
+
+TEST(util, ParallelForReusesThreads) {
+  std::mutex mutex;
+  std::set<std::thread::id> ids;
+  for (int call = 0; call < 20; ++call)
+    ParallelFor(0, 64, [&](size_t) {
+      std::lock_guard<std::mutex> lock(mutex);
+      ids.insert(std::this_thread::get_id());
+    }, 8);
+
+  // Pool workers and the calling thread.
+  ASSERT_LE(ids.size(), SharedThreadPool().GetThreadCount() + 1);
+}
+
+
+TEST(util, ParallelForNested) {
+  std::atomic<int> calls(0);
+  ParallelFor(0, 16, [&calls](size_t) {
+    ParallelFor(0, 16, [&calls](size_t) { ++calls; }, 16);
+  }, 16);
+  ASSERT_EQ(256, calls);
+}
@@ -0,0 +1,43 @@
+#include "gtest/gtest.h"
+#include "util/thread/ThreadPool.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+
+using namespace util;
+
+
+TEST(util, ThreadPoolResults) {
+  ThreadPool pool(3);
+  ASSERT_EQ(3, pool.GetThreadCount());
+
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i)
+    results.push_back(pool.Submit([i]() { return i * i; }));
+
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(i * i, results[i].get());
+}
+
+
+TEST(util, ThreadPoolException) {
+  ThreadPool pool(2);
+  auto result = pool.Submit([]() -> int {
+    throw std::runtime_error("task failed");
+  });
+  ASSERT_THROW(result.get(), std::runtime_error);
+}
+
+
+TEST(util, ThreadPoolFinishesTasks) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool pool(0);
+    ASSERT_EQ(1, pool.GetThreadCount());
+    for (int i = 0; i < 50; ++i)
+      pool.Submit([&counter]() { ++counter; });
+  }
+  ASSERT_EQ(50, counter.load());
+}
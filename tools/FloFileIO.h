@@ -4,6 +4,8 @@
 #include <fstream>
 #include <stdexcept>
 #include <cmath>
+#include <cstring>
+#include <vector>
 
 namespace FlowIO {
 
@@ -28,23 +30,26 @@ void ReadFlowFile(const std::string &fileName,
   ifs.read(reinterpret_cast<char*>(&width), BYTES_COUNT);
   ifs.read(reinterpret_cast<char*>(&height), BYTES_COUNT);
 
-  FlowX.Allocate(height, width);
-  FlowY.Allocate(height, width);
+  if (width <= 0 || height <= 0)
+    throw std::runtime_error("Wrong size read from file " + fileName);
 
-  for (int i = 0; i < height; ++i)
-    for (int j = 0; j < width; ++j) {
-      float x = 0.0f, y = 0.0f;
-      ifs.read(reinterpret_cast<char*>(&x), BYTES_COUNT);
-      ifs.read(reinterpret_cast<char*>(&y), BYTES_COUNT);
-      FlowX(i, j) = static_cast<T>(x);
-      FlowY(i, j) = static_cast<T>(y);
-    }
+  FlowX.Resize(height, width);
+  FlowY.Resize(height, width);
+
+  // Interleaved (x, y) pairs, read all at once.
+  std::vector<float> flow(2 * FlowX.getSize());
+  ifs.read(reinterpret_cast<char*>(flow.data()), flow.size() * BYTES_COUNT);
+
+  for (size_t i = 0; i < FlowX.getSize(); ++i) {
+    FlowX[i] = static_cast<T>(flow[2 * i]);
+    FlowY[i] = static_cast<T>(flow[2 * i + 1]);
+  }
 }
 
 
+// Encodes flow fields into the contents of a .flo file.
 template<class T>
-void WriteFlowFile(const std::string &fileName,
-                   const Image<T> &FlowX, const Image<T> &FlowY) {
+std::vector<char> EncodeFlow(const Image<T> &FlowX, const Image<T> &FlowY) {
   if (FlowX.isEmpty() || FlowY.isEmpty())
     throw std::invalid_argument("One of the matrices is empty!");
   if (FlowX.getHeight() != FlowY.getHeight())
@@ -52,27 +57,44 @@ void WriteFlowFile(const std::string &fileName,
   if (FlowX.getWidth() != FlowY.getWidth())
     throw std::invalid_argument("Matrices have different widths!");
 
-  std::ofstream ofs;
-  ofs.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  ofs.open(fileName, std::ios::binary);
-
-  // Write the tag.
-  ofs.write(reinterpret_cast<const char*>(&TAG_FLOAT), BYTES_COUNT);
+  std::vector<char> contents(BYTES_COUNT * (3 + 2 * FlowX.getSize()));
+  char *out = contents.data();
 
-  // Write the size.
+  // Tag and size.
   int width = static_cast<int>(FlowX.getWidth());
   int height = static_cast<int>(FlowX.getHeight());
-  ofs.write(reinterpret_cast<char*>(&width), BYTES_COUNT);
-  ofs.write(reinterpret_cast<char*>(&height), BYTES_COUNT);
+  std::memcpy(out, &TAG_FLOAT, BYTES_COUNT);
+  std::memcpy(out + BYTES_COUNT, &width, BYTES_COUNT);
+  std::memcpy(out + 2 * BYTES_COUNT, &height, BYTES_COUNT);
+  out += 3 * BYTES_COUNT;
 
   for (size_t i = 0; i < FlowX.getHeight(); ++i)
     for (size_t j = 0; j < FlowX.getWidth(); ++j) {
       float xFlow = static_cast<float>(FlowX(i, j));
       float yFlow = static_cast<float>(FlowY(i, j));
-      ofs.write(reinterpret_cast<char*>(&xFlow), BYTES_COUNT);
-      ofs.write(reinterpret_cast<char*>(&yFlow), BYTES_COUNT);
+      std::memcpy(out, &xFlow, BYTES_COUNT);
+      std::memcpy(out + BYTES_COUNT, &yFlow, BYTES_COUNT);
+      out += 2 * BYTES_COUNT;
     }
+
+  return contents;
 }
 
-} // FlowIO namespace
 
+// Writes encoded .flo file contents with a single write.
+inline void WriteFlowContents(const std::string &fileName,
+                              const std::vector<char> &contents) {
+  std::ofstream ofs;
+  ofs.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+  ofs.open(fileName, std::ios::binary);
+  ofs.write(contents.data(), contents.size());
+}
+
+
+template<class T>
+void WriteFlowFile(const std::string &fileName,
+                   const Image<T> &FlowX, const Image<T> &FlowY) {
+  WriteFlowContents(fileName, EncodeFlow(FlowX, FlowY));
+}
+
+} // FlowIO namespace